@@ -0,0 +1,1525 @@
+/*
+ * ----------------------------------------------------------------------
+ * |\ /| mxjson-bench.c
+ * | X | Parser benchmark driver
+ * |/ \|
+ * ----------------------------------------------------------------------
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "mxjson.h"
+#include "mxjson-write.h"
+#include "mxstr.h"
+#include "bench/mxjson-corpus.h"
+
+
+/**
+ * The maximum number of bytes to read from an input file at a time.
+ */
+#define READ_SIZE 65536
+
+
+/**
+ * Size of each document, and of the complete stream, for the generated
+ * NDJSON stream used to measure per-document latency.
+ */
+#define NDJSON_DOC_SIZE 512
+#define NDJSON_SIZE     (4 << 20)
+
+
+/**
+ * Number of bits of each latency used to select a histogram bucket within
+ * a power of 2, giving a resolution of 1/32 (about 3%).
+ */
+#define HISTOGRAM_SUB_BITS 5
+
+
+/**
+ * Number of histogram buckets, covering latencies up to 2^64 ns.
+ */
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+
+/**
+ * Number of the slowest documents to report in the latency distribution.
+ */
+#define OUTLIERS 5
+
+
+/**
+ * Benchmark modes.
+ */
+typedef enum {
+    BENCH_TOKENS,     /**< mxjson_parse() */
+    BENCH_PADDED,     /**< mxjson_parse_padded() */
+    BENCH_VALIDATE,   /**< mxjson_validate() */
+    BENCH_UNESCAPE,   /**< mxjson_parse(), then unescape every string */
+    BENCH_MODE_COUNT
+} bench_mode_t;
+
+
+/**
+ * Names of the benchmark modes.
+ */
+static const char *bench_mode_names[BENCH_MODE_COUNT] = {
+    "tokens", "padded", "validate", "unescape",
+};
+
+
+/**
+ * How each thread allocates tokens in the scaling benchmark.
+ */
+typedef enum {
+    BENCH_RESIZE,       /**< A new parser for each parse, using mxjson_resize */
+    BENCH_USER_TOKENS,  /**< A token array per thread, reused for each parse */
+    BENCH_STRATEGY_COUNT
+} bench_strategy_t;
+
+
+/**
+ * Names of the token allocation strategies.
+ */
+static const char *bench_strategy_names[BENCH_STRATEGY_COUNT] = {
+    "resize", "tokens",
+};
+
+
+/**
+ * Hardware performance counters.
+ */
+typedef enum {
+    BENCH_CYCLES,         /**< CPU cycles */
+    BENCH_INSTRUCTIONS,   /**< Instructions retired */
+    BENCH_BRANCH_MISSES,  /**< Mispredicted branches */
+    BENCH_L1D_MISSES,     /**< L1 data cache read misses */
+    BENCH_LLC_MISSES,     /**< Last level cache read misses */
+    BENCH_COUNTER_COUNT
+} bench_counter_t;
+
+
+/**
+ * Names of the hardware performance counters.
+ */
+static const char *bench_counter_names[BENCH_COUNTER_COUNT] = {
+    "cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses",
+};
+
+
+/**
+ * A group of hardware performance counters, which are enabled together
+ * around each parse.
+ *
+ * Counters that can't be opened (e.g. in a container or VM without a
+ * PMU, or where perf_event_paranoid forbids it) are left out of the
+ * group, and aren't reported.
+ */
+typedef struct {
+    int      leader;                        /**< Group leader fd, or -1 */
+    int      fds[BENCH_COUNTER_COUNT];      /**< Counter fds, or -1 */
+    int      slots[BENCH_COUNTER_COUNT];    /**< Position in group reads */
+    int      opened;                        /**< Counters in the group */
+    bool     valid;                         /**< Whether counts were read */
+    uint64_t totals[BENCH_COUNTER_COUNT];   /**< Counts since reset */
+} bench_counters_t;
+
+
+/**
+ * Result of benchmarking a document in one mode.
+ */
+typedef struct {
+    const char   *name;        /**< Name of the document */
+    bench_mode_t  mode;        /**< Benchmark mode */
+    size_t        bytes;       /**< Size of the document */
+    mxjson_idx_t  tokens;      /**< Number of tokens in the document */
+    unsigned int  iterations;  /**< Number of times the document was parsed */
+    double        best;        /**< Fastest time for a single parse (s) */
+    double        mean;        /**< Mean time for a single parse (s) */
+    long          peak_rss;    /**< Peak resident set size (kB) */
+    bool          counted[BENCH_COUNTER_COUNT]; /**< Counters available */
+    double        counts[BENCH_COUNTER_COUNT];  /**< Mean count per parse */
+} bench_result_t;
+
+
+/**
+ * A document that was slow to parse.
+ */
+typedef struct {
+    size_t   line;   /**< Line number of the document in the input */
+    size_t   bytes;  /**< Size of the document */
+    uint64_t ns;     /**< Time to parse the document */
+} bench_outlier_t;
+
+
+/**
+ * Histogram of parse latencies.
+ *
+ * The buckets have a constant relative width (in the style of an HDR
+ * histogram): latencies below 2^(HISTOGRAM_SUB_BITS + 1) ns each have a
+ * bucket, and each power of 2 above that is divided into
+ * 2^HISTOGRAM_SUB_BITS buckets. The slowest documents are recorded
+ * individually.
+ */
+typedef struct {
+    uint64_t        buckets[HISTOGRAM_BUCKETS]; /**< Counts */
+    uint64_t        count;     /**< Number of latencies recorded */
+    uint64_t        total;     /**< Sum of the latencies (ns) */
+    uint64_t        min;       /**< Lowest latency (ns) */
+    uint64_t        max;       /**< Highest latency (ns) */
+    bench_outlier_t worst[OUTLIERS]; /**< Slowest documents, slowest first */
+} bench_histogram_t;
+
+
+/**
+ * A thread in the scaling benchmark. Each thread has its own parser
+ * context, and parses the same (read-only) document.
+ */
+typedef struct {
+    pthread_t           thread;    /**< Thread handle */
+    pthread_barrier_t  *barrier;   /**< Barrier to start the threads together */
+    bench_strategy_t    strategy;  /**< Token allocation strategy */
+    mxstr_t             json;      /**< Document to parse (shared) */
+    mxjson_idx_t        tokens;    /**< Number of tokens in the document */
+    unsigned int        iterations; /**< Times to parse the document */
+    double              start;     /**< Time the thread started parsing */
+    double              end;       /**< Time the thread finished parsing */
+    bool                ok;        /**< Whether every parse succeeded */
+} bench_thread_t;
+
+
+/**
+ * Result of the scaling benchmark for a number of threads.
+ */
+typedef struct {
+    bench_strategy_t strategy;    /**< Token allocation strategy */
+    unsigned int     threads;     /**< Number of threads */
+    double           mb_per_s;    /**< Aggregate throughput (MB/s) */
+    double           thread_min;  /**< Slowest thread throughput (MB/s) */
+    double           thread_mean; /**< Mean thread throughput (MB/s) */
+    double           thread_max;  /**< Fastest thread throughput (MB/s) */
+    double           efficiency;  /**< Throughput relative to perfect scaling */
+} bench_scaling_t;
+
+
+/**
+ * Benchmark settings.
+ */
+typedef struct {
+    unsigned int      iterations; /**< Times to parse each document */
+    unsigned int      threads;    /**< Maximum threads for scaling, or 0 */
+    uint32_t          lazy_depth; /**< Depth limit for tokenizing, or 0 */
+    bool              modes[BENCH_MODE_COUNT]; /**< Modes to run */
+    bool              table;      /**< Output a table rather than JSON */
+    bool              latency;    /**< Measure per-document latency */
+    const char       *label;      /**< Label identifying the build */
+    bench_counters_t *counters;   /**< Hardware counters, or NULL */
+} bench_config_t;
+
+
+/**
+ * Get the current time in seconds from a monotonic clock.
+ */
+static double
+bench_now (void)
+{
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+ * Reset the peak resident set size of the process (Linux only), so that
+ * the peak can be measured for each document.
+ */
+static void
+bench_peak_rss_reset (void)
+{
+    FILE *f;
+
+    f = fopen("/proc/self/clear_refs", "w");
+
+    if (f != NULL) {
+        (void)fputs("5", f);
+        (void)fclose(f);
+    }
+}
+
+
+/**
+ * Get the peak resident set size of the process in kB.
+ *
+ * The peak since the last call to bench_peak_rss_reset() is read from
+ * /proc/self/status where available, otherwise the peak for the lifetime
+ * of the process is used.
+ */
+static long
+bench_peak_rss (void)
+{
+    struct rusage usage;
+    char          line[256];
+    long          rss = -1;
+    FILE         *f;
+
+    f = fopen("/proc/self/status", "r");
+
+    if (f != NULL) {
+        while (rss < 0 && fgets(line, sizeof(line), f) != NULL) {
+            if (strncmp(line, "VmHWM:", 6) == 0) {
+                rss = atol(&line[6]);
+            }
+        }
+        (void)fclose(f);
+    }
+
+    if (rss < 0 && getrusage(RUSAGE_SELF, &usage) == 0) {
+        rss = usage.ru_maxrss;
+    }
+
+    return rss;
+}
+
+
+#if defined(__linux__)
+/**
+ * Open a hardware performance counter for the calling thread.
+ */
+static int
+bench_counter_open (bench_counter_t counter, int group_fd)
+{
+    static const struct {
+        uint32_t type;
+        uint64_t config;
+    } events[BENCH_COUNTER_COUNT] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                              (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL |
+                              (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    };
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[counter].type;
+    attr.config = events[counter].config;
+    attr.disabled = (group_fd == -1);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+#endif
+
+
+/**
+ * Close the hardware performance counters.
+ */
+static void
+bench_counters_close (bench_counters_t *c)
+{
+    bench_counter_t counter;
+
+    for (counter = 0; counter < BENCH_COUNTER_COUNT; counter++) {
+        if (c->fds[counter] != -1) {
+            (void)close(c->fds[counter]);
+            c->fds[counter] = -1;
+        }
+    }
+
+    c->leader = -1;
+}
+
+
+/**
+ * Clear the counts accumulated by bench_counters_stop().
+ */
+static void
+bench_counters_reset (bench_counters_t *c)
+{
+    memset(c->totals, 0, sizeof(c->totals));
+    c->valid = (c->leader != -1);
+}
+
+
+/**
+ * Start counting.
+ */
+static void
+bench_counters_start (bench_counters_t *c)
+{
+#if defined(__linux__)
+    if (c->leader != -1) {
+        (void)ioctl(c->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        (void)ioctl(c->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#else
+    UNUSED(c);
+#endif
+}
+
+
+/**
+ * Stop counting, and add the counts to the totals.
+ *
+ * The counts are only valid if the group was counting for the whole
+ * time it was enabled. Otherwise (e.g. if the PMU was shared with another
+ * process, so that the group was multiplexed), the counts are marked as
+ * invalid rather than being scaled.
+ */
+static void
+bench_counters_stop (bench_counters_t *c)
+{
+#if defined(__linux__)
+    uint64_t        data[3 + BENCH_COUNTER_COUNT];
+    bench_counter_t counter;
+    bool            ok;
+
+    if (c->leader != -1) {
+        (void)ioctl(c->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        ok = (read(c->leader, data, sizeof(data)) ==
+              (ssize_t)((3 + c->opened) * sizeof(data[0])) &&
+              data[0] == (uint64_t)c->opened && data[1] == data[2]);
+
+        for (counter = 0; ok && counter < BENCH_COUNTER_COUNT; counter++) {
+            if (c->fds[counter] != -1) {
+                c->totals[counter] += data[3 + c->slots[counter]];
+            }
+        }
+
+        c->valid = c->valid && ok;
+    }
+#else
+    UNUSED(c);
+#endif
+}
+
+
+/**
+ * Open the hardware performance counters.
+ *
+ * Each counter that is supported is added to the group. If the group
+ * can't be scheduled on the PMU as a whole (e.g. a VM that provides fewer
+ * hardware counters), counters are dropped from the end of the list until
+ * it can.
+ *
+ * @return
+ *   Indicates whether any counters are available. A warning is output if
+ *   not, and parsing can still be benchmarked.
+ */
+static bool
+bench_counters_open (bench_counters_t *c)
+{
+    bench_counter_t counter;
+    bench_counter_t limit;
+    int             error = 0;
+
+    memset(c, 0, sizeof(*c));
+    c->leader = -1;
+
+    for (limit = BENCH_COUNTER_COUNT; !c->valid && limit > 0; limit--) {
+        c->leader = -1;
+        c->opened = 0;
+
+        for (counter = 0; counter < BENCH_COUNTER_COUNT; counter++) {
+#if defined(__linux__)
+            c->fds[counter] = (counter < limit) ?
+                              bench_counter_open(counter, c->leader) : -1;
+#else
+            c->fds[counter] = -1;
+            errno = ENOSYS;
+#endif
+
+            if (c->fds[counter] != -1) {
+                c->leader = (c->leader == -1) ? c->fds[counter] : c->leader;
+                c->slots[counter] = c->opened++;
+            } else if (counter < limit) {
+                error = errno;
+            }
+        }
+
+        /*
+         * Check that the group counts.
+         */
+        bench_counters_reset(c);
+        bench_counters_start(c);
+        bench_counters_stop(c);
+
+        if (!c->valid) {
+            bench_counters_close(c);
+        }
+    }
+
+    if (!c->valid) {
+        fprintf(stderr, "Hardware performance counters are unavailable"
+                " (%s)\n", strerror(error != 0 ? error : EBUSY));
+    }
+
+    return c->valid;
+}
+
+
+/**
+ * Read a file into a buffer, followed by padding for mxjson_parse_padded().
+ */
+static bool
+bench_read_file (const char *filename, mxbuf_t *buffer)
+{
+    ssize_t size = -1;
+    int     fd;
+
+    fd = open(filename, O_RDONLY);
+
+    if (fd != -1) {
+        do {
+            mxbuf_require(buffer, READ_SIZE);
+            size = read(fd, buffer->available.ptr, READ_SIZE);
+
+            if (size > 0) {
+                (void)mxstr_consume(&buffer->available, size);
+            }
+        } while (size > 0);
+
+        (void)close(fd);
+    }
+
+    mxbuf_pad(buffer, MXJSON_PADDING);
+
+    return (size == 0);
+}
+
+
+/**
+ * Unescape the name and string value of every token.
+ *
+ * @return
+ *   The total length of the names and values, so that the work can't be
+ *   optimised away.
+ */
+static size_t
+bench_unescape_all (mxjson_parser_t *p, mxbuf_t *buffer)
+{
+    mxjson_idx_t idx;
+    size_t       len = 0;
+
+    for (idx = 1; idx <= p->idx; idx++) {
+        mxbuf_reset(buffer);
+        len += mxjson_token_name(p, idx, buffer, NULL).len;
+        len += mxjson_token_string(p, idx, buffer, NULL).len;
+    }
+
+    return len;
+}
+
+
+/**
+ * Parse a document repeatedly in one mode.
+ *
+ * @return
+ *   Indicates whether every parse succeeded.
+ */
+static bool
+bench_run (const bench_config_t *config,
+           mxjson_parser_t      *p,
+           mxstr_t               json,
+           bench_result_t       *result)
+{
+    bench_counters_t *counters = config->counters;
+    bench_counter_t   counter;
+    mxbuf_t           buffer;
+    volatile size_t   sink = 0;
+    double            start;
+    double            elapsed;
+    double            total = 0;
+    unsigned int      i;
+    bool              ok = true;
+
+    mxbuf_create(&buffer, NULL, 0);
+    result->iterations = config->iterations;
+    result->best = 0;
+
+    if (counters != NULL) {
+        bench_counters_reset(counters);
+    }
+
+    for (i = 0; ok && i < config->iterations; i++) {
+        if (counters != NULL) {
+            bench_counters_start(counters);
+        }
+        start = bench_now();
+
+        switch (result->mode) {
+        case BENCH_TOKENS:
+            ok = mxjson_parse(p, json);
+            break;
+
+        case BENCH_PADDED:
+            ok = mxjson_parse_padded(p, json);
+            break;
+
+        case BENCH_VALIDATE:
+            ok = mxjson_validate(json);
+            break;
+
+        case BENCH_UNESCAPE:
+            ok = mxjson_parse(p, json);
+            sink += ok ? bench_unescape_all(p, &buffer) : 0;
+            break;
+
+        default:
+            ok = false;
+            break;
+        }
+
+        elapsed = bench_now() - start;
+        total += elapsed;
+
+        if (counters != NULL) {
+            bench_counters_stop(counters);
+        }
+
+        if (i == 0 || elapsed < result->best) {
+            result->best = elapsed;
+        }
+    }
+
+    result->mean = total / config->iterations;
+
+    for (counter = 0; counter < BENCH_COUNTER_COUNT; counter++) {
+        result->counted[counter] = (counters != NULL && counters->valid &&
+                                    counters->fds[counter] != -1);
+        result->counts[counter] = result->counted[counter] ?
+            (double)counters->totals[counter] / config->iterations : 0;
+    }
+
+    mxbuf_free(&buffer);
+    (void)sink;
+
+    return ok;
+}
+
+
+/**
+ * Flush callback to write JSON output to stdout.
+ */
+static bool
+bench_flush (void *ctx, mxstr_t data)
+{
+    return (fwrite(data.ptr, 1, data.len, ctx) == data.len);
+}
+
+
+/**
+ * Output the ratio of a hardware counter to the bytes or tokens parsed, as
+ * a member of a JSON object (e.g. "cycles_per_byte").
+ */
+static void
+bench_output_ratio (mxjson_writer_t *w,
+                    bench_counter_t  counter,
+                    const char      *unit,
+                    double           value)
+{
+    char key[64];
+    int  len;
+
+    len = snprintf(key, sizeof(key), "%s_per_%s",
+                   bench_counter_names[counter], unit);
+    (void)mxjson_writer_key(w, mxstr(key, len));
+    (void)mxjson_writer_double(w, value);
+}
+
+
+/**
+ * Output a result as a single line of JSON.
+ */
+static void
+bench_output_json (const bench_config_t *config, const bench_result_t *r)
+{
+    mxjson_writer_t w;
+    bench_counter_t counter;
+    char            buf[2048];
+
+    mxjson_writer_init(&w, buf, sizeof(buf), bench_flush, stdout);
+    (void)mxjson_writer_begin_object(&w);
+
+    if (config->label != NULL) {
+        (void)mxjson_writer_key(&w, mxstr_literal("label"));
+        (void)mxjson_writer_string(&w, mxstr((char *)config->label,
+                                             strlen(config->label)));
+    }
+
+    (void)mxjson_writer_key(&w, mxstr_literal("file"));
+    (void)mxjson_writer_string(&w, mxstr((char *)r->name, strlen(r->name)));
+    (void)mxjson_writer_key(&w, mxstr_literal("mode"));
+    (void)mxjson_writer_string(&w, mxstr((char *)bench_mode_names[r->mode],
+                                         strlen(bench_mode_names[r->mode])));
+    (void)mxjson_writer_key(&w, mxstr_literal("bytes"));
+    (void)mxjson_writer_int(&w, r->bytes);
+    (void)mxjson_writer_key(&w, mxstr_literal("tokens"));
+    (void)mxjson_writer_int(&w, r->tokens);
+    (void)mxjson_writer_key(&w, mxstr_literal("iterations"));
+    (void)mxjson_writer_int(&w, r->iterations);
+    (void)mxjson_writer_key(&w, mxstr_literal("best_s"));
+    (void)mxjson_writer_double(&w, r->best);
+    (void)mxjson_writer_key(&w, mxstr_literal("mean_s"));
+    (void)mxjson_writer_double(&w, r->mean);
+    (void)mxjson_writer_key(&w, mxstr_literal("mb_per_s"));
+    (void)mxjson_writer_double(&w, r->bytes / r->best / 1e6);
+    (void)mxjson_writer_key(&w, mxstr_literal("tokens_per_s"));
+    (void)mxjson_writer_double(&w, r->tokens / r->best);
+    (void)mxjson_writer_key(&w, mxstr_literal("ns_per_token"));
+    (void)mxjson_writer_double(&w, r->best * 1e9 / r->tokens);
+    (void)mxjson_writer_key(&w, mxstr_literal("peak_rss_kb"));
+    (void)mxjson_writer_int(&w, r->peak_rss);
+
+    for (counter = 0; counter < BENCH_COUNTER_COUNT; counter++) {
+        if (r->counted[counter]) {
+            bench_output_ratio(&w, counter, "byte",
+                               r->counts[counter] / r->bytes);
+            bench_output_ratio(&w, counter, "token",
+                               r->counts[counter] / r->tokens);
+        }
+    }
+
+    if (r->counted[BENCH_CYCLES] && r->counted[BENCH_INSTRUCTIONS]) {
+        (void)mxjson_writer_key(&w, mxstr_literal("ipc"));
+        (void)mxjson_writer_double(&w, r->counts[BENCH_INSTRUCTIONS] /
+                                       r->counts[BENCH_CYCLES]);
+    }
+
+    (void)mxjson_writer_end_object(&w);
+
+    if (mxjson_writer_finish(&w)) {
+        (void)putchar('\n');
+    }
+}
+
+
+/**
+ * Output a column of a table for a hardware counter ratio, or "-" if the
+ * counter is not available.
+ */
+static void
+bench_output_column (const bench_result_t *r,
+                     bench_counter_t       counter,
+                     bench_counter_t       per,
+                     double                divisor)
+{
+    if (r->counted[counter] && (per == BENCH_COUNTER_COUNT ||
+                                r->counted[per])) {
+        printf(" %8.3f", r->counts[counter] /
+               (per == BENCH_COUNTER_COUNT ? divisor : r->counts[per]));
+    } else {
+        printf(" %8s", "-");
+    }
+}
+
+
+/**
+ * Output a result as a row of a table.
+ */
+static void
+bench_output_table (const bench_config_t *config, const bench_result_t *r)
+{
+    printf("%-12s %-9s %10zu %9u %9.1f %9.2f %8.2f %9ld",
+           r->name, bench_mode_names[r->mode], r->bytes, r->tokens,
+           r->bytes / r->best / 1e6, r->tokens / r->best / 1e6,
+           r->best * 1e9 / r->tokens, r->peak_rss);
+
+    if (config->counters != NULL) {
+        bench_output_column(r, BENCH_CYCLES, BENCH_COUNTER_COUNT, r->bytes);
+        bench_output_column(r, BENCH_INSTRUCTIONS, BENCH_COUNTER_COUNT,
+                            r->bytes);
+        bench_output_column(r, BENCH_INSTRUCTIONS, BENCH_CYCLES, 0);
+        bench_output_column(r, BENCH_BRANCH_MISSES, BENCH_COUNTER_COUNT,
+                            r->tokens);
+        bench_output_column(r, BENCH_L1D_MISSES, BENCH_COUNTER_COUNT,
+                            r->tokens);
+        bench_output_column(r, BENCH_LLC_MISSES, BENCH_COUNTER_COUNT,
+                            r->tokens);
+    }
+
+    (void)putchar('\n');
+}
+
+
+/**
+ * Benchmark a document in each of the selected modes.
+ *
+ * @return
+ *   Indicates whether the document was parsed successfully in every mode.
+ */
+static bool
+bench_document (const bench_config_t *config, const char *name, mxstr_t json)
+{
+    mxjson_parser_t p;
+    bench_result_t  result;
+    bench_mode_t    mode;
+    bool            ok;
+
+    /*
+     * Count the tokens, so that validation (which produces no tokens) can
+     * be reported per token too.
+     */
+    mxjson_init(&p, 0, NULL, mxjson_resize);
+    mxjson_lazy_depth(&p, config->lazy_depth);
+    ok = mxjson_parse(&p, json);
+    result.name = name;
+    result.bytes = json.len;
+    result.tokens = p.idx;
+    mxjson_free(&p);
+
+    for (mode = 0; ok && mode < BENCH_MODE_COUNT; mode++) {
+        if (config->modes[mode]) {
+            mxjson_init(&p, 0, NULL, mxjson_resize);
+            mxjson_lazy_depth(&p, config->lazy_depth);
+            bench_peak_rss_reset();
+            result.mode = mode;
+            ok = bench_run(config, &p, json, &result);
+            result.peak_rss = bench_peak_rss();
+            mxjson_free(&p);
+
+            if (!ok) {
+                /* Reported below */
+            } else if (config->table) {
+                bench_output_table(config, &result);
+            } else {
+                bench_output_json(config, &result);
+            }
+        }
+    }
+
+    if (!ok) {
+        fprintf(stderr, "%s: failed to parse\n", name);
+    }
+
+    return ok;
+}
+
+
+/**
+ * Parse a document repeatedly in a thread of the scaling benchmark.
+ *
+ * With BENCH_RESIZE, a parser context is created and freed for each parse
+ * (as a server handling independent requests would), so the token array is
+ * grown from empty by mxjson_resize() each time and the threads compete
+ * for the allocator. With BENCH_USER_TOKENS, the thread allocates a token
+ * array large enough for the document before it starts, and reuses it.
+ */
+static void *
+bench_thread (void *arg)
+{
+    bench_thread_t  *t = arg;
+    mxjson_parser_t  p;
+    mxjson_token_t  *tokens = NULL;
+    unsigned int     i;
+
+    if (t->strategy == BENCH_USER_TOKENS) {
+        tokens = mxutil_calloc((t->tokens + 1) * sizeof(*tokens));
+        mxjson_init(&p, t->tokens + 1, tokens, NULL);
+    }
+
+    t->ok = true;
+    (void)pthread_barrier_wait(t->barrier);
+    t->start = bench_now();
+
+    for (i = 0; t->ok && i < t->iterations; i++) {
+        if (t->strategy == BENCH_RESIZE) {
+            mxjson_init(&p, 0, NULL, mxjson_resize);
+            t->ok = mxjson_parse(&p, t->json);
+            mxjson_free(&p);
+        } else {
+            t->ok = mxjson_parse(&p, t->json);
+        }
+    }
+
+    t->end = bench_now();
+    free(tokens);
+
+    return NULL;
+}
+
+
+/**
+ * Output a scaling result as a single line of JSON.
+ */
+static void
+bench_output_scaling_json (const bench_config_t  *config,
+                           const char            *name,
+                           mxstr_t                json,
+                           const bench_scaling_t *r)
+{
+    mxjson_writer_t w;
+    char            buf[1024];
+
+    mxjson_writer_init(&w, buf, sizeof(buf), bench_flush, stdout);
+    (void)mxjson_writer_begin_object(&w);
+
+    if (config->label != NULL) {
+        (void)mxjson_writer_key(&w, mxstr_literal("label"));
+        (void)mxjson_writer_string(&w, mxstr((char *)config->label,
+                                             strlen(config->label)));
+    }
+
+    (void)mxjson_writer_key(&w, mxstr_literal("file"));
+    (void)mxjson_writer_string(&w, mxstr((char *)name, strlen(name)));
+    (void)mxjson_writer_key(&w, mxstr_literal("strategy"));
+    (void)mxjson_writer_string(&w,
+        mxstr((char *)bench_strategy_names[r->strategy],
+              strlen(bench_strategy_names[r->strategy])));
+    (void)mxjson_writer_key(&w, mxstr_literal("threads"));
+    (void)mxjson_writer_int(&w, r->threads);
+    (void)mxjson_writer_key(&w, mxstr_literal("bytes"));
+    (void)mxjson_writer_int(&w, json.len);
+    (void)mxjson_writer_key(&w, mxstr_literal("iterations"));
+    (void)mxjson_writer_int(&w, config->iterations);
+    (void)mxjson_writer_key(&w, mxstr_literal("mb_per_s"));
+    (void)mxjson_writer_double(&w, r->mb_per_s);
+    (void)mxjson_writer_key(&w, mxstr_literal("thread_mb_per_s_min"));
+    (void)mxjson_writer_double(&w, r->thread_min);
+    (void)mxjson_writer_key(&w, mxstr_literal("thread_mb_per_s_mean"));
+    (void)mxjson_writer_double(&w, r->thread_mean);
+    (void)mxjson_writer_key(&w, mxstr_literal("thread_mb_per_s_max"));
+    (void)mxjson_writer_double(&w, r->thread_max);
+    (void)mxjson_writer_key(&w, mxstr_literal("efficiency"));
+    (void)mxjson_writer_double(&w, r->efficiency);
+    (void)mxjson_writer_end_object(&w);
+
+    if (mxjson_writer_finish(&w)) {
+        (void)putchar('\n');
+    }
+}
+
+
+/**
+ * Measure how the throughput of independent parses of a document scales
+ * with the number of threads, from 1 up to the configured maximum, for
+ * each token allocation strategy.
+ *
+ * The aggregate throughput is the total bytes parsed by all the threads
+ * over the time from the first thread starting to the last thread
+ * finishing. The efficiency is the aggregate throughput relative to
+ * perfect scaling of the single thread throughput, so a drop shows where
+ * the threads start to contend (e.g. for the allocator, the shared cache
+ * or memory bandwidth).
+ *
+ * @return
+ *   Indicates whether every parse succeeded.
+ */
+static bool
+bench_scaling (const bench_config_t *config, const char *name, mxstr_t json)
+{
+    pthread_barrier_t  barrier;
+    bench_thread_t    *threads;
+    bench_scaling_t    r;
+    mxjson_parser_t    p;
+    mxjson_idx_t       tokens;
+    unsigned int       i;
+    double             single = 0;
+    double             start;
+    double             end;
+    double             rate;
+    bool               ok;
+
+    mxjson_init(&p, 0, NULL, mxjson_resize);
+    ok = mxjson_parse(&p, json);
+    tokens = p.idx;
+    mxjson_free(&p);
+
+    threads = mxutil_calloc(config->threads * sizeof(*threads));
+
+    for (r.strategy = 0; ok && r.strategy < BENCH_STRATEGY_COUNT;
+         r.strategy++) {
+        for (r.threads = 1; ok && r.threads <= config->threads; r.threads++) {
+            (void)pthread_barrier_init(&barrier, NULL, r.threads);
+
+            for (i = 0; ok && i < r.threads; i++) {
+                threads[i].barrier = &barrier;
+                threads[i].strategy = r.strategy;
+                threads[i].json = json;
+                threads[i].tokens = tokens;
+                threads[i].iterations = config->iterations;
+                ok = (pthread_create(&threads[i].thread, NULL, bench_thread,
+                                     &threads[i]) == 0);
+            }
+
+            /*
+             * The barrier can't be released if a thread couldn't be
+             * created, so give up without waiting for the others.
+             */
+            if (!ok) {
+                fprintf(stderr, "%s: could not create %u threads\n", name,
+                        r.threads);
+                exit(1);
+            }
+
+            start = 0;
+            end = 0;
+            r.thread_min = 0;
+            r.thread_mean = 0;
+            r.thread_max = 0;
+
+            for (i = 0; i < r.threads; i++) {
+                (void)pthread_join(threads[i].thread, NULL);
+                ok = ok && threads[i].ok;
+                rate = (double)json.len * config->iterations /
+                       (threads[i].end - threads[i].start) / 1e6;
+                start = (i == 0) ? threads[i].start :
+                                   min(start, threads[i].start);
+                end = max(end, threads[i].end);
+                r.thread_min = (i == 0) ? rate : min(r.thread_min, rate);
+                r.thread_mean += rate / r.threads;
+                r.thread_max = max(r.thread_max, rate);
+            }
+
+            (void)pthread_barrier_destroy(&barrier);
+            r.mb_per_s = (double)json.len * config->iterations * r.threads /
+                         (end - start) / 1e6;
+            single = (r.threads == 1) ? r.mb_per_s : single;
+            r.efficiency = r.mb_per_s / (single * r.threads);
+
+            if (!ok) {
+                /* Reported below */
+            } else if (config->table) {
+                printf("%-12s %-9s %7u %9.1f %9.1f %9.1f %9.1f %6.1f%%\n",
+                       name, bench_strategy_names[r.strategy], r.threads,
+                       r.mb_per_s, r.thread_min, r.thread_mean, r.thread_max,
+                       r.efficiency * 100);
+            } else {
+                bench_output_scaling_json(config, name, json, &r);
+            }
+        }
+    }
+
+    free(threads);
+
+    if (!ok) {
+        fprintf(stderr, "%s: failed to parse\n", name);
+    }
+
+    return ok;
+}
+
+
+/**
+ * Get the histogram bucket for a latency.
+ */
+static size_t
+bench_histogram_bucket (uint64_t ns)
+{
+    unsigned int shift;
+    size_t       bucket = ns;
+
+    if (ns >= (2 << HISTOGRAM_SUB_BITS)) {
+        shift = 63 - __builtin_clzll(ns) - HISTOGRAM_SUB_BITS;
+        bucket = ((size_t)shift << HISTOGRAM_SUB_BITS) + (ns >> shift);
+    }
+
+    return bucket;
+}
+
+
+/**
+ * Get the highest latency that is counted in a histogram bucket.
+ */
+static uint64_t
+bench_histogram_value (size_t bucket)
+{
+    unsigned int shift;
+    uint64_t     ns = bucket;
+
+    if (bucket >= (2 << HISTOGRAM_SUB_BITS)) {
+        shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+        ns = ((bucket - ((size_t)shift << HISTOGRAM_SUB_BITS) + 1) << shift) - 1;
+    }
+
+    return ns;
+}
+
+
+/**
+ * Record the latency for parsing a document.
+ */
+static void
+bench_histogram_add (bench_histogram_t *h,
+                     uint64_t           ns,
+                     size_t             line,
+                     size_t             bytes)
+{
+    size_t i;
+
+    h->buckets[bench_histogram_bucket(ns)]++;
+    h->min = (h->count == 0) ? ns : min(h->min, ns);
+    h->max = max(h->max, ns);
+    h->count++;
+    h->total += ns;
+
+    /*
+     * Insert into the slowest documents, keeping them in order.
+     */
+    for (i = OUTLIERS; i > 0 && ns > h->worst[i - 1].ns; i--) {
+        if (i < OUTLIERS) {
+            h->worst[i] = h->worst[i - 1];
+        }
+    }
+
+    if (i < OUTLIERS) {
+        h->worst[i].line = line;
+        h->worst[i].bytes = bytes;
+        h->worst[i].ns = ns;
+    }
+}
+
+
+/**
+ * Get a percentile of the recorded latencies.
+ *
+ * @return
+ *   The highest latency in the bucket containing the percentile, so the
+ *   result is within the resolution of the histogram, and never less than
+ *   the actual percentile.
+ */
+static uint64_t
+bench_histogram_percentile (const bench_histogram_t *h, double percentile)
+{
+    uint64_t target;
+    uint64_t seen = 0;
+    size_t   bucket = 0;
+
+    target = (uint64_t)(h->count * percentile / 100);
+    target = max(target, 1);
+
+    while (bucket < HISTOGRAM_BUCKETS && seen + h->buckets[bucket] < target) {
+        seen += h->buckets[bucket];
+        bucket++;
+    }
+
+    return min(bench_histogram_value(bucket), h->max);
+}
+
+
+/**
+ * Percentiles reported for the latency distribution.
+ */
+static const struct {
+    const char *name;
+    double      percentile;
+} bench_percentiles[] = {
+    { "p50_ns", 50 }, { "p90_ns", 90 }, { "p99_ns", 99 },
+    { "p999_ns", 99.9 },
+};
+
+
+/**
+ * Output a latency distribution as a single line of JSON.
+ */
+static void
+bench_output_latency_json (const bench_config_t    *config,
+                           const char              *name,
+                           size_t                   documents,
+                           const bench_histogram_t *h)
+{
+    mxjson_writer_t w;
+    char            buf[2048];
+    size_t          i;
+
+    mxjson_writer_init(&w, buf, sizeof(buf), bench_flush, stdout);
+    (void)mxjson_writer_begin_object(&w);
+
+    if (config->label != NULL) {
+        (void)mxjson_writer_key(&w, mxstr_literal("label"));
+        (void)mxjson_writer_string(&w, mxstr((char *)config->label,
+                                             strlen(config->label)));
+    }
+
+    (void)mxjson_writer_key(&w, mxstr_literal("file"));
+    (void)mxjson_writer_string(&w, mxstr((char *)name, strlen(name)));
+    (void)mxjson_writer_key(&w, mxstr_literal("mode"));
+    (void)mxjson_writer_string(&w, mxstr_literal("latency"));
+    (void)mxjson_writer_key(&w, mxstr_literal("documents"));
+    (void)mxjson_writer_int(&w, documents);
+    (void)mxjson_writer_key(&w, mxstr_literal("parses"));
+    (void)mxjson_writer_int(&w, h->count);
+    (void)mxjson_writer_key(&w, mxstr_literal("min_ns"));
+    (void)mxjson_writer_int(&w, h->min);
+    (void)mxjson_writer_key(&w, mxstr_literal("mean_ns"));
+    (void)mxjson_writer_double(&w, (double)h->total / h->count);
+
+    for (i = 0; i < mxarray_size(bench_percentiles); i++) {
+        (void)mxjson_writer_key(&w, mxstr((char *)bench_percentiles[i].name,
+                                strlen(bench_percentiles[i].name)));
+        (void)mxjson_writer_int(&w, bench_histogram_percentile(h,
+                                bench_percentiles[i].percentile));
+    }
+
+    (void)mxjson_writer_key(&w, mxstr_literal("max_ns"));
+    (void)mxjson_writer_int(&w, h->max);
+    (void)mxjson_writer_key(&w, mxstr_literal("worst"));
+    (void)mxjson_writer_begin_array(&w);
+
+    for (i = 0; i < OUTLIERS && i < h->count; i++) {
+        (void)mxjson_writer_begin_object(&w);
+        (void)mxjson_writer_key(&w, mxstr_literal("line"));
+        (void)mxjson_writer_int(&w, h->worst[i].line);
+        (void)mxjson_writer_key(&w, mxstr_literal("bytes"));
+        (void)mxjson_writer_int(&w, h->worst[i].bytes);
+        (void)mxjson_writer_key(&w, mxstr_literal("ns"));
+        (void)mxjson_writer_int(&w, h->worst[i].ns);
+        (void)mxjson_writer_end_object(&w);
+    }
+
+    (void)mxjson_writer_end_array(&w);
+    (void)mxjson_writer_end_object(&w);
+
+    if (mxjson_writer_finish(&w)) {
+        (void)putchar('\n');
+    }
+}
+
+
+/**
+ * Output a latency distribution as a row of a table, followed by the
+ * slowest documents.
+ */
+static void
+bench_output_latency_table (const char              *name,
+                            size_t                   documents,
+                            const bench_histogram_t *h)
+{
+    size_t i;
+
+    printf("%-12s %9zu %9" PRIu64 " %9.0f", name, documents, h->min,
+           (double)h->total / h->count);
+
+    for (i = 0; i < mxarray_size(bench_percentiles); i++) {
+        printf(" %9" PRIu64, bench_histogram_percentile(h,
+               bench_percentiles[i].percentile));
+    }
+
+    printf(" %9" PRIu64 "\n", h->max);
+
+    for (i = 0; i < OUTLIERS && i < h->count; i++) {
+        printf("  line %zu (%zu bytes): %" PRIu64 " ns\n", h->worst[i].line,
+               h->worst[i].bytes, h->worst[i].ns);
+    }
+}
+
+
+/**
+ * Parse each line of an NDJSON stream as a separate document, timing each
+ * parse, and output the latency distribution.
+ *
+ * The stream is parsed config->iterations times, with the same parser
+ * context used for every document (as a server handling a stream of
+ * requests would), so the distribution shows the fixed cost of each call
+ * as well as the cost of the document.
+ *
+ * @return
+ *   Indicates whether every document was parsed successfully.
+ */
+static bool
+bench_latency (const bench_config_t *config, const char *name, mxstr_t json)
+{
+    static bench_histogram_t h;
+    mxjson_parser_t          p;
+    mxstr_t                  s;
+    mxstr_t                  doc;
+    size_t                   documents = 0;
+    size_t                   line;
+    double                   start;
+    double                   elapsed;
+    unsigned int             i;
+    bool                     ok = true;
+    uint8_t                  c;
+
+    memset(&h, 0, sizeof(h));
+    mxjson_init(&p, 0, NULL, mxjson_resize);
+    mxjson_lazy_depth(&p, config->lazy_depth);
+
+    for (i = 0; ok && i < config->iterations; i++) {
+        s = json;
+        line = 0;
+
+        while (ok && !mxstr_empty(s)) {
+            doc = s;
+            mxstr_consume_chars(&s, &c, (c != '\n'));
+            doc = mxstr_prefix(doc, s);
+            (void)mxstr_consume_char(&s, &c, (c == '\n'));
+            line++;
+
+            if (!mxstr_empty(doc)) {
+                start = bench_now();
+                ok = mxjson_parse(&p, doc);
+                elapsed = bench_now() - start;
+                bench_histogram_add(&h, (uint64_t)(elapsed * 1e9), line,
+                                    doc.len);
+                documents += (i == 0);
+            }
+        }
+    }
+
+    mxjson_free(&p);
+
+    if (!ok) {
+        fprintf(stderr, "%s: failed to parse line %zu\n", name, line);
+    } else if (h.count == 0) {
+        fprintf(stderr, "%s: no documents\n", name);
+    } else if (config->table) {
+        bench_output_latency_table(name, documents, &h);
+    } else {
+        bench_output_latency_json(config, name, documents, &h);
+    }
+
+    return ok;
+}
+
+
+/**
+ * Write the generated corpus to files in a directory.
+ */
+static bool
+bench_write_corpus (const char *dir, uint64_t seed)
+{
+    char     path[4096];
+    mxbuf_t  data;
+    FILE    *f;
+    size_t   i;
+    bool     ok = true;
+
+    mxbuf_create(&data, NULL, 0);
+
+    for (i = 0; ok && i < mxarray_size(mxjson_corpora); i++) {
+        mxbuf_reset(&data);
+        (void)snprintf(path, sizeof(path), "%s/%s.json", dir,
+                       mxjson_corpora[i].name);
+        ok = mxjson_corpus_generate(mxjson_corpora[i].generate, seed,
+                                    mxjson_corpora[i].size,
+                                    mxjson_corpora[i].indent, &data);
+        f = ok ? fopen(path, "w") : NULL;
+        ok = (f != NULL);
+
+        if (ok) {
+            ok = (fwrite(data.buf.ptr, 1, mxbuf_str(&data).len, f) ==
+                  mxbuf_str(&data).len);
+            ok = (fclose(f) == 0) && ok;
+        }
+
+        if (!ok) {
+            fprintf(stderr, "Could not write %s\n", path);
+        }
+    }
+
+    mxbuf_free(&data);
+
+    return ok;
+}
+
+
+int main (int argc, char **argv)
+{
+    bench_config_t        config;
+    bench_counters_t      counters;
+    mxjson_corpus_shape_t shape;
+    mxbuf_t               data;
+    const char           *corpus_dir = NULL;
+    uint64_t              seed = 1;
+    bench_mode_t          mode;
+    size_t                i;
+    int                   opt;
+    bool                  modes = false;
+    bool                  perf = false;
+    bool                  ok = true;
+
+    memset(&config, 0, sizeof(config));
+    config.iterations = 100;
+
+    while ((opt = getopt(argc, argv, "dg:hj:l:m:n:ps:tz:")) != -1) {
+        switch (opt) {
+        case 'd':
+            config.latency = true;
+            break;
+
+        case 'g':
+            corpus_dir = optarg;
+            break;
+
+        case 'j':
+            config.threads = (atoi(optarg) > 0) ? atoi(optarg) :
+                             max(sysconf(_SC_NPROCESSORS_ONLN), 1);
+            break;
+
+        case 'l':
+            config.label = optarg;
+            break;
+
+        case 'm':
+            ok = false;
+
+            for (mode = 0; mode < BENCH_MODE_COUNT; mode++) {
+                if (strcmp(optarg, bench_mode_names[mode]) == 0) {
+                    config.modes[mode] = true;
+                    modes = true;
+                    ok = true;
+                }
+            }
+            break;
+
+        case 'n':
+            config.iterations = max(atoi(optarg), 1);
+            break;
+
+        case 'p':
+            perf = true;
+            break;
+
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+
+        case 't':
+            config.table = true;
+            break;
+
+        case 'z':
+            config.lazy_depth = atoi(optarg);
+            break;
+
+        case 'h':
+        default:
+            ok = false;
+            break;
+        }
+
+        if (!ok) {
+            fprintf(stderr, "Usage: %s [OPTION...] [FILE...]\n\n"
+             "  -d          Parse each line of the input as a separate\n"
+             "              document (NDJSON), and output the distribution\n"
+             "              of the time to parse a document\n"
+             "  -g <dir>    Write the generated corpus to <dir> and exit\n"
+             "  -h          Display this usage information\n"
+             "  -j <count>  Parse each file in 1 to <count> threads at once,\n"
+             "              each with its own parser, and output how the\n"
+             "              throughput scales for each token allocation\n"
+             "              strategy (resize or tokens). 0 is the number\n"
+             "              of CPUs\n"
+             "  -l <label>  Label to include in each result (e.g. commit)\n"
+             "  -m <mode>   Mode to run (tokens, padded, validate or\n"
+             "              unescape), may be repeated (default all)\n"
+             "  -n <count>  Number of times to parse each file (default %u)\n"
+             "  -p          Read hardware performance counters (cycles,\n"
+             "              instructions, branch misses, L1D and LLC misses)\n"
+             "              around each parse\n"
+             "  -s <seed>   Seed for the generated corpus (default %llu)\n"
+             "  -t          Output a table rather than JSON lines\n"
+             "  -z <depth>  Only tokenize objects and arrays above <depth>,\n"
+             "              validating deeper values without tokenizing them\n\n"
+             "If no FILE is specified, the generated corpus (citm, twitter,\n"
+             "canada and literals, or an NDJSON stream with -d) is used.\n\n",
+             argv[0], config.iterations,
+             (unsigned long long)seed);
+            exit(1);
+        }
+    }
+
+    for (mode = 0; mode < BENCH_MODE_COUNT; mode++) {
+        config.modes[mode] |= !modes;
+    }
+
+    if (corpus_dir != NULL) {
+        return !bench_write_corpus(corpus_dir, seed);
+    }
+
+    if (perf && bench_counters_open(&counters)) {
+        config.counters = &counters;
+    }
+
+    if (config.table && config.threads != 0) {
+        printf("%-12s %-9s %7s %9s %9s %9s %9s %7s\n", "file", "strategy",
+               "threads", "MB/s", "thr_min", "thr_mean", "thr_max", "eff");
+    } else if (config.table && config.latency) {
+        printf("%-12s %9s %9s %9s %9s %9s %9s %9s %9s\n", "file", "docs",
+               "min_ns", "mean_ns", "p50_ns", "p90_ns", "p99_ns", "p999_ns",
+               "max_ns");
+    } else if (config.table) {
+        printf("%-12s %-9s %10s %9s %9s %9s %8s %9s", "file", "mode",
+               "bytes", "tokens", "MB/s", "Mtok/s", "ns/tok", "rss_kB");
+
+        if (config.counters != NULL) {
+            printf(" %8s %8s %8s %8s %8s %8s", "cyc/B", "ins/B", "IPC",
+                   "brm/tok", "l1d/tok", "llc/tok");
+        }
+        (void)putchar('\n');
+    }
+
+    mxbuf_create(&data, NULL, 0);
+
+    if (optind >= argc && config.latency && config.threads == 0) {
+        shape = mxjson_corpus_shape_default;
+        shape.seed = seed;
+        shape.size = NDJSON_SIZE;
+        shape.doc_size = NDJSON_DOC_SIZE;
+        ok = (mxjson_corpus_shaped(&shape, mxjson_corpus_flush, &data, NULL) &&
+              bench_latency(&config, "ndjson", mxbuf_str(&data)));
+    } else if (optind >= argc) {
+        for (i = 0; ok && i < mxarray_size(mxjson_corpora); i++) {
+            mxbuf_reset(&data);
+            ok = mxjson_corpus_generate(mxjson_corpora[i].generate, seed,
+                                        mxjson_corpora[i].size,
+                                        mxjson_corpora[i].indent, &data);
+            mxbuf_pad(&data, MXJSON_PADDING);
+            ok = ok && ((config.threads != 0) ?
+                bench_scaling(&config, mxjson_corpora[i].name,
+                              mxbuf_str(&data)) :
+                bench_document(&config, mxjson_corpora[i].name,
+                               mxbuf_str(&data)));
+        }
+    }
+
+    for (i = optind; ok && i < (size_t)argc; i++) {
+        mxbuf_reset(&data);
+        ok = bench_read_file(argv[i], &data);
+
+        if (!ok) {
+            fprintf(stderr, "Could not read %s\n", argv[i]);
+        } else if (config.threads != 0) {
+            ok = bench_scaling(&config, argv[i], mxbuf_str(&data));
+        } else if (config.latency) {
+            ok = bench_latency(&config, argv[i], mxbuf_str(&data));
+        } else {
+            ok = bench_document(&config, argv[i], mxbuf_str(&data));
+        }
+    }
+
+    mxbuf_free(&data);
+
+    if (config.counters != NULL) {
+        bench_counters_close(config.counters);
+    }
+
+    return (!ok);
+}
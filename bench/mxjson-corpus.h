@@ -0,0 +1,1464 @@
+/*
+ * ----------------------------------------------------------------------
+ * |\ /| mxjson-corpus.h
+ * | X | Generated JSON corpora for benchmarking
+ * |/ \|
+ * ----------------------------------------------------------------------
+ */
+
+/* ----------------------------------------------------------------------
+ * Note
+ *
+ * The standard JSON benchmark files (citm_catalog.json, twitter.json and
+ * canada.json) are not distributed with mxjson. Instead, documents with
+ * the same shape are generated deterministically from a seed, so that
+ * results are reproducible without any external files:
+ *
+ *  - citm: An event catalog. Large objects keyed by numeric id strings,
+ *    arrays of small objects holding integers, many nulls, and indented
+ *    with 4 spaces.
+ *  - twitter: A search result of status updates. Nested user objects,
+ *    UTF-8 text, escape sequences (\n, \/ and \"), and indented with 2
+ *    spaces.
+ *  - canada: A GeoJSON polygon. Deeply nested arrays of coordinate pairs
+ *    written as long floating point numbers, with no indentation.
+ *  - literals: An array of small objects holding only true, false and
+ *    null, with no indentation. Not a standard benchmark file, but
+ *    isolates the cost of matching literals.
+ *
+ * Documents (or NDJSON streams) with a controlled shape - nesting depth,
+ * fan-out, proportion of objects/arrays, string lengths, escape density,
+ * number format, proportion of whitespace and size - are generated by
+ * mxjson_corpus_shaped().
+ *
+ * Adversarial documents (mxjson_corpus_adversarial[]) each stress a single
+ * path in the parser - nesting, escape sequences, long strings and
+ * numbers, token allocation and whitespace - and can be generated at any
+ * size, to check that the parse time is linear in the size of the input.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef MXJSON_CORPUS_H
+#define MXJSON_CORPUS_H
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "mxjson.h"
+#include "mxjson-write.h"
+#include "mxstr.h"
+#include "mxutil.h"
+
+
+/**
+ * Maximum nesting depth of a shaped document. Values are generated
+ * recursively, so this limits the stack used.
+ */
+#define MXJSON_CORPUS_MAX_DEPTH 4096
+
+
+/**
+ * Pseudo random number generator state (splitmix64).
+ */
+typedef struct {
+    uint64_t state;
+} mxjson_corpus_rng_t;
+
+
+/**
+ * Generation context for a corpus document.
+ */
+typedef struct {
+    mxjson_writer_t     w;         /**< Writer producing the document */
+    mxjson_corpus_rng_t rng;       /**< Random number generator */
+    mxbuf_t            *out;       /**< Buffer receiving the output */
+    size_t              size;      /**< Approximate size to generate */
+    char                buf[4096]; /**< Writer buffer */
+} mxjson_corpus_ctx_t;
+
+
+/**
+ * Generate a document.
+ */
+typedef void (*mxjson_corpus_fn)(mxjson_corpus_ctx_t *ctx);
+
+
+/**
+ * A document in the standard corpus.
+ */
+typedef struct {
+    const char       *name;     /**< Name of the document */
+    mxjson_corpus_fn  generate; /**< Function to generate the document */
+    size_t            size;     /**< Approximate size before indentation */
+    unsigned int      indent;   /**< Indentation (0 for compact) */
+} mxjson_corpus_t;
+
+
+/**
+ * Get the next pseudo random number.
+ */
+static inline uint64_t
+mxjson_corpus_rand (mxjson_corpus_rng_t *rng)
+{
+    uint64_t z;
+
+    rng->state += 0x9e3779b97f4a7c15ULL;
+    z = rng->state;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+    return z ^ (z >> 31);
+}
+
+
+/**
+ * Get a pseudo random number in the range [0, n).
+ */
+static inline uint32_t
+mxjson_corpus_range (mxjson_corpus_rng_t *rng, uint32_t n)
+{
+    return (uint32_t)(((mxjson_corpus_rand(rng) >> 32) * n) >> 32);
+}
+
+
+/**
+ * Get a pseudo random number in the range [lo, hi].
+ */
+static inline uint32_t
+mxjson_corpus_between (mxjson_corpus_rng_t *rng, uint32_t lo, uint32_t hi)
+{
+    return lo + mxjson_corpus_range(rng, hi - lo + 1);
+}
+
+
+/**
+ * Get the size of the document generated so far.
+ */
+static inline size_t
+mxjson_corpus_size (mxjson_corpus_ctx_t *ctx)
+{
+    return (mxstr_substr_offset(ctx->out->buf, ctx->out->available) +
+            mxstr_substr_offset(ctx->w.buf, ctx->w.available));
+}
+
+
+/**
+ * \internal
+ * Flush callback appending the writer output to the output buffer.
+ */
+static inline bool
+mxjson_corpus_flush (void *ctx, mxstr_t data)
+{
+    (void)mxbuf_write(ctx, data);
+
+    return true;
+}
+
+
+/**
+ * Write a member name.
+ */
+static inline void
+mxjson_corpus_key (mxjson_corpus_ctx_t *ctx, const char *name)
+{
+    (void)mxjson_writer_key(&ctx->w, mxstr((char *)name, strlen(name)));
+}
+
+
+/**
+ * Write an integer object member.
+ */
+static inline void
+mxjson_corpus_int (mxjson_corpus_ctx_t *ctx, const char *name, int64_t value)
+{
+    mxjson_corpus_key(ctx, name);
+    (void)mxjson_writer_int(&ctx->w, value);
+}
+
+
+/**
+ * Write a null object member.
+ */
+static inline void
+mxjson_corpus_null (mxjson_corpus_ctx_t *ctx, const char *name)
+{
+    mxjson_corpus_key(ctx, name);
+    (void)mxjson_writer_null(&ctx->w);
+}
+
+
+/**
+ * Write a bool object member.
+ */
+static inline void
+mxjson_corpus_bool (mxjson_corpus_ctx_t *ctx, const char *name, bool value)
+{
+    mxjson_corpus_key(ctx, name);
+    (void)mxjson_writer_bool(&ctx->w, value);
+}
+
+
+/**
+ * Write a string object member.
+ */
+static inline void
+mxjson_corpus_str (mxjson_corpus_ctx_t *ctx, const char *name, mxstr_t str)
+{
+    mxjson_corpus_key(ctx, name);
+    (void)mxjson_writer_string(&ctx->w, str);
+}
+
+
+/**
+ * Write a member name for a decimal id.
+ */
+static inline void
+mxjson_corpus_id_key (mxjson_corpus_ctx_t *ctx, uint64_t id)
+{
+    char name[32];
+
+    (void)snprintf(name, sizeof(name), "%llu", (unsigned long long)id);
+    mxjson_corpus_key(ctx, name);
+}
+
+
+/**
+ * Generate text of random words into a buffer.
+ *
+ * @param[in] ctx
+ *   The generation context.
+ *
+ * @param[in] words
+ *   The words to choose from.
+ *
+ * @param[in] count
+ *   The number of words in the array.
+ *
+ * @param[in] n
+ *   The number of words to generate.
+ *
+ * @param[in] buffer
+ *   The buffer, which is reset before the text is generated.
+ *
+ * @return
+ *   The generated text.
+ */
+static inline mxstr_t
+mxjson_corpus_words (mxjson_corpus_ctx_t *ctx,
+                     const char * const  *words,
+                     uint32_t             count,
+                     uint32_t             n,
+                     mxbuf_t             *buffer)
+{
+    const char *word;
+    uint32_t    i;
+
+    mxbuf_reset(buffer);
+
+    for (i = 0; i < n; i++) {
+        word = words[mxjson_corpus_range(&ctx->rng, count)];
+
+        if (i != 0) {
+            (void)mxbuf_putc(buffer, ' ');
+        }
+        (void)mxbuf_write(buffer, mxstr((char *)word, strlen(word)));
+    }
+
+    return mxbuf_str(buffer);
+}
+
+
+/**
+ * Words for citm names.
+ */
+static const char * const mxjson_corpus_citm_words[] = {
+    "Orchestre", "Philharmonique", "Radio", "France", "Salle", "Pleyel",
+    "Quatuor", "Concert", "Symphonie", "Arri\xc3\xa8re-sc\xc3\xa8ne",
+    "central", "Balcon", "Parterre", "Loge", "Premi\xc3\xa8re", "Jeune",
+    "public", "Abonnement", "Musique", "de", "chambre", "R\xc3\xa9" "cital",
+    "Piano", "Tour", "Anniversary", "Opera", "Gala", "Jazz", "Danse",
+};
+
+
+/**
+ * Generate an object mapping ids to names.
+ */
+static inline void
+mxjson_corpus_citm_names (mxjson_corpus_ctx_t *ctx,
+                          const char          *name,
+                          uint32_t             count,
+                          mxbuf_t             *text)
+{
+    uint32_t i;
+
+    mxjson_corpus_key(ctx, name);
+    (void)mxjson_writer_begin_object(&ctx->w);
+
+    for (i = 0; i < count; i++) {
+        mxjson_corpus_id_key(ctx, 100000000 + mxjson_corpus_rand(&ctx->rng) %
+                                  900000000);
+        (void)mxjson_writer_string(
+            &ctx->w, mxjson_corpus_words(ctx, mxjson_corpus_citm_words,
+                                         mxarray_size(mxjson_corpus_citm_words),
+                                         mxjson_corpus_between(&ctx->rng, 1, 4),
+                                         text));
+    }
+
+    (void)mxjson_writer_end_object(&ctx->w);
+}
+
+
+/**
+ * Generate an array of random ids.
+ */
+static inline void
+mxjson_corpus_ids (mxjson_corpus_ctx_t *ctx, const char *name, uint32_t count)
+{
+    uint32_t i;
+
+    mxjson_corpus_key(ctx, name);
+    (void)mxjson_writer_begin_array(&ctx->w);
+
+    for (i = 0; i < count; i++) {
+        (void)mxjson_writer_int(&ctx->w, 100000000 +
+                                mxjson_corpus_rand(&ctx->rng) % 900000000);
+    }
+
+    (void)mxjson_writer_end_array(&ctx->w);
+}
+
+
+/**
+ * Generate a document shaped like citm_catalog.json.
+ */
+static inline void
+mxjson_corpus_citm (mxjson_corpus_ctx_t *ctx)
+{
+    mxjson_corpus_rng_t *rng = &ctx->rng;
+    mxbuf_t              text;
+    uint32_t             events = ctx->size / 1600 + 1;
+    uint32_t             i;
+    uint32_t             j;
+    uint32_t             k;
+    uint32_t             n;
+
+    mxbuf_create(&text, NULL, 0);
+    (void)mxjson_writer_begin_object(&ctx->w);
+
+    mxjson_corpus_citm_names(ctx, "areaNames", 17, &text);
+    mxjson_corpus_citm_names(ctx, "audienceSubCategoryNames", 1, &text);
+    mxjson_corpus_key(ctx, "blockNames");
+    (void)mxjson_writer_begin_object(&ctx->w);
+    (void)mxjson_writer_end_object(&ctx->w);
+
+    mxjson_corpus_key(ctx, "events");
+    (void)mxjson_writer_begin_object(&ctx->w);
+
+    for (i = 0; i < events; i++) {
+        mxjson_corpus_id_key(ctx, 138586341 + i * 4);
+        (void)mxjson_writer_begin_object(&ctx->w);
+        mxjson_corpus_null(ctx, "description");
+        mxjson_corpus_int(ctx, "id", 138586341 + i * 4);
+        mxjson_corpus_null(ctx, "logo");
+        mxjson_corpus_str(ctx, "name",
+                          mxjson_corpus_words(
+                              ctx, mxjson_corpus_citm_words,
+                              mxarray_size(mxjson_corpus_citm_words),
+                              mxjson_corpus_between(rng, 1, 5), &text));
+        mxjson_corpus_ids(ctx, "subTopicIds", mxjson_corpus_between(rng, 1, 4));
+        mxjson_corpus_null(ctx, "subjectCode");
+        mxjson_corpus_null(ctx, "subtitle");
+        mxjson_corpus_ids(ctx, "topicIds", mxjson_corpus_between(rng, 1, 3));
+        (void)mxjson_writer_end_object(&ctx->w);
+    }
+
+    (void)mxjson_writer_end_object(&ctx->w);
+
+    mxjson_corpus_key(ctx, "performances");
+    (void)mxjson_writer_begin_array(&ctx->w);
+
+    while (mxjson_corpus_size(ctx) < ctx->size) {
+        (void)mxjson_writer_begin_object(&ctx->w);
+        mxjson_corpus_int(ctx, "eventId",
+                          138586341 + mxjson_corpus_range(rng, events) * 4);
+        mxjson_corpus_int(ctx, "id", 339887544 + mxjson_corpus_range(rng, 1000000));
+        mxjson_corpus_null(ctx, "logo");
+        mxjson_corpus_null(ctx, "name");
+
+        mxjson_corpus_key(ctx, "prices");
+        (void)mxjson_writer_begin_array(&ctx->w);
+        n = mxjson_corpus_between(rng, 1, 4);
+
+        for (j = 0; j < n; j++) {
+            (void)mxjson_writer_begin_object(&ctx->w);
+            mxjson_corpus_int(ctx, "amount",
+                              mxjson_corpus_between(rng, 10, 2000) * 50);
+            mxjson_corpus_int(ctx, "audienceSubCategoryId", 337100890);
+            mxjson_corpus_int(ctx, "seatCategoryId", 338937295 + j);
+            (void)mxjson_writer_end_object(&ctx->w);
+        }
+
+        (void)mxjson_writer_end_array(&ctx->w);
+
+        mxjson_corpus_key(ctx, "seatCategories");
+        (void)mxjson_writer_begin_array(&ctx->w);
+
+        for (j = 0; j < n; j++) {
+            (void)mxjson_writer_begin_object(&ctx->w);
+            mxjson_corpus_key(ctx, "areas");
+            (void)mxjson_writer_begin_array(&ctx->w);
+
+            for (k = mxjson_corpus_between(rng, 1, 6); k != 0; k--) {
+                (void)mxjson_writer_begin_object(&ctx->w);
+                mxjson_corpus_int(ctx, "areaId",
+                                  205705993 + mxjson_corpus_range(rng, 20));
+                mxjson_corpus_ids(ctx, "blockIds", 0);
+                (void)mxjson_writer_end_object(&ctx->w);
+            }
+
+            (void)mxjson_writer_end_array(&ctx->w);
+            mxjson_corpus_int(ctx, "seatCategoryId", 338937295 + j);
+            (void)mxjson_writer_end_object(&ctx->w);
+        }
+
+        (void)mxjson_writer_end_array(&ctx->w);
+        mxjson_corpus_null(ctx, "seatMapImage");
+        mxjson_corpus_int(ctx, "start",
+                          1372701600000LL +
+                          (int64_t)mxjson_corpus_range(rng, 100000) * 3600000);
+        mxjson_corpus_str(ctx, "venueCode", mxstr_literal("PLEYEL_PLEYEL"));
+        (void)mxjson_writer_end_object(&ctx->w);
+    }
+
+    (void)mxjson_writer_end_array(&ctx->w);
+
+    mxjson_corpus_citm_names(ctx, "seatCategoryNames", 64, &text);
+    mxjson_corpus_citm_names(ctx, "subTopicNames", 19, &text);
+    mxjson_corpus_key(ctx, "subjectNames");
+    (void)mxjson_writer_begin_object(&ctx->w);
+    (void)mxjson_writer_end_object(&ctx->w);
+    mxjson_corpus_citm_names(ctx, "topicNames", 4, &text);
+    mxjson_corpus_key(ctx, "venueNames");
+    (void)mxjson_writer_begin_object(&ctx->w);
+    mxjson_corpus_str(ctx, "PLEYEL_PLEYEL", mxstr_literal("Salle Pleyel"));
+    (void)mxjson_writer_end_object(&ctx->w);
+
+    (void)mxjson_writer_end_object(&ctx->w);
+    mxbuf_free(&text);
+}
+
+
+/**
+ * Words for twitter text (mostly Japanese, as in twitter.json).
+ */
+static const char * const mxjson_corpus_twitter_words[] = {
+    "\xe5\x90\x8d\xe5\x89\x8d",                         /* name */
+    "\xe5\x89\x8d\xe7\x94\xb0\xe3\x81\x82\xe3\x82\x86\xe3\x81\xbf",
+    "\xe7\xac\xac\xe4\xb8\x80\xe5\x8d\xb0\xe8\xb1\xa1",
+    "\xe3\x81\x8a\xe3\x81\xaf\xe3\x82\x88\xe3\x81\x86",
+    "\xe4\xbb\x8a\xe6\x97\xa5", "\xe3\x82\x88\xe3\x82\x8d\xe3\x81\x97\xe3\x81\x8f",
+    "RT", "@aym0566x", "#followme", "http://t.co/Xs31FI7Gd4", "love",
+    "the", "and", "is", "\xf0\x9f\x98\x82", "\n", "lol", "today",
+};
+
+
+/**
+ * Generate a user object for a twitter status.
+ */
+static inline void
+mxjson_corpus_twitter_user (mxjson_corpus_ctx_t *ctx, mxbuf_t *text)
+{
+    mxjson_corpus_rng_t *rng = &ctx->rng;
+    uint64_t             id = mxjson_corpus_rand(rng) % 3000000000ULL;
+    char                 id_str[24];
+
+    (void)snprintf(id_str, sizeof(id_str), "%llu", (unsigned long long)id);
+
+    (void)mxjson_writer_begin_object(&ctx->w);
+    mxjson_corpus_int(ctx, "id", id);
+    mxjson_corpus_str(ctx, "id_str", mxstr(id_str, strlen(id_str)));
+    mxjson_corpus_str(ctx, "name",
+                      mxjson_corpus_words(
+                          ctx, mxjson_corpus_twitter_words,
+                          mxarray_size(mxjson_corpus_twitter_words), 2, text));
+    mxjson_corpus_str(ctx, "screen_name", mxstr_literal("yuttari1998"));
+    mxjson_corpus_str(ctx, "location",
+                      mxjson_corpus_words(
+                          ctx, mxjson_corpus_twitter_words,
+                          mxarray_size(mxjson_corpus_twitter_words), 1, text));
+    mxjson_corpus_str(ctx, "description",
+                      mxjson_corpus_words(
+                          ctx, mxjson_corpus_twitter_words,
+                          mxarray_size(mxjson_corpus_twitter_words),
+                          mxjson_corpus_between(rng, 5, 30), text));
+    mxjson_corpus_null(ctx, "url");
+    mxjson_corpus_key(ctx, "entities");
+    (void)mxjson_writer_raw(&ctx->w,
+                            mxstr_literal("{\"description\":{\"urls\":[]}}"));
+    mxjson_corpus_bool(ctx, "protected", false);
+    mxjson_corpus_int(ctx, "followers_count", mxjson_corpus_range(rng, 5000));
+    mxjson_corpus_int(ctx, "friends_count", mxjson_corpus_range(rng, 5000));
+    mxjson_corpus_int(ctx, "listed_count", mxjson_corpus_range(rng, 50));
+    mxjson_corpus_str(ctx, "created_at",
+                      mxstr_literal("Sun Aug 31 00:29:15 +0000 2014"));
+    mxjson_corpus_int(ctx, "favourites_count", mxjson_corpus_range(rng, 9000));
+    mxjson_corpus_int(ctx, "utc_offset", 32400);
+    mxjson_corpus_str(ctx, "time_zone", mxstr_literal("Tokyo"));
+    mxjson_corpus_bool(ctx, "geo_enabled", mxjson_corpus_range(rng, 2));
+    mxjson_corpus_bool(ctx, "verified", false);
+    mxjson_corpus_int(ctx, "statuses_count", mxjson_corpus_range(rng, 90000));
+    mxjson_corpus_str(ctx, "lang", mxstr_literal("ja"));
+    mxjson_corpus_key(ctx, "profile_image_url");
+    (void)mxjson_writer_raw(&ctx->w,
+                            mxstr_literal("\"http:\\/\\/pbs.twimg.com\\/"
+                                          "profile_images\\/4977\\/a.jpeg\""));
+    mxjson_corpus_str(ctx, "profile_background_color",
+                      mxstr_literal("C0DEED"));
+    mxjson_corpus_bool(ctx, "default_profile", true);
+    mxjson_corpus_null(ctx, "following");
+    mxjson_corpus_null(ctx, "notifications");
+    (void)mxjson_writer_end_object(&ctx->w);
+}
+
+
+/**
+ * Generate a document shaped like twitter.json.
+ */
+static inline void
+mxjson_corpus_twitter (mxjson_corpus_ctx_t *ctx)
+{
+    mxjson_corpus_rng_t *rng = &ctx->rng;
+    mxbuf_t              text;
+    uint64_t             id = 505874924095815681ULL;
+    char                 id_str[24];
+    uint32_t             i;
+
+    mxbuf_create(&text, NULL, 0);
+    (void)mxjson_writer_begin_object(&ctx->w);
+    mxjson_corpus_key(ctx, "statuses");
+    (void)mxjson_writer_begin_array(&ctx->w);
+
+    while (mxjson_corpus_size(ctx) < ctx->size) {
+        id += mxjson_corpus_range(rng, 1000000);
+        (void)snprintf(id_str, sizeof(id_str), "%llu", (unsigned long long)id);
+
+        (void)mxjson_writer_begin_object(&ctx->w);
+        mxjson_corpus_key(ctx, "metadata");
+        (void)mxjson_writer_raw(&ctx->w,
+                                mxstr_literal("{\"result_type\":\"recent\","
+                                              "\"iso_language_code\":\"ja\"}"));
+        mxjson_corpus_str(ctx, "created_at",
+                          mxstr_literal("Sun Aug 31 00:29:15 +0000 2014"));
+        mxjson_corpus_int(ctx, "id", id);
+        mxjson_corpus_str(ctx, "id_str", mxstr(id_str, strlen(id_str)));
+        mxjson_corpus_str(ctx, "text",
+                          mxjson_corpus_words(
+                              ctx, mxjson_corpus_twitter_words,
+                              mxarray_size(mxjson_corpus_twitter_words),
+                              mxjson_corpus_between(rng, 3, 40), &text));
+        mxjson_corpus_key(ctx, "source");
+        (void)mxjson_writer_raw(&ctx->w,
+                                mxstr_literal("\"<a href=\\\"http:\\/\\/twitter"
+                                              ".com\\/download\\/iphone\\\" "
+                                              "rel=\\\"nofollow\\\">Twitter for "
+                                              "iPhone<\\/a>\""));
+        mxjson_corpus_bool(ctx, "truncated", false);
+        mxjson_corpus_null(ctx, "in_reply_to_status_id");
+        mxjson_corpus_null(ctx, "in_reply_to_status_id_str");
+        mxjson_corpus_null(ctx, "in_reply_to_user_id");
+        mxjson_corpus_null(ctx, "in_reply_to_user_id_str");
+        mxjson_corpus_null(ctx, "in_reply_to_screen_name");
+        mxjson_corpus_key(ctx, "user");
+        mxjson_corpus_twitter_user(ctx, &text);
+        mxjson_corpus_null(ctx, "geo");
+        mxjson_corpus_null(ctx, "coordinates");
+        mxjson_corpus_null(ctx, "place");
+        mxjson_corpus_null(ctx, "contributors");
+        mxjson_corpus_int(ctx, "retweet_count", mxjson_corpus_range(rng, 100));
+        mxjson_corpus_int(ctx, "favorite_count", mxjson_corpus_range(rng, 100));
+
+        mxjson_corpus_key(ctx, "entities");
+        (void)mxjson_writer_begin_object(&ctx->w);
+        mxjson_corpus_ids(ctx, "hashtags", 0);
+        mxjson_corpus_ids(ctx, "symbols", 0);
+        mxjson_corpus_ids(ctx, "urls", 0);
+        mxjson_corpus_key(ctx, "user_mentions");
+        (void)mxjson_writer_begin_array(&ctx->w);
+
+        for (i = mxjson_corpus_range(rng, 3); i != 0; i--) {
+            (void)mxjson_writer_begin_object(&ctx->w);
+            mxjson_corpus_str(ctx, "screen_name", mxstr_literal("aym0566x"));
+            mxjson_corpus_str(ctx, "name",
+                              mxjson_corpus_words(
+                                  ctx, mxjson_corpus_twitter_words,
+                                  mxarray_size(mxjson_corpus_twitter_words),
+                                  1, &text));
+            mxjson_corpus_int(ctx, "id", 866260188);
+            mxjson_corpus_str(ctx, "id_str", mxstr_literal("866260188"));
+            mxjson_corpus_key(ctx, "indices");
+            (void)mxjson_writer_raw(&ctx->w, mxstr_literal("[0,9]"));
+            (void)mxjson_writer_end_object(&ctx->w);
+        }
+
+        (void)mxjson_writer_end_array(&ctx->w);
+        (void)mxjson_writer_end_object(&ctx->w);
+        mxjson_corpus_bool(ctx, "favorited", false);
+        mxjson_corpus_bool(ctx, "retweeted", false);
+        mxjson_corpus_str(ctx, "lang", mxstr_literal("ja"));
+        (void)mxjson_writer_end_object(&ctx->w);
+    }
+
+    (void)mxjson_writer_end_array(&ctx->w);
+    mxjson_corpus_key(ctx, "search_metadata");
+    (void)mxjson_writer_raw(&ctx->w,
+                            mxstr_literal("{\"completed_in\":0.087,"
+                                          "\"max_id\":505874924095815681,"
+                                          "\"query\":\"%E4%B8%80\","
+                                          "\"count\":100}"));
+    (void)mxjson_writer_end_object(&ctx->w);
+    mxbuf_free(&text);
+}
+
+
+/**
+ * Generate a document shaped like canada.json.
+ */
+static inline void
+mxjson_corpus_canada (mxjson_corpus_ctx_t *ctx)
+{
+    mxjson_corpus_rng_t *rng = &ctx->rng;
+    char                 number[32];
+    double               x;
+    double               y;
+    uint32_t             i;
+    int                  len;
+
+    (void)mxjson_writer_begin_object(&ctx->w);
+    mxjson_corpus_str(ctx, "type", mxstr_literal("FeatureCollection"));
+    mxjson_corpus_key(ctx, "features");
+    (void)mxjson_writer_begin_array(&ctx->w);
+    (void)mxjson_writer_begin_object(&ctx->w);
+    mxjson_corpus_str(ctx, "type", mxstr_literal("Feature"));
+    mxjson_corpus_key(ctx, "properties");
+    (void)mxjson_writer_raw(&ctx->w, mxstr_literal("{\"name\":\"Canada\"}"));
+    mxjson_corpus_key(ctx, "geometry");
+    (void)mxjson_writer_begin_object(&ctx->w);
+    mxjson_corpus_str(ctx, "type", mxstr_literal("Polygon"));
+    mxjson_corpus_key(ctx, "coordinates");
+    (void)mxjson_writer_begin_array(&ctx->w);
+
+    while (mxjson_corpus_size(ctx) < ctx->size) {
+        /*
+         * A ring of coordinates, following a random walk.
+         */
+        (void)mxjson_writer_begin_array(&ctx->w);
+        x = -140.0 + mxjson_corpus_range(rng, 8000) / 100.0;
+        y = 42.0 + mxjson_corpus_range(rng, 3000) / 100.0;
+
+        for (i = mxjson_corpus_between(rng, 10, 2000); i != 0; i--) {
+            x += (mxjson_corpus_range(rng, 2001) - 1000.0) / 100000.0;
+            y += (mxjson_corpus_range(rng, 2001) - 1000.0) / 100000.0;
+            (void)mxjson_writer_begin_array(&ctx->w);
+            len = snprintf(number, sizeof(number), "%.15f", x);
+            (void)mxjson_writer_number(&ctx->w, mxstr(number, len));
+            len = snprintf(number, sizeof(number), "%.15f", y);
+            (void)mxjson_writer_number(&ctx->w, mxstr(number, len));
+            (void)mxjson_writer_end_array(&ctx->w);
+        }
+
+        (void)mxjson_writer_end_array(&ctx->w);
+    }
+
+    (void)mxjson_writer_end_array(&ctx->w);
+    (void)mxjson_writer_end_object(&ctx->w);
+    (void)mxjson_writer_end_object(&ctx->w);
+    (void)mxjson_writer_end_array(&ctx->w);
+    (void)mxjson_writer_end_object(&ctx->w);
+}
+
+
+/**
+ * Generate a document made up almost entirely of literals.
+ *
+ * An array of small objects of flags, each holding only true, false and
+ * null values and a short array of them, so that the parse time is
+ * dominated by matching literals.
+ */
+static inline void
+mxjson_corpus_literals (mxjson_corpus_ctx_t *ctx)
+{
+    static const char   *names[] = {
+        "active", "admin", "deleted", "locked", "muted", "pinned",
+        "private", "verified",
+    };
+    mxjson_corpus_rng_t *rng = &ctx->rng;
+    uint32_t             i;
+    uint32_t             value;
+
+    (void)mxjson_writer_begin_array(&ctx->w);
+
+    while (mxjson_corpus_size(ctx) < ctx->size) {
+        (void)mxjson_writer_begin_object(&ctx->w);
+
+        for (i = 0; i < mxarray_size(names); i++) {
+            value = mxjson_corpus_range(rng, 3);
+
+            if (value == 2) {
+                mxjson_corpus_null(ctx, names[i]);
+            } else {
+                mxjson_corpus_bool(ctx, names[i], value);
+            }
+        }
+
+        mxjson_corpus_key(ctx, "history");
+        (void)mxjson_writer_begin_array(&ctx->w);
+
+        for (i = mxjson_corpus_between(rng, 4, 32); i != 0; i--) {
+            value = mxjson_corpus_range(rng, 3);
+
+            if (value == 2) {
+                (void)mxjson_writer_null(&ctx->w);
+            } else {
+                (void)mxjson_writer_bool(&ctx->w, value);
+            }
+        }
+
+        (void)mxjson_writer_end_array(&ctx->w);
+        (void)mxjson_writer_end_object(&ctx->w);
+    }
+
+    (void)mxjson_writer_end_array(&ctx->w);
+}
+
+
+/**
+ * The standard corpus, with sizes similar to the original documents, and
+ * the literals document.
+ */
+static const mxjson_corpus_t mxjson_corpora[] = {
+    { "citm",     mxjson_corpus_citm,     500000, 4 },
+    { "twitter",  mxjson_corpus_twitter,  400000, 2 },
+    { "canada",   mxjson_corpus_canada,   2200000, 0 },
+    { "literals", mxjson_corpus_literals, 1000000, 0 },
+};
+
+
+/**
+ * Generate a document.
+ *
+ * The document is generated in compact form, then re-written with the
+ * required indentation.
+ *
+ * @param[in] generate
+ *   The function to generate the document.
+ *
+ * @param[in] seed
+ *   Seed for the random number generator. The same seed always produces
+ *   the same document.
+ *
+ * @param[in] size
+ *   The approximate size of the document before indentation.
+ *
+ * @param[in] indent
+ *   The indentation (0 for compact).
+ *
+ * @param[in] out
+ *   The buffer to append the document to.
+ *
+ * @return
+ *   Indicates whether a valid JSON document was generated.
+ */
+static inline bool
+mxjson_corpus_generate (mxjson_corpus_fn  generate,
+                        uint64_t          seed,
+                        size_t            size,
+                        unsigned int      indent,
+                        mxbuf_t          *out)
+{
+    mxjson_corpus_ctx_t ctx;
+    mxjson_parser_t     p;
+    mxbuf_t             compact;
+    bool                ok;
+
+    mxbuf_create(&compact, NULL, 0);
+    ctx.rng.state = seed;
+    ctx.out = &compact;
+    ctx.size = size;
+    mxjson_writer_init(&ctx.w, ctx.buf, sizeof(ctx.buf),
+                       mxjson_corpus_flush, &compact);
+
+    generate(&ctx);
+    ok = mxjson_writer_finish(&ctx.w);
+
+    if (ok) {
+        mxjson_init(&p, 0, NULL, mxjson_resize);
+        ok = mxjson_parse(&p, mxbuf_str(&compact));
+
+        if (ok && indent != 0) {
+            (void)mxjson_write(&p, 1, out, indent);
+        } else if (ok) {
+            (void)mxbuf_write(out, mxbuf_str(&compact));
+        }
+
+        mxjson_free(&p);
+    }
+
+    mxbuf_free(&compact);
+
+    return ok;
+}
+
+
+/*
+ * ----------------------------------------------------------------------
+ * Shaped Documents
+ * ----------------------------------------------------------------------
+ */
+
+/**
+ * Number formats for shaped documents.
+ */
+typedef enum {
+    MXJSON_CORPUS_INT,      /**< Integers, e.g. -123456 */
+    MXJSON_CORPUS_DECIMAL,  /**< Decimals, e.g. 12.3456789 */
+    MXJSON_CORPUS_EXPONENT, /**< Exponent form, e.g. -1.25e-17 */
+    MXJSON_CORPUS_MIXED,    /**< A random mix of the above */
+} mxjson_corpus_numbers_t;
+
+
+/**
+ * Parameters controlling the shape of a generated document.
+ */
+typedef struct {
+    uint64_t                seed;       /**< Random number generator seed */
+    uint64_t                size;       /**< Total size to generate */
+    uint64_t                doc_size;   /**< Size of each NDJSON document,
+                                             or 0 for a single document */
+    uint32_t                depth;      /**< Maximum nesting depth */
+    uint32_t                fanout;     /**< Maximum children per object or
+                                             array */
+    uint32_t                string_min; /**< Minimum string length */
+    uint32_t                string_max; /**< Maximum string length */
+    uint32_t                escapes;    /**< Escape sequences per 1000
+                                             string characters */
+    uint32_t                containers; /**< Percentage of values that are
+                                             objects or arrays */
+    uint32_t                whitespace; /**< Percentage of whitespace */
+    mxjson_corpus_numbers_t numbers;    /**< Number format */
+} mxjson_corpus_shape_t;
+
+
+/**
+ * Default shape: a compact document of moderately nested objects and arrays.
+ */
+static const mxjson_corpus_shape_t mxjson_corpus_shape_default = {
+    1, 1000000, 0, 6, 8, 0, 24, 10, 10, 0, MXJSON_CORPUS_MIXED
+};
+
+
+/**
+ * \internal
+ * State for generating a shaped document.
+ */
+typedef struct {
+    const mxjson_corpus_shape_t *shape;     /**< Shape to generate */
+    mxjson_corpus_rng_t          rng;       /**< Random number generator */
+    mxbuf_t                      buf;       /**< Output not yet flushed */
+    mxjson_flush_cb              flush_fn;  /**< Callback to consume output */
+    void                        *flush_ctx; /**< Context for flush_fn */
+    uint64_t                     written;   /**< Total size generated */
+    uint64_t                     ws;        /**< Whitespace generated */
+    uint64_t                     limit;     /**< Size at which to stop
+                                                 adding children */
+    bool                         ndjson;    /**< No newlines in whitespace */
+    bool                         ok;        /**< Flush callback succeeded */
+} mxjson_corpus_gen_t;
+
+
+/**
+ * \internal
+ * Pass the buffered output to the flush callback once enough has built up
+ * (or unconditionally if force is set).
+ */
+static inline void
+mxjson_corpus_gen_flush (mxjson_corpus_gen_t *g, bool force)
+{
+    mxstr_t data = mxbuf_str(&g->buf);
+
+    if (data.len >= 65536 || (force && data.len != 0)) {
+        g->ok = g->ok && g->flush_fn(g->flush_ctx, data);
+        mxbuf_reset(&g->buf);
+    }
+}
+
+
+/**
+ * \internal
+ * Write a string to a shaped document.
+ */
+static inline void
+mxjson_corpus_gen_put (mxjson_corpus_gen_t *g, mxstr_t str)
+{
+    g->written += mxbuf_write(&g->buf, str);
+    mxjson_corpus_gen_flush(g, false);
+}
+
+
+/**
+ * \internal
+ * Write a character to a shaped document.
+ */
+static inline void
+mxjson_corpus_gen_putc (mxjson_corpus_gen_t *g, unsigned char c)
+{
+    g->written += mxbuf_putc(&g->buf, c);
+}
+
+
+/**
+ * \internal
+ * Write whitespace between tokens, if needed to keep the proportion of
+ * whitespace at the requested percentage. The whitespace is a newline
+ * followed by spaces (only spaces for NDJSON).
+ */
+static inline void
+mxjson_corpus_gen_ws (mxjson_corpus_gen_t *g)
+{
+    uint64_t pct = g->shape->whitespace;
+    uint64_t deficit;
+    uint64_t n;
+
+    if (pct * g->written > 100 * g->ws) {
+        deficit = (pct * g->written - 100 * g->ws) / (100 - pct) + 1;
+        n = min(deficit, 64);
+        g->ws += n;
+
+        if (!g->ndjson) {
+            mxjson_corpus_gen_putc(g, '\n');
+            n--;
+        }
+
+        g->written += mxbuf_write_chars(&g->buf, ' ', n);
+    }
+}
+
+
+/**
+ * \internal
+ * Write a string value (or member name) of random length to a shaped
+ * document, including escape sequences at the requested density.
+ */
+static inline void
+mxjson_corpus_gen_string (mxjson_corpus_gen_t *g,
+                          uint32_t             min_len,
+                          uint32_t             max_len)
+{
+    static const char   plain[] = "abcdefghijklmnopqrstuvwxyz"
+                                  "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 ";
+    static const char  *escapes[] = {
+        "\\n", "\\t", "\\\"", "\\\\", "\\/", "\\u00e9", "\\ud83d\\ude00",
+    };
+    const char         *esc;
+    uint32_t            len;
+    uint32_t            i;
+
+    len = mxjson_corpus_between(&g->rng, min_len, max(min_len, max_len));
+    mxjson_corpus_gen_putc(g, '\"');
+
+    for (i = 0; i < len; i++) {
+        if (mxjson_corpus_range(&g->rng, 1000) < g->shape->escapes) {
+            esc = escapes[mxjson_corpus_range(&g->rng, mxarray_size(escapes))];
+            mxjson_corpus_gen_put(g, mxstr((char *)esc, strlen(esc)));
+        } else {
+            mxjson_corpus_gen_putc(g, plain[mxjson_corpus_range(
+                                                &g->rng, sizeof(plain) - 1)]);
+        }
+
+        if ((i & 0xfff) == 0) {
+            mxjson_corpus_gen_flush(g, false);
+        }
+    }
+
+    mxjson_corpus_gen_putc(g, '\"');
+}
+
+
+/**
+ * \internal
+ * Write a number in the requested format to a shaped document.
+ */
+static inline void
+mxjson_corpus_gen_number (mxjson_corpus_gen_t *g)
+{
+    mxjson_corpus_numbers_t format = g->shape->numbers;
+    mxjson_corpus_rng_t    *rng = &g->rng;
+    char                    number[48];
+    uint64_t                a;
+    uint64_t                b;
+    uint64_t                scale;
+    int64_t                 value;
+    int                     precision;
+    int                     len;
+
+    if (format == MXJSON_CORPUS_MIXED) {
+        format = mxjson_corpus_range(rng, MXJSON_CORPUS_MIXED);
+    }
+
+    /*
+     * Each random number is drawn in a separate statement, as the order in
+     * which the operands of an expression are evaluated is unspecified, and
+     * the values are subtracted unsigned, as the difference overflows
+     * int64_t. The same options then generate the same output with any
+     * compiler.
+     */
+    a = mxjson_corpus_rand(rng);
+    a >>= mxjson_corpus_range(rng, 64);
+    b = mxjson_corpus_rand(rng);
+    b >>= mxjson_corpus_range(rng, 64);
+    value = (int64_t)(a - b);
+
+    switch (format) {
+    case MXJSON_CORPUS_INT:
+    default:
+        len = snprintf(number, sizeof(number), "%lld", (long long)value);
+        break;
+
+    case MXJSON_CORPUS_DECIMAL:
+        precision = mxjson_corpus_between(rng, 1, 17);
+        scale = 1ULL << mxjson_corpus_range(rng, 64);
+        len = snprintf(number, sizeof(number), "%.*f", precision,
+                       (double)value / scale);
+        break;
+
+    case MXJSON_CORPUS_EXPONENT:
+        precision = mxjson_corpus_range(rng, 17);
+        scale = 1ULL << mxjson_corpus_range(rng, 64);
+        len = snprintf(number, sizeof(number), "%.*e", precision,
+                       (double)value / scale);
+
+        /*
+         * Replace the exponent (from the range of value) with one across
+         * the whole range of a double.
+         */
+        len = strchr(number, 'e') - number;
+        len += snprintf(&number[len], sizeof(number) - len, "e%d",
+                        (int)mxjson_corpus_range(rng, 600) - 300);
+        break;
+    }
+
+    mxjson_corpus_gen_put(g, mxstr(number, len));
+}
+
+
+/**
+ * \internal
+ * Write a random value to a shaped document.
+ *
+ * The nesting is bounded by the depth, and by the size: once the size
+ * limit is reached no more children are added, so a high proportion of
+ * containers fills the document depth first rather than growing without
+ * bound.
+ */
+static inline void
+mxjson_corpus_gen_value (mxjson_corpus_gen_t *g, uint32_t depth)
+{
+    const mxjson_corpus_shape_t *shape = g->shape;
+    mxjson_corpus_rng_t         *rng = &g->rng;
+    uint32_t                     n;
+    uint32_t                     i;
+    uint32_t                     r;
+    bool                         object;
+
+    r = mxjson_corpus_range(rng, 10);
+
+    if (depth < shape->depth &&
+        mxjson_corpus_range(rng, 100) < shape->containers) {
+        object = (r < 5);
+        n = mxjson_corpus_between(rng, 0, shape->fanout);
+        mxjson_corpus_gen_putc(g, object ? '{' : '[');
+
+        for (i = 0; i < n && g->written < g->limit; i++) {
+            if (i != 0) {
+                mxjson_corpus_gen_putc(g, ',');
+            }
+            mxjson_corpus_gen_ws(g);
+
+            if (object) {
+                mxjson_corpus_gen_string(g, 1, 16);
+                mxjson_corpus_gen_putc(g, ':');
+            }
+            mxjson_corpus_gen_value(g, depth + 1);
+        }
+
+        mxjson_corpus_gen_ws(g);
+        mxjson_corpus_gen_putc(g, object ? '}' : ']');
+
+    } else if (r < 4) {
+        mxjson_corpus_gen_string(g, shape->string_min, shape->string_max);
+
+    } else if (r < 8) {
+        mxjson_corpus_gen_number(g);
+
+    } else {
+        switch (mxjson_corpus_range(rng, 3)) {
+        case 0:
+            mxjson_corpus_gen_put(g, mxstr_literal("true"));
+            break;
+
+        case 1:
+            mxjson_corpus_gen_put(g, mxstr_literal("false"));
+            break;
+
+        default:
+            mxjson_corpus_gen_put(g, mxstr_literal("null"));
+            break;
+        }
+    }
+
+    mxjson_corpus_gen_flush(g, false);
+}
+
+
+/**
+ * \internal
+ * Write a top level object or array, adding children until the document
+ * reaches the size limit.
+ */
+static inline void
+mxjson_corpus_gen_document (mxjson_corpus_gen_t *g, bool object)
+{
+    bool first = true;
+
+    mxjson_corpus_gen_putc(g, object ? '{' : '[');
+
+    while (g->written < g->limit) {
+        if (!first) {
+            mxjson_corpus_gen_putc(g, ',');
+        }
+        mxjson_corpus_gen_ws(g);
+
+        if (object) {
+            mxjson_corpus_gen_string(g, 1, 16);
+            mxjson_corpus_gen_putc(g, ':');
+        }
+        mxjson_corpus_gen_value(g, 1);
+        first = false;
+    }
+
+    mxjson_corpus_gen_ws(g);
+    mxjson_corpus_gen_putc(g, object ? '}' : ']');
+}
+
+
+/**
+ * Generate a document (or NDJSON stream) with a controlled shape.
+ *
+ * The output is deterministic for a given shape (including the seed), and
+ * is passed to the flush callback in blocks, so the memory used does not
+ * depend on the size generated. A single document is a top level array.
+ * An NDJSON stream is a sequence of top level objects, one per line.
+ *
+ * @param[in] shape
+ *   The shape of the document to generate. The depth must be at most
+ *   MXJSON_CORPUS_MAX_DEPTH, and the whitespace percentage at most 95.
+ *
+ * @param[in] flush_fn
+ *   Callback to consume the output.
+ *
+ * @param[in] flush_ctx
+ *   Context pointer passed to flush_fn.
+ *
+ * @param[out] written
+ *   Set to the number of bytes generated (which is 0 for an empty NDJSON
+ *   stream). May be NULL.
+ *
+ * @return
+ *   Indicates whether the output was consumed. false is returned if the
+ *   flush callback failed.
+ */
+static inline bool
+mxjson_corpus_shaped (const mxjson_corpus_shape_t *shape,
+                      mxjson_flush_cb              flush_fn,
+                      void                        *flush_ctx,
+                      uint64_t                    *written)
+{
+    mxjson_corpus_gen_t g;
+
+    assert(shape->depth <= MXJSON_CORPUS_MAX_DEPTH && shape->whitespace <= 95);
+
+    memset(&g, 0, sizeof(g));
+    g.shape = shape;
+    g.rng.state = shape->seed;
+    g.flush_fn = flush_fn;
+    g.flush_ctx = flush_ctx;
+    g.ndjson = (shape->doc_size != 0);
+    g.ok = true;
+    mxbuf_create(&g.buf, NULL, 0);
+
+    if (g.ndjson) {
+        while (g.written < shape->size) {
+            g.limit = min(g.written + shape->doc_size, shape->size);
+            mxjson_corpus_gen_document(&g, true);
+            mxjson_corpus_gen_putc(&g, '\n');
+        }
+    } else {
+        g.limit = shape->size;
+        mxjson_corpus_gen_document(&g, false);
+    }
+
+    mxjson_corpus_gen_flush(&g, true);
+    mxbuf_free(&g.buf);
+
+    if (written != NULL) {
+        *written = g.written;
+    }
+
+    return g.ok;
+}
+
+
+/*
+ * ----------------------------------------------------------------------
+ * Adversarial Documents
+ * ----------------------------------------------------------------------
+ */
+
+/**
+ * Generate an adversarial document of (approximately) the given size,
+ * appending it to a buffer.
+ */
+typedef void (*mxjson_corpus_adversarial_fn)(mxbuf_t *out, size_t size);
+
+
+/**
+ * An adversarial document, designed to stress a single path in the
+ * parser.
+ */
+typedef struct {
+    const char                   *name;     /**< Name of the document */
+    mxjson_corpus_adversarial_fn  generate; /**< Function to generate it */
+    bool                          valid;    /**< Whether it is valid JSON */
+} mxjson_corpus_adversarial_t;
+
+
+/**
+ * \internal
+ * Get the number of bytes appended to a buffer since an earlier size.
+ */
+static inline size_t
+mxjson_corpus_appended (mxbuf_t *out, size_t start)
+{
+    return mxbuf_str(out).len - start;
+}
+
+
+/**
+ * Objects/arrays nested to the maximum depth accepted by the parser,
+ * repeated as the elements of an array (mxjson_ascend(), parse stack).
+ */
+static inline void
+mxjson_corpus_adv_deep_arrays (mxbuf_t *out, size_t size)
+{
+    size_t start = mxbuf_str(out).len;
+    size_t depth = MXJSON_MAX_DEPTH - 1;
+
+    (void)mxbuf_putc(out, '[');
+
+    do {
+        mxbuf_write_chars(out, '[', depth);
+        mxbuf_write_chars(out, ']', depth);
+        (void)mxbuf_putc(out, ',');
+    } while (mxjson_corpus_appended(out, start) < size);
+
+    (void)mxbuf_write(out, mxstr_literal("[]]"));
+}
+
+
+/**
+ * Objects nested to the maximum depth, each with a single member, repeated
+ * as the elements of an array.
+ */
+static inline void
+mxjson_corpus_adv_deep_objects (mxbuf_t *out, size_t size)
+{
+    size_t start = mxbuf_str(out).len;
+    size_t depth = MXJSON_MAX_DEPTH - 1;
+    size_t i;
+
+    (void)mxbuf_putc(out, '[');
+
+    do {
+        for (i = 0; i < depth; i++) {
+            (void)mxbuf_write(out, mxstr_literal("{\"a\":"));
+        }
+        (void)mxbuf_putc(out, '0');
+        mxbuf_write_chars(out, '}', depth);
+        (void)mxbuf_putc(out, ',');
+    } while (mxjson_corpus_appended(out, start) < size);
+
+    (void)mxbuf_write(out, mxstr_literal("{}]"));
+}
+
+
+/**
+ * Opening brackets only, nested far beyond the maximum depth (rejected).
+ */
+static inline void
+mxjson_corpus_adv_deep_unclosed (mxbuf_t *out, size_t size)
+{
+    mxbuf_write_chars(out, '[', size);
+}
+
+
+/**
+ * A single string made up of \u escape sequences, including surrogate
+ * pairs (mxjson_parse_escaped_char(), mxjson_unescape()).
+ */
+static inline void
+mxjson_corpus_adv_unicode_escapes (mxbuf_t *out, size_t size)
+{
+    size_t start = mxbuf_str(out).len;
+
+    (void)mxbuf_write(out, mxstr_literal("[\""));
+
+    while (mxjson_corpus_appended(out, start) < size) {
+        (void)mxbuf_write(out, mxstr_literal("\\ud83d\\ude00\\u00e9\\u4e2d"));
+    }
+
+    (void)mxbuf_write(out, mxstr_literal("\"]"));
+}
+
+
+/**
+ * An array of short strings, each containing several escape sequences.
+ */
+static inline void
+mxjson_corpus_adv_escaped_strings (mxbuf_t *out, size_t size)
+{
+    size_t start = mxbuf_str(out).len;
+
+    (void)mxbuf_putc(out, '[');
+
+    while (mxjson_corpus_appended(out, start) < size) {
+        (void)mxbuf_write(out, mxstr_literal("\"a\\n\\t\\\"\\\\\\/b\\u0000\","));
+    }
+
+    (void)mxbuf_write(out, mxstr_literal("\"\"]"));
+}
+
+
+/**
+ * A single string of plain characters (string_span kernels).
+ */
+static inline void
+mxjson_corpus_adv_long_string (mxbuf_t *out, size_t size)
+{
+    (void)mxbuf_write(out, mxstr_literal("[\""));
+    mxbuf_write_chars(out, 'a', size);
+    (void)mxbuf_write(out, mxstr_literal("\"]"));
+}
+
+
+/**
+ * A string that is never terminated (rejected).
+ */
+static inline void
+mxjson_corpus_adv_unterminated_string (mxbuf_t *out, size_t size)
+{
+    (void)mxbuf_write(out, mxstr_literal("[\""));
+    mxbuf_write_chars(out, 'a', size);
+}
+
+
+/**
+ * A single number, with long runs of digits in the integer part, the
+ * fraction and the exponent (mxjson_parse_number()).
+ */
+static inline void
+mxjson_corpus_adv_long_number (mxbuf_t *out, size_t size)
+{
+    (void)mxbuf_write(out, mxstr_literal("[-1"));
+    mxbuf_write_chars(out, '7', size / 3);
+    (void)mxbuf_putc(out, '.');
+    mxbuf_write_chars(out, '3', size / 3);
+    (void)mxbuf_write(out, mxstr_literal("e+1"));
+    mxbuf_write_chars(out, '9', size / 3);
+    (void)mxbuf_putc(out, ']');
+}
+
+
+/**
+ * A flat array of single digit numbers, which produces the most tokens per
+ * byte of input (mxjson_token(), mxjson_resize()).
+ */
+static inline void
+mxjson_corpus_adv_flat_array (mxbuf_t *out, size_t size)
+{
+    size_t start = mxbuf_str(out).len;
+
+    (void)mxbuf_putc(out, '[');
+
+    while (mxjson_corpus_appended(out, start) < size) {
+        (void)mxbuf_write(out, mxstr_literal("0,0,0,0,0,0,0,0,"));
+    }
+
+    (void)mxbuf_write(out, mxstr_literal("0]"));
+}
+
+
+/**
+ * A flat object with a distinct member name for each member.
+ */
+static inline void
+mxjson_corpus_adv_flat_object (mxbuf_t *out, size_t size)
+{
+    size_t   start = mxbuf_str(out).len;
+    uint64_t i = 0;
+
+    (void)mxbuf_putc(out, '{');
+
+    while (mxjson_corpus_appended(out, start) < size) {
+        (void)mxbuf_putc(out, '\"');
+        (void)mxbuf_put_uint64(out, i++);
+        (void)mxbuf_write(out, mxstr_literal("\":0,"));
+    }
+
+    (void)mxbuf_write(out, mxstr_literal("\"\":0}"));
+}
+
+
+/**
+ * A single value surrounded by whitespace (mxjson_consume_ws()).
+ */
+static inline void
+mxjson_corpus_adv_whitespace (mxbuf_t *out, size_t size)
+{
+    (void)mxbuf_putc(out, '[');
+    mxbuf_write_chars(out, ' ', size / 2);
+    (void)mxbuf_write(out, mxstr_literal("0\n"));
+    mxbuf_write_chars(out, '\t', size / 2);
+    (void)mxbuf_putc(out, ']');
+}
+
+
+/**
+ * The adversarial documents.
+ */
+static const mxjson_corpus_adversarial_t mxjson_corpus_adversarial[] = {
+    { "deep_arrays", mxjson_corpus_adv_deep_arrays, true },
+    { "deep_objects", mxjson_corpus_adv_deep_objects, true },
+    { "deep_unclosed", mxjson_corpus_adv_deep_unclosed, false },
+    { "unicode_escapes", mxjson_corpus_adv_unicode_escapes, true },
+    { "escaped_strings", mxjson_corpus_adv_escaped_strings, true },
+    { "long_string", mxjson_corpus_adv_long_string, true },
+    { "unterminated_string", mxjson_corpus_adv_unterminated_string, false },
+    { "long_number", mxjson_corpus_adv_long_number, true },
+    { "flat_array", mxjson_corpus_adv_flat_array, true },
+    { "flat_object", mxjson_corpus_adv_flat_object, true },
+    { "whitespace", mxjson_corpus_adv_whitespace, true },
+};
+
+
+#endif
@@ -0,0 +1,177 @@
+/*
+ * ----------------------------------------------------------------------
+ * |\ /| mxjson-gen.c
+ * | X | Generate JSON documents with a controlled shape
+ * |/ \|
+ * ----------------------------------------------------------------------
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mxjson.h"
+#include "mxstr.h"
+#include "bench/mxjson-corpus.h"
+
+
+/**
+ * Names of the number formats.
+ */
+static const char *gen_number_names[] = {
+    "int", "decimal", "exponent", "mixed",
+};
+
+
+/**
+ * Parse a size, with an optional k, M or G (powers of 1024) suffix.
+ */
+static uint64_t
+gen_size (const char *str)
+{
+    char     *end;
+    uint64_t  size;
+
+    size = strtoull(str, &end, 0);
+
+    switch (*end) {
+    case 'G': case 'g':
+        size <<= 10;
+        /* Fall through */
+    case 'M': case 'm':
+        size <<= 10;
+        /* Fall through */
+    case 'K': case 'k':
+        size <<= 10;
+        break;
+
+    default:
+        break;
+    }
+
+    return size;
+}
+
+
+/**
+ * Flush callback to write the output to stdout.
+ */
+static bool
+gen_flush (void *ctx, mxstr_t data)
+{
+    return (fwrite(data.ptr, 1, data.len, ctx) == data.len);
+}
+
+
+int main (int argc, char **argv)
+{
+    mxjson_corpus_shape_t shape = mxjson_corpus_shape_default;
+    char                 *sep;
+    size_t                i;
+    int                   opt;
+    bool                  ok = true;
+
+    while ((opt = getopt(argc, argv, "c:d:e:f:hl:n:N:r:s:w:")) != -1) {
+        switch (opt) {
+        case 'c':
+            shape.containers = atoi(optarg);
+            break;
+
+        case 'd':
+            shape.depth = atoi(optarg);
+            ok = ok && (shape.depth <= MXJSON_CORPUS_MAX_DEPTH);
+            break;
+
+        case 'e':
+            shape.escapes = atoi(optarg);
+            break;
+
+        case 'f':
+            shape.fanout = atoi(optarg);
+            break;
+
+        case 'l':
+            shape.string_min = strtoul(optarg, &sep, 0);
+            shape.string_max = (*sep == '-') ? strtoul(&sep[1], NULL, 0) :
+                                               shape.string_min;
+            break;
+
+        case 'n':
+            ok = false;
+
+            for (i = 0; i < mxarray_size(gen_number_names); i++) {
+                if (strcmp(optarg, gen_number_names[i]) == 0) {
+                    shape.numbers = i;
+                    ok = true;
+                }
+            }
+            break;
+
+        case 'N':
+            shape.doc_size = max(gen_size(optarg), 1);
+            break;
+
+        case 'r':
+            shape.seed = strtoull(optarg, NULL, 0);
+            break;
+
+        case 's':
+            shape.size = gen_size(optarg);
+            break;
+
+        case 'w':
+            shape.whitespace = atoi(optarg);
+            ok = ok && (shape.whitespace <= 95);
+            break;
+
+        case 'h':
+        default:
+            ok = false;
+            break;
+        }
+    }
+
+    if (!ok || optind != argc) {
+        fprintf(stderr, "Usage: %s [OPTION...]\n\n"
+         "Write a generated JSON document to stdout.\n\n"
+         "  -c <percent>  Percentage of values that are objects/arrays\n"
+         "                (default %u)\n"
+         "  -d <depth>    Maximum nesting depth (default %u, max %u)\n"
+         "  -e <count>    Escape sequences per 1000 string characters"
+         " (default %u)\n"
+         "  -f <count>    Maximum children per object/array (default %u)\n"
+         "  -h            Display this usage information\n"
+         "  -l <min-max>  String length range (default %u-%u)\n"
+         "  -n <format>   Number format: int, decimal, exponent or mixed\n"
+         "                (default %s)\n"
+         "  -N <size>     Generate an NDJSON stream, with documents of\n"
+         "                about <size> bytes\n"
+         "  -r <seed>     Random number generator seed (default %llu)\n"
+         "  -s <size>     Total size to generate (default %llu)\n"
+         "  -w <percent>  Percentage of whitespace (default %u, max 95)\n\n"
+         "Sizes may have a k, M or G suffix. The same options always\n"
+         "generate the same output.\n\n", argv[0],
+         mxjson_corpus_shape_default.containers,
+         mxjson_corpus_shape_default.depth, MXJSON_CORPUS_MAX_DEPTH,
+         mxjson_corpus_shape_default.escapes,
+         mxjson_corpus_shape_default.fanout,
+         mxjson_corpus_shape_default.string_min,
+         mxjson_corpus_shape_default.string_max,
+         gen_number_names[mxjson_corpus_shape_default.numbers],
+         (unsigned long long)mxjson_corpus_shape_default.seed,
+         (unsigned long long)mxjson_corpus_shape_default.size,
+         mxjson_corpus_shape_default.whitespace);
+        exit(1);
+    }
+
+    ok = (mxjson_corpus_shaped(&shape, gen_flush, stdout, NULL) &&
+          fflush(stdout) == 0);
+
+    if (!ok) {
+        fprintf(stderr, "Could not write to stdout\n");
+    }
+
+    return (!ok);
+}
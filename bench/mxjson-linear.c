@@ -0,0 +1,320 @@
+/*
+ * ----------------------------------------------------------------------
+ * |\ /| mxjson-linear.c
+ * | X | Check that the parse time is linear for adversarial inputs
+ * |/ \|
+ * ----------------------------------------------------------------------
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mxjson.h"
+#include "mxstr.h"
+#include "bench/mxjson-corpus.h"
+
+
+/**
+ * Number of sizes each document is generated at. Each size is double the
+ * previous one, up to the maximum size.
+ */
+#define SIZE_COUNT 5
+
+
+/**
+ * Minimum number of times to time each operation, and the minimum total
+ * time (s) to spend timing it, to reduce the effect of noise.
+ */
+#define MIN_REPEATS 5
+#define MIN_TIME    0.05
+
+
+/**
+ * Operations timed for each document.
+ */
+typedef enum {
+    LINEAR_PARSE,     /**< mxjson_parse(), then unescape every string */
+    LINEAR_VALIDATE,  /**< mxjson_validate() */
+    LINEAR_OP_COUNT
+} linear_op_t;
+
+
+/**
+ * Names of the operations.
+ */
+static const char *linear_op_names[LINEAR_OP_COUNT] = {
+    "parse", "validate",
+};
+
+
+/**
+ * Get the current time in seconds from a monotonic clock.
+ */
+static double
+linear_now (void)
+{
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+ * Perform an operation on a document.
+ *
+ * @return
+ *   Indicates whether the document is valid.
+ */
+static bool
+linear_run (linear_op_t op, mxjson_parser_t *p, mxbuf_t *buffer, mxstr_t json)
+{
+    mxjson_idx_t idx;
+    bool         ok;
+
+    if (op == LINEAR_PARSE) {
+        ok = mxjson_parse(p, json);
+
+        for (idx = 1; ok && idx <= p->idx; idx++) {
+            mxbuf_reset(buffer);
+            (void)mxjson_token_name(p, idx, buffer, &ok);
+            (void)(ok && mxjson_token_string(p, idx, buffer, &ok).len);
+        }
+    } else {
+        ok = mxjson_validate(json);
+    }
+
+    return ok;
+}
+
+
+/**
+ * Time an operation on a document.
+ *
+ * @param[out] valid
+ *   Set to whether the document is valid.
+ *
+ * @return
+ *   The fastest time (s) for the operation.
+ */
+static double
+linear_time (linear_op_t op, mxstr_t json, bool *valid)
+{
+    mxjson_parser_t p;
+    mxbuf_t         buffer;
+    double          start;
+    double          elapsed;
+    double          total = 0;
+    double          best = 0;
+    unsigned int    i;
+
+    mxjson_init(&p, 0, NULL, mxjson_resize);
+    mxbuf_create(&buffer, NULL, 0);
+
+    for (i = 0; i < MIN_REPEATS || total < MIN_TIME; i++) {
+        start = linear_now();
+        *valid = linear_run(op, &p, &buffer, json);
+        elapsed = linear_now() - start;
+        total += elapsed;
+        best = (i == 0) ? elapsed : min(best, elapsed);
+    }
+
+    mxbuf_free(&buffer);
+    mxjson_free(&p);
+
+    return best;
+}
+
+
+/**
+ * Get the exponent k of the best fit of time = c * size^k (a least squares
+ * fit of log(time) against log(size)). k is 1 for linear growth, and 2 for
+ * quadratic growth.
+ */
+static double
+linear_slope (const double *sizes, const double *times, size_t count)
+{
+    double mean_x = 0;
+    double mean_y = 0;
+    double sxx = 0;
+    double sxy = 0;
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        mean_x += log(sizes[i]) / count;
+        mean_y += log(times[i]) / count;
+    }
+
+    for (i = 0; i < count; i++) {
+        sxx += (log(sizes[i]) - mean_x) * (log(sizes[i]) - mean_x);
+        sxy += (log(sizes[i]) - mean_x) * (log(times[i]) - mean_y);
+    }
+
+    return sxy / sxx;
+}
+
+
+/**
+ * Write the adversarial documents, at the maximum size, to files in a
+ * directory.
+ */
+static bool
+linear_write_corpus (const char *dir, size_t size)
+{
+    char     path[4096];
+    mxbuf_t  data;
+    FILE    *f;
+    size_t   i;
+    bool     ok = true;
+
+    mxbuf_create(&data, NULL, 0);
+
+    for (i = 0; ok && i < mxarray_size(mxjson_corpus_adversarial); i++) {
+        mxbuf_reset(&data);
+        mxjson_corpus_adversarial[i].generate(&data, size);
+        (void)snprintf(path, sizeof(path), "%s/%s.json", dir,
+                       mxjson_corpus_adversarial[i].name);
+        f = fopen(path, "w");
+        ok = (f != NULL);
+
+        if (ok) {
+            ok = (fwrite(data.buf.ptr, 1, mxbuf_str(&data).len, f) ==
+                  mxbuf_str(&data).len);
+            ok = (fclose(f) == 0) && ok;
+        }
+
+        if (!ok) {
+            fprintf(stderr, "Could not write %s\n", path);
+        }
+    }
+
+    mxbuf_free(&data);
+
+    return ok;
+}
+
+
+/**
+ * Check that the time for each operation on an adversarial document grows
+ * linearly with the size of the document.
+ *
+ * @return
+ *   Indicates whether the document was parsed as expected, in linear time.
+ */
+static bool
+linear_check (const mxjson_corpus_adversarial_t *adv,
+              size_t                             max_size,
+              double                             max_slope)
+{
+    mxbuf_t     data[SIZE_COUNT];
+    double      sizes[SIZE_COUNT];
+    double      times[SIZE_COUNT];
+    double      slope;
+    linear_op_t op;
+    size_t      i;
+    bool        valid;
+    bool        expected = true;
+    bool        linear = true;
+
+    for (i = 0; i < SIZE_COUNT; i++) {
+        mxbuf_create(&data[i], NULL, 0);
+        adv->generate(&data[i], max_size >> (SIZE_COUNT - 1 - i));
+        sizes[i] = mxbuf_str(&data[i]).len;
+    }
+
+    for (op = 0; op < LINEAR_OP_COUNT; op++) {
+        printf("%-20s %-9s", adv->name, linear_op_names[op]);
+
+        for (i = 0; i < SIZE_COUNT; i++) {
+            times[i] = linear_time(op, mxbuf_str(&data[i]), &valid);
+            expected = expected && (valid == adv->valid);
+            printf(" %8.2f", times[i] * 1e9 / sizes[i]);
+        }
+
+        slope = linear_slope(sizes, times, SIZE_COUNT);
+        linear = linear && (slope <= max_slope);
+        printf(" %6.2f  %s\n", slope, (slope > max_slope) ? "SUPERLINEAR" :
+                                      !expected ? "UNEXPECTED RESULT" : "ok");
+    }
+
+    for (i = 0; i < SIZE_COUNT; i++) {
+        mxbuf_free(&data[i]);
+    }
+
+    return (expected && linear);
+}
+
+
+int main (int argc, char **argv)
+{
+    const char  *corpus_dir = NULL;
+    size_t       max_size = 8 << 20;
+    double       max_slope = 1.4;
+    size_t       i;
+    int          opt;
+    bool         ok = true;
+
+    while ((opt = getopt(argc, argv, "g:hs:x:")) != -1) {
+        switch (opt) {
+        case 'g':
+            corpus_dir = optarg;
+            break;
+
+        case 's':
+            max_size = strtoull(optarg, NULL, 0) << 10;
+            ok = ok && (max_size >> SIZE_COUNT) != 0;
+            break;
+
+        case 'x':
+            max_slope = atof(optarg);
+            break;
+
+        case 'h':
+        default:
+            ok = false;
+            break;
+        }
+    }
+
+    if (!ok || optind != argc) {
+        fprintf(stderr, "Usage: %s [OPTION...]\n\n"
+         "Check that the parse time grows linearly with the size of the\n"
+         "input, for each of the adversarial documents.\n\n"
+         "  -g <dir>    Write the adversarial documents (at the maximum\n"
+         "              size) to <dir> and exit\n"
+         "  -h          Display this usage information\n"
+         "  -s <kB>     Maximum document size (default %zu)\n"
+         "  -x <slope>  Maximum exponent k for time = c * size^k before\n"
+         "              the growth is reported as superlinear (default %.2f)\n"
+         "\n"
+         "Each document is timed at %d sizes, doubling up to the maximum\n"
+         "size. The exit status is non-zero if any growth is superlinear.\n\n",
+         argv[0], max_size >> 10, max_slope, SIZE_COUNT);
+        exit(1);
+    }
+
+    if (corpus_dir != NULL) {
+        return !linear_write_corpus(corpus_dir, max_size);
+    }
+
+    printf("%-20s %-9s", "document", "operation");
+
+    for (i = 0; i < SIZE_COUNT; i++) {
+        printf(" %7zuk", (max_size >> (SIZE_COUNT - 1 - i)) >> 10);
+    }
+
+    printf(" %6s\n", "slope");
+
+    for (i = 0; i < mxarray_size(mxjson_corpus_adversarial); i++) {
+        ok = linear_check(&mxjson_corpus_adversarial[i], max_size,
+                          max_slope) && ok;
+    }
+
+    return (!ok);
+}
@@ -12,6 +12,12 @@
 #include <unistd.h>
 #include <fcntl.h>
 
+/*
+ * Record token depths during parsing, as the depth is needed for every
+ * token displayed.
+ */
+#define MXJSON_DEPTH 1
+
 #include "mxstr.h"
 #include "mxjson.h"
 
@@ -63,9 +69,10 @@ read_file (int fd, mxbuf_t *buffer)
     } while (size > 0);
 
     /*
-     * Resize the buffer to the exact size of the data read.
+     * Zero fill the padding after the data read, so that the JSON can be
+     * parsed by mxjson_parse_padded().
      */
-    mxbuf_trim(buffer);
+    mxbuf_pad(buffer, MXJSON_PADDING);
 
     /*
      * If size < 0 an error occurred during the call to read.
@@ -193,7 +200,8 @@ static const char *json_types[MXJSON_COUNT] = {
     "number",
     "string",
     "object",
-    "array"
+    "array",
+    "raw"
 };
 
 
@@ -243,6 +251,7 @@ display_stats (mxjson_parser_t *p)
 
         case MXJSON_NUMBER:
         case MXJSON_STRING:
+        case MXJSON_RAW:
             size = token->str_size;
             stats->value_esc += token->value_esc;
             break;
@@ -281,28 +290,6 @@ display_stats (mxjson_parser_t *p)
 }
 
 
-/**
- * Calculate the depth of a token (how many nested object/array values
- * the token is inside).
- */
-static inline uint16_t
-token_depth (mxjson_parser_t *p, mxjson_idx_t idx)
-{
-    uint16_t        depth = 0;
-    mxjson_token_t *token;
-
-    assert(idx != MXJSON_IDX_NONE);
-
-    do {
-        depth++;
-        token = &p->tokens[idx];
-        idx = token->parent;
-    } while (idx != MXJSON_IDX_NONE);
-
-    return depth - 1;
-}
-
-
 /**
  * Structure to track a location within an object or array value
  */
@@ -393,7 +380,7 @@ display_tree (mxjson_parser_t *p,
 
     while (idx <= p->idx) {
         token = &p->tokens[idx];
-        depth = token_depth(p, idx);
+        depth = mxjson_depth(p, idx);
         loc[depth].index++;
         indent(loc, depth, false);
 
@@ -439,6 +426,7 @@ display_tree (mxjson_parser_t *p,
             break;
 
         case MXJSON_NUMBER:
+        case MXJSON_RAW:
             printf("%.*s", token->str_size, &p->json.ptr[token->str]);
             break;
         case MXJSON_STRING:
@@ -479,7 +467,7 @@ display_tree (mxjson_parser_t *p,
         if (idx <= p->idx) {
             token = &p->tokens[idx];
             parent = &p->tokens[token->parent];
-            depth = token_depth(p, idx);
+            depth = mxjson_depth(p, idx);
 
             /*
              * Handle the completion of the display for object/array
@@ -502,7 +490,7 @@ display_tree (mxjson_parser_t *p,
                 idx = parent->next;
                 token = &p->tokens[idx];
                 parent = &p->tokens[token->parent];
-                depth = token_depth(p, idx);
+                depth = mxjson_depth(p, idx);
             }
         }
 
@@ -606,7 +594,7 @@ int main (int argc, char **argv)
          * Parse the JSON input
          */
         json = mxbuf_str(&data);
-        ok = mxjson_parse(&p, json);
+        ok = mxjson_parse_padded(&p, json);
 
         if (p.idx >= p.count) {
             assert(!ok);
@@ -96,7 +96,6 @@ int main (int argc, char **argv)
 {
     void            *buf;
     size_t           size;
-    mxjson_parser_t  p;
     mxstr_t          json;
     bool             ok = false;
 
@@ -108,9 +107,11 @@ int main (int argc, char **argv)
         if (buf != NULL) {
             json = mxstr(buf, size);
 
-            mxjson_init(&p, 1024, NULL, mxjson_resize);
-            ok = mxjson_parse(&p, json);
-            mxjson_free(&p);
+            /*
+             * Only the validity of the JSON is needed, so the JSON is
+             * validated without producing tokens.
+             */
+            ok = mxjson_validate(json);
 
             unmap_file(buf, size);
         } else {
@@ -0,0 +1,543 @@
+/*
+ * ----------------------------------------------------------------------
+ * |\ /| mxjson-doc.h
+ * | X | Detached JSON Documents
+ * |/ \|
+ * ----------------------------------------------------------------------
+ */
+
+/* ----------------------------------------------------------------------
+ * Note
+ *
+ * The tokens produced by mxjson_parse() hold offsets into the input JSON,
+ * so the input must be kept for as long as the tokens are used. A detached
+ * document is a copy of a parsed value (and its descendants) which does
+ * not reference the input: the tokens are copied along with only the
+ * string bytes they reference (object member names, and string and number
+ * values), so the input may be freed as soon as the document has been
+ * created.
+ *
+ * A document is a single block of memory, with no pointers:
+ *
+ *   mxjson_doc_t
+ *   Token array, including the sentinel at index 0 (token_count + 1 tokens)
+ *   Text (text_len bytes)
+ *
+ * Tokens reference the text with offsets, and each other with indices, in
+ * the same way as the tokens in a parser context, so a document may be
+ * moved or copied with memcpy() (e.g. to a cache, or another thread). The
+ * value that was detached is the token at index 1 of the document. The
+ * document is read with the mxjson_doc_*() functions, or using a parser
+ * context attached to it with mxjson_attach().
+ *
+ * A document is never modified once it has been created, so any number of
+ * threads may read it at once without locking. Documents created by
+ * mxjson_detach() are reference counted (atomically), so a document can be
+ * handed to other threads (each taking a reference with mxjson_doc_ref()),
+ * and is freed when the last reference is released with
+ * mxjson_doc_unref(). The parser context that produced it may be reused
+ * straight away, and mxjson_detach(p, 1) gives a document of the whole
+ * parse result.
+ *
+ * Names and strings are copied with their quotes, and in their original
+ * (escaped) form, so mxjson_token_name(), mxjson_token_string() and
+ * mxjson_write() work as they do on the parse result. With MXJSON_SPAN,
+ * the span of an object or array is empty in a document (the punctuation
+ * and whitespace are not copied). With MXJSON_DEPTH, depths are relative
+ * to the detached value.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef MXJSON_DOC_H
+#define MXJSON_DOC_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mxjson.h"
+#include "mxstr.h"
+#include "mxutil.h"
+
+
+/**
+ * Header at the start of a detached document.
+ *
+ * The reference count is only used for documents created by
+ * mxjson_detach().
+ */
+typedef struct {
+    uint64_t     size;         /**< Size of the document, including header */
+    mxjson_idx_t token_count;  /**< Number of tokens (excluding sentinel) */
+    uint32_t     text_len;     /**< Length of the text */
+    atomic_uint  refs;         /**< Number of references to the document */
+    uint32_t     reserved;     /**< Set to 0 */
+} mxjson_doc_t;
+
+
+/*
+ * ----------------------------------------------------------------------
+ * Internal Implementation
+ * ----------------------------------------------------------------------
+ */
+
+/**
+ * \internal
+ * Get the token array of a document.
+ */
+static inline mxjson_token_t *
+mxjson_doc_tokens (const mxjson_doc_t *doc)
+{
+    return (mxjson_token_t *)&doc[1];
+}
+
+
+/**
+ * \internal
+ * Get the text of a document.
+ */
+static inline char *
+mxjson_doc_text (const mxjson_doc_t *doc)
+{
+    return (char *)&mxjson_doc_tokens(doc)[doc->token_count + 1];
+}
+
+
+/**
+ * \internal
+ * Append a string to the text of a document being built.
+ *
+ * @param[in] text
+ *   The text of the document, or NULL if the size of the text is being
+ *   calculated.
+ *
+ * @param[in,out] len
+ *   The length of the text, which is updated.
+ *
+ * @return
+ *   The offset of the string in the text.
+ */
+static inline uint32_t
+mxjson_doc_append (char *text, uint32_t *len, const void *str, size_t size)
+{
+    uint32_t offset = *len;
+
+    if (text != NULL) {
+        memcpy(&text[offset], str, size);
+    }
+    *len += size;
+
+    return offset;
+}
+
+
+/**
+ * \internal
+ * Copy the tokens for a value and its descendants to a document, along
+ * with the text they reference, or calculate the size of the text.
+ *
+ * @param[in] doc
+ *   The document to populate (with token_count set), or NULL to calculate
+ *   the size of the text only.
+ *
+ * @return
+ *   The length of the text.
+ */
+static inline uint32_t
+mxjson_doc_build (mxjson_parser_t *p, mxjson_idx_t idx, mxjson_doc_t *doc)
+{
+    const unsigned char *json = p->json.ptr;
+    mxjson_token_t      *tokens = NULL;
+    mxjson_token_t      *token;
+    mxjson_token_t       t;
+    mxjson_idx_t         end;
+    mxjson_idx_t         i;
+    uint32_t             len = 0;
+    char                *text = NULL;
+
+    end = mxjson_next(p, idx);
+
+    if (doc != NULL) {
+        tokens = mxjson_doc_tokens(doc);
+        text = mxjson_doc_text(doc);
+        memset(&tokens[0], 0, sizeof(tokens[0]));
+    }
+
+    for (i = idx; i != end; i++) {
+        token = &p->tokens[i];
+        t = *token;
+
+        /*
+         * The quotes are copied with names and strings, as mxjson_write()
+         * copies them from the text.
+         */
+        if (token->name != 0) {
+            t.name = mxjson_doc_append(text, &len, &json[token->name - 1],
+                                       (size_t)token->name_size + 2) + 1;
+        }
+
+        switch (token->value_type) {
+        case MXJSON_STRING:
+            t.str = mxjson_doc_append(text, &len, &json[token->str - 1],
+                                      (size_t)token->str_size + 2) + 1;
+#if MXJSON_SPAN
+            t.raw = t.str - 1;
+#endif
+            break;
+
+        case MXJSON_NUMBER:
+        case MXJSON_RAW:
+            t.str = mxjson_doc_append(text, &len, &json[token->str],
+                                      token->str_size);
+#if MXJSON_SPAN
+            t.raw = t.str;
+#endif
+            break;
+
+        case MXJSON_OBJECT:
+        case MXJSON_ARRAY:
+            t.next = token->next - idx + 1;
+#if MXJSON_SPAN
+            t.raw = 0;
+            t.raw_size = 0;
+#endif
+            break;
+
+        default:
+#if MXJSON_SPAN
+            t.raw = mxjson_doc_append(text, &len, &json[token->raw],
+                                      token->raw_size);
+#endif
+            break;
+        }
+
+        t.parent = (i == idx) ? MXJSON_IDX_NONE : token->parent - idx + 1;
+#if MXJSON_DEPTH
+        t.depth = token->depth - p->tokens[idx].depth;
+#endif
+
+        if (tokens != NULL) {
+            tokens[i - idx + 1] = t;
+        }
+    }
+
+    return len;
+}
+
+
+/**
+ * \internal
+ * Populate a document of the size given by mxjson_doc_size().
+ */
+static inline void
+mxjson_doc_fill (mxjson_parser_t *p,
+                 mxjson_idx_t     idx,
+                 mxjson_doc_t    *doc,
+                 size_t           size)
+{
+    doc->size = size;
+    doc->token_count = mxjson_next(p, idx) - idx;
+    atomic_init(&doc->refs, 1);
+    doc->reserved = 0;
+    doc->text_len = mxjson_doc_build(p, idx, doc);
+}
+
+
+/*
+ * ----------------------------------------------------------------------
+ * External API
+ * ----------------------------------------------------------------------
+ */
+
+/**
+ * Get the size of the document that mxjson_detach_to() creates for a value.
+ *
+ * @param[in] p
+ *   The parser context, containing the result of a successful call to
+ *   mxjson_parse().
+ *
+ * @param[in] idx
+ *   The index for the token to detach.
+ *
+ * @return
+ *   The size of the document, or 0 if the tokens have been reordered by
+ *   mxjson_breadth_first() (a document can't be created from them).
+ */
+static inline size_t
+mxjson_doc_size (mxjson_parser_t *p, mxjson_idx_t idx)
+{
+    size_t size = 0;
+
+    if (!p->breadth) {
+        size = (sizeof(mxjson_doc_t) +
+                ((size_t)mxjson_next(p, idx) - idx + 1) *
+                sizeof(mxjson_token_t) +
+                mxjson_doc_build(p, idx, NULL));
+    }
+
+    return size;
+}
+
+
+/**
+ * Detach a parsed value and its descendants from the input JSON, into a
+ * caller supplied block of memory.
+ *
+ * @param[in] p
+ *   The parser context, containing the result of a successful call to
+ *   mxjson_parse().
+ *
+ * @param[in] idx
+ *   The index for the token to detach.
+ *
+ * @param[out] doc
+ *   The memory for the document, which must be aligned for
+ *   mxjson_token_t.
+ *
+ * @param[in] size
+ *   The size of the memory for the document. At least mxjson_doc_size() is
+ *   required.
+ *
+ * @return
+ *   Indicates whether the document was created. false is returned if the
+ *   memory is too small, or the tokens have been reordered by
+ *   mxjson_breadth_first().
+ */
+static inline bool
+mxjson_detach_to (mxjson_parser_t *p,
+                  mxjson_idx_t     idx,
+                  mxjson_doc_t    *doc,
+                  size_t           size)
+{
+    size_t required;
+    bool   ok;
+
+    required = mxjson_doc_size(p, idx);
+    ok = (required != 0 && size >= required);
+
+    if (ok) {
+        mxjson_doc_fill(p, idx, doc, required);
+    }
+
+    return ok;
+}
+
+
+/**
+ * Detach a parsed value and its descendants from the input JSON.
+ *
+ * For example, to keep part of a large message once the message buffer has
+ * been released:
+ *
+ *     mxjson_doc_t    *doc;
+ *     mxjson_parser_t  view;
+ *
+ *     doc = mxjson_detach(&p, idx);
+ *     // The input JSON and p may be freed or reused
+ *
+ *     mxjson_attach(&view, doc);
+ *     // Use view with mxjson_first, mxjson_next, mxjson_token_string etc.
+ *     mxjson_doc_unref(doc);
+ *
+ * @param[in] p
+ *   The parser context, containing the result of a successful call to
+ *   mxjson_parse().
+ *
+ * @param[in] idx
+ *   The index for the token to detach.
+ *
+ * @return
+ *   The document, with a reference count of 1. It is freed when the last
+ *   reference is released with mxjson_doc_unref(). NULL is returned if the
+ *   tokens have been reordered by mxjson_breadth_first().
+ */
+static inline mxjson_doc_t *
+mxjson_detach (mxjson_parser_t *p, mxjson_idx_t idx)
+{
+    mxjson_doc_t *doc = NULL;
+    size_t        size;
+
+    size = mxjson_doc_size(p, idx);
+
+    if (size != 0) {
+        doc = mxutil_malloc(size);
+        mxjson_doc_fill(p, idx, doc, size);
+    }
+
+    return doc;
+}
+
+
+/**
+ * Take a reference to a document created by mxjson_detach().
+ *
+ * May be called from any thread holding a reference, e.g. before passing
+ * the document to another thread.
+ *
+ * @param[in] doc
+ *   The document.
+ *
+ * @return
+ *   The document.
+ */
+static inline const mxjson_doc_t *
+mxjson_doc_ref (const mxjson_doc_t *doc)
+{
+    mxjson_doc_t *d = (mxjson_doc_t *)doc;
+
+    (void)atomic_fetch_add_explicit(&d->refs, 1, memory_order_relaxed);
+
+    return doc;
+}
+
+
+/**
+ * Release a reference to a document created by mxjson_detach(), freeing
+ * the document when the last reference is released.
+ *
+ * @param[in] doc
+ *   The document.
+ */
+static inline void
+mxjson_doc_unref (const mxjson_doc_t *doc)
+{
+    mxjson_doc_t *d = (mxjson_doc_t *)doc;
+
+    /*
+     * The release ordering makes each thread's reads of the document happen
+     * before the decrement, and the acquire ordering makes them happen
+     * before the free by the thread releasing the last reference.
+     */
+    if (atomic_fetch_sub_explicit(&d->refs, 1, memory_order_acq_rel) == 1) {
+        free(d);
+    }
+}
+
+
+/**
+ * Get a token of a document.
+ *
+ * @param[in] doc
+ *   The document.
+ *
+ * @param[in] idx
+ *   The index of the token, from 1 to doc->token_count.
+ *
+ * @return
+ *   The token.
+ */
+static inline const mxjson_token_t *
+mxjson_doc_token (const mxjson_doc_t *doc, mxjson_idx_t idx)
+{
+    return &mxjson_doc_tokens(doc)[idx];
+}
+
+
+/**
+ * Get the first child of a token of a document. See mxjson_first().
+ */
+static inline mxjson_idx_t
+mxjson_doc_first (const mxjson_doc_t *doc, mxjson_idx_t idx)
+{
+    UNUSED(doc);
+
+    return idx + 1;
+}
+
+
+/**
+ * Get the next token after a token of a document and its descendants. See
+ * mxjson_next().
+ */
+static inline mxjson_idx_t
+mxjson_doc_next (const mxjson_doc_t *doc, mxjson_idx_t idx)
+{
+    return mxjson_next_of(mxjson_doc_tokens(doc), idx);
+}
+
+
+/**
+ * Get the name of a token of a document, unescaping it if necessary. See
+ * mxjson_token_name().
+ */
+static inline mxstr_t
+mxjson_doc_name (const mxjson_doc_t *doc,
+                 mxjson_idx_t        idx,
+                 mxbuf_t            *buffer,
+                 bool               *valid)
+{
+    return mxjson_name_of(mxstr(mxjson_doc_text(doc), doc->text_len),
+                          mxjson_doc_token(doc, idx), buffer, valid);
+}
+
+
+/**
+ * Get a string representation of the value of a token of a document,
+ * unescaping it if necessary. See mxjson_token_string().
+ */
+static inline mxstr_t
+mxjson_doc_string (const mxjson_doc_t *doc,
+                   mxjson_idx_t        idx,
+                   mxbuf_t            *buffer,
+                   bool               *valid)
+{
+    return mxjson_string_of(mxstr(mxjson_doc_text(doc), doc->text_len),
+                            mxjson_doc_token(doc, idx), buffer, valid);
+}
+
+
+#if MXJSON_SPAN
+/**
+ * Get the span of the value of a token of a document. See
+ * mxjson_token_raw(). The span of an object or array is empty.
+ */
+static inline mxstr_t
+mxjson_doc_raw (const mxjson_doc_t *doc, mxjson_idx_t idx)
+{
+    const mxjson_token_t *token = mxjson_doc_token(doc, idx);
+
+    return mxstr(&mxjson_doc_text(doc)[token->raw], token->raw_size);
+}
+#endif
+
+
+/**
+ * Get the nesting depth of a token of a document, relative to the token at
+ * index 1. See mxjson_depth().
+ */
+static inline uint32_t
+mxjson_doc_depth (const mxjson_doc_t *doc, mxjson_idx_t idx)
+{
+    return mxjson_depth_of(mxjson_doc_tokens(doc), idx);
+}
+
+
+/**
+ * Attach a parser context to a document, to read it.
+ *
+ * The parser context may be used with the navigation and interpretation
+ * APIs (mxjson_first(), mxjson_next(), mxjson_token_name() etc.), but must
+ * not be passed to mxjson_parse(). The document is read-only, and must
+ * remain valid (at the same address) while the parser context is used. It
+ * is not necessary to call mxjson_free() for the parser context.
+ *
+ * @param[out] p
+ *   The parser context to attach.
+ *
+ * @param[in] doc
+ *   The document.
+ */
+static inline void
+mxjson_attach (mxjson_parser_t *p, const mxjson_doc_t *doc)
+{
+    mxjson_init(p, 0, NULL, NULL);
+    p->json = mxstr(mxjson_doc_text(doc), doc->text_len);
+    mxstr_substr(p->json, doc->text_len, doc->text_len, &p->unparsed);
+    p->tokens = mxjson_doc_tokens(doc);
+    p->idx = doc->token_count;
+    p->count = doc->token_count + 1;
+}
+
+
+#endif
@@ -0,0 +1,596 @@
+/*
+ * ----------------------------------------------------------------------
+ * |\ /| mxjson-par.h
+ * | X | Parallel Traversal
+ * |/ \|
+ * ----------------------------------------------------------------------
+ */
+
+/* ----------------------------------------------------------------------
+ * Note
+ *
+ * The children of an object or array can only be reached in order, by
+ * following the mxjson_next() chain. To process the children of a large
+ * array on several threads, the indices of the children are first
+ * collected with one pass along the chain, then divided into ranges which
+ * are processed by a pool of threads, with a callback for each child.
+ *
+ * Each thread starts with an equal share of the children, and takes them
+ * from the front of its range in small batches. A thread that runs out of
+ * work steals the back half of the largest remaining range, so an uneven
+ * cost per child (e.g. objects of very different sizes) is balanced
+ * between the threads.
+ *
+ * The parser context is only read, so it must not be changed (e.g. by
+ * mxjson_parse()) while a traversal is running. A detached document (see
+ * mxjson-doc.h) may be traversed using a parser context attached to it.
+ *
+ * This API requires POSIX threads.
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef MXJSON_PAR_H
+#define MXJSON_PAR_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mxjson.h"
+#include "mxutil.h"
+
+
+/**
+ * Maximum number of children a thread takes from its range at once.
+ */
+#define MXJSON_PAR_BATCH 256
+
+
+/**
+ * Alignment for per-thread data, to avoid false sharing between threads.
+ */
+#define MXJSON_PAR_ALIGN 64
+
+
+/**
+ * Callback to process a child of an object or array.
+ *
+ * @param[in] ctx
+ *   The context passed to mxjson_par_foreach() or mxjson_par_reduce().
+ *
+ * @param[in] acc
+ *   The accumulator for the calling thread, or NULL for
+ *   mxjson_par_foreach().
+ *
+ * @param[in] p
+ *   The parser context.
+ *
+ * @param[in] idx
+ *   The index of the child token.
+ *
+ * @param[in] n
+ *   The position of the child in the object or array (0 for the first
+ *   child).
+ */
+typedef void (*mxjson_par_cb)(void            *ctx,
+                              void            *acc,
+                              mxjson_parser_t *p,
+                              mxjson_idx_t     idx,
+                              size_t           n);
+
+
+/**
+ * Callback to combine the accumulator of a thread into the result of
+ * mxjson_par_reduce().
+ */
+typedef void (*mxjson_par_combine_cb)(void *ctx, void *result, const void *acc);
+
+
+/**
+ * \internal
+ * A range of children waiting to be processed by a thread.
+ */
+typedef struct {
+    _Alignas(MXJSON_PAR_ALIGN)
+    pthread_mutex_t lock;   /**< Protects begin and end */
+    size_t          begin;  /**< First child in the range */
+    size_t          end;    /**< End of the range */
+} mxjson_par_range_t;
+
+
+/**
+ * \internal
+ * A traversal being run by a pool.
+ */
+typedef struct {
+    mxjson_parser_t     *p;        /**< The parser context */
+    const mxjson_idx_t  *children; /**< Indices of the children */
+    size_t               count;    /**< Number of children */
+    size_t               batch;    /**< Children to take at once */
+    mxjson_par_cb        fn;       /**< Callback for each child */
+    void                *ctx;      /**< Context for the callback */
+    unsigned char       *accs;     /**< Accumulators, or NULL */
+    size_t               stride;   /**< Distance between accumulators */
+    mxjson_par_range_t  *ranges;   /**< Range for each thread */
+} mxjson_par_job_t;
+
+
+/**
+ * A pool of threads to run traversals.
+ *
+ * The threads are created once by mxjson_pool_init(), and wait for work
+ * between traversals. The thread calling mxjson_par_foreach() or
+ * mxjson_par_reduce() takes part in the traversal, so a pool of N threads
+ * has N - 1 worker threads.
+ */
+typedef struct {
+    unsigned int        threads;    /**< Number of threads, including caller */
+    pthread_t          *workers;    /**< Worker threads */
+    pthread_mutex_t     lock;       /**< Protects the fields below */
+    pthread_cond_t      start;      /**< Signalled when a job is posted */
+    pthread_cond_t      done;       /**< Signalled when a job completes */
+    uint64_t            generation; /**< Incremented for each job */
+    unsigned int        active;     /**< Workers still running the job */
+    bool                stop;       /**< Set to stop the workers */
+    mxjson_par_job_t   *job;        /**< The current job */
+    mxjson_par_range_t *ranges;     /**< Range for each thread */
+} mxjson_pool_t;
+
+
+/*
+ * ----------------------------------------------------------------------
+ * Internal Implementation
+ * ----------------------------------------------------------------------
+ */
+
+/**
+ * \internal
+ * Take the next batch of children from a range.
+ *
+ * @return
+ *   Indicates whether any children were taken.
+ */
+static inline bool
+mxjson_par_take (mxjson_par_range_t *range,
+                 size_t              batch,
+                 size_t             *begin,
+                 size_t             *end)
+{
+    bool ok;
+
+    (void)pthread_mutex_lock(&range->lock);
+    *begin = range->begin;
+    *end = min(range->begin + batch, range->end);
+    range->begin = *end;
+    ok = (*begin < *end);
+    (void)pthread_mutex_unlock(&range->lock);
+
+    return ok;
+}
+
+
+/**
+ * \internal
+ * Steal the back half of the largest remaining range of another thread,
+ * into the (empty) range of the calling thread.
+ *
+ * The steal is repeated if the victim's range is emptied between choosing
+ * it and locking it to steal from it.
+ *
+ * @return
+ *   Indicates whether any children were stolen. false is returned once all
+ *   the ranges are empty.
+ */
+static inline bool
+mxjson_par_steal (mxjson_par_job_t *job, unsigned int self, unsigned int n)
+{
+    mxjson_par_range_t *range;
+    mxjson_par_range_t *victim;
+    size_t              best;
+    size_t              remaining;
+    size_t              mid = 0;
+    size_t              end = 0;
+    unsigned int        i;
+    bool                ok = false;
+
+    do {
+        victim = NULL;
+        best = 0;
+
+        for (i = 0; i < n; i++) {
+            range = &job->ranges[i];
+            (void)pthread_mutex_lock(&range->lock);
+            remaining = range->end - range->begin;
+            (void)pthread_mutex_unlock(&range->lock);
+
+            if (i != self && remaining > best) {
+                victim = range;
+                best = remaining;
+            }
+        }
+
+        if (victim != NULL) {
+            (void)pthread_mutex_lock(&victim->lock);
+
+            if (victim->begin < victim->end) {
+                mid = victim->begin + (victim->end - victim->begin) / 2;
+                end = victim->end;
+                victim->end = mid;
+                ok = true;
+            }
+
+            (void)pthread_mutex_unlock(&victim->lock);
+        }
+    } while (!ok && victim != NULL);
+
+    if (ok) {
+        (void)pthread_mutex_lock(&job->ranges[self].lock);
+        job->ranges[self].begin = mid;
+        job->ranges[self].end = end;
+        (void)pthread_mutex_unlock(&job->ranges[self].lock);
+    }
+
+    return ok;
+}
+
+
+/**
+ * \internal
+ * Process children until none are left, as thread number self of n.
+ */
+static inline void
+mxjson_par_run (mxjson_par_job_t *job, unsigned int self, unsigned int n)
+{
+    void   *acc = NULL;
+    size_t  begin;
+    size_t  end;
+    size_t  i;
+
+    if (job->accs != NULL) {
+        acc = &job->accs[self * job->stride];
+    }
+
+    do {
+        while (mxjson_par_take(&job->ranges[self], job->batch, &begin,
+                               &end)) {
+            for (i = begin; i < end; i++) {
+                job->fn(job->ctx, acc, job->p, job->children[i], i);
+            }
+        }
+    } while (mxjson_par_steal(job, self, n));
+}
+
+
+/**
+ * \internal
+ * Worker thread of a pool, which runs each job that is posted.
+ */
+static inline void *
+mxjson_par_worker (void *arg)
+{
+    mxjson_pool_t    *pool = arg;
+    mxjson_par_job_t *job;
+    uint64_t          generation = 0;
+    unsigned int      threads;
+    unsigned int      self;
+
+    (void)pthread_mutex_lock(&pool->lock);
+
+    /*
+     * The worker number is assigned in the order the workers start. The
+     * caller is thread 0.
+     */
+    self = ++pool->active;
+    (void)pthread_cond_signal(&pool->done);
+
+    while (!pool->stop) {
+        if (pool->generation != generation) {
+            generation = pool->generation;
+            job = pool->job;
+            threads = pool->threads;
+            (void)pthread_mutex_unlock(&pool->lock);
+            mxjson_par_run(job, self, threads);
+            (void)pthread_mutex_lock(&pool->lock);
+
+            if (--pool->active == 0) {
+                (void)pthread_cond_signal(&pool->done);
+            }
+        } else {
+            (void)pthread_cond_wait(&pool->start, &pool->lock);
+        }
+    }
+
+    (void)pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+
+/**
+ * \internal
+ * Run a traversal on the pool, and wait for it to complete.
+ */
+static inline void
+mxjson_par_job (mxjson_pool_t *pool, mxjson_par_job_t *job)
+{
+    size_t       share;
+    unsigned int i;
+
+    /*
+     * Each thread starts with an equal share of the children, and the
+     * batches are small enough for there to be several per thread, so that
+     * the threads finish together.
+     */
+    share = job->count / pool->threads;
+    job->batch = max(min(share / 8, MXJSON_PAR_BATCH), 1);
+    job->ranges = pool->ranges;
+
+    for (i = 0; i < pool->threads; i++) {
+        pool->ranges[i].begin = i * share;
+        pool->ranges[i].end = (i == pool->threads - 1) ? job->count :
+                                                         (i + 1) * share;
+    }
+
+    (void)pthread_mutex_lock(&pool->lock);
+    pool->job = job;
+    pool->active = pool->threads - 1;
+    pool->generation++;
+    (void)pthread_cond_broadcast(&pool->start);
+    (void)pthread_mutex_unlock(&pool->lock);
+
+    mxjson_par_run(job, 0, pool->threads);
+
+    (void)pthread_mutex_lock(&pool->lock);
+
+    while (pool->active != 0) {
+        (void)pthread_cond_wait(&pool->done, &pool->lock);
+    }
+
+    pool->job = NULL;
+    (void)pthread_mutex_unlock(&pool->lock);
+}
+
+
+/*
+ * ----------------------------------------------------------------------
+ * External API
+ * ----------------------------------------------------------------------
+ */
+
+/**
+ * Create a pool of threads for parallel traversals.
+ *
+ * @param[out] pool
+ *   The pool to initialise. mxjson_pool_free() must be called once the
+ *   pool is no longer required.
+ *
+ * @param[in] threads
+ *   The number of threads to use for each traversal, including the calling
+ *   thread (typically the number of CPUs). 1 processes all the children on
+ *   the calling thread.
+ *
+ * @return
+ *   Indicates whether the threads were created.
+ */
+static inline bool
+mxjson_pool_init (mxjson_pool_t *pool, unsigned int threads)
+{
+    unsigned int created = 0;
+    unsigned int i;
+    bool         ok = true;
+
+    memset(pool, 0, sizeof(*pool));
+    pool->threads = max(threads, 1);
+    pool->workers = mxutil_calloc(pool->threads * sizeof(*pool->workers));
+    pool->ranges = aligned_alloc(MXJSON_PAR_ALIGN,
+                                 pool->threads * sizeof(*pool->ranges));
+    assert(pool->ranges != NULL);
+    (void)pthread_mutex_init(&pool->lock, NULL);
+    (void)pthread_cond_init(&pool->start, NULL);
+    (void)pthread_cond_init(&pool->done, NULL);
+
+    for (i = 0; i < pool->threads; i++) {
+        (void)pthread_mutex_init(&pool->ranges[i].lock, NULL);
+    }
+
+    while (ok && created + 1 < pool->threads) {
+        ok = (pthread_create(&pool->workers[created + 1], NULL,
+                             mxjson_par_worker, pool) == 0);
+        created += ok;
+    }
+
+    /*
+     * Wait for the workers to start, so that each has its worker number
+     * before the first job is posted. If a thread could not be created,
+     * the pool is usable with the threads that were.
+     */
+    (void)pthread_mutex_lock(&pool->lock);
+
+    while (pool->active != created) {
+        (void)pthread_cond_wait(&pool->done, &pool->lock);
+    }
+
+    pool->active = 0;
+    pool->threads = created + 1;
+    (void)pthread_mutex_unlock(&pool->lock);
+
+    return ok;
+}
+
+
+/**
+ * Stop the threads of a pool, and free its resources.
+ *
+ * @param[in] pool
+ *   The pool to free.
+ */
+static inline void
+mxjson_pool_free (mxjson_pool_t *pool)
+{
+    unsigned int i;
+
+    (void)pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    (void)pthread_cond_broadcast(&pool->start);
+    (void)pthread_mutex_unlock(&pool->lock);
+
+    for (i = 1; i < pool->threads; i++) {
+        (void)pthread_join(pool->workers[i], NULL);
+    }
+
+    for (i = 0; i < pool->threads; i++) {
+        (void)pthread_mutex_destroy(&pool->ranges[i].lock);
+    }
+
+    (void)pthread_cond_destroy(&pool->done);
+    (void)pthread_cond_destroy(&pool->start);
+    (void)pthread_mutex_destroy(&pool->lock);
+    free(pool->ranges);
+    free(pool->workers);
+    memset(pool, 0, sizeof(*pool));
+}
+
+
+/**
+ * Process the children of an object or array in parallel, and combine the
+ * results from each thread.
+ *
+ * Each thread has its own accumulator, which is passed to the callback for
+ * each child that the thread processes, so the callback can update it
+ * without synchronisation. The accumulators start as copies of result
+ * (which should be the identity for the combine operation, e.g. a sum of
+ * 0), and are combined into result in thread order once all the children
+ * have been processed.
+ *
+ * For example, to sum the numbers in a large array:
+ *
+ *     static void
+ *     sum_child (void *ctx, void *acc, mxjson_parser_t *p,
+ *                mxjson_idx_t idx, size_t n)
+ *     {
+ *         *(double *)acc += strtod(...p->tokens[idx]...);
+ *     }
+ *
+ *     static void
+ *     sum_combine (void *ctx, void *result, const void *acc)
+ *     {
+ *         *(double *)result += *(const double *)acc;
+ *     }
+ *
+ *     double sum = 0;
+ *
+ *     mxjson_par_reduce(&pool, &p, array_idx, sum_child, NULL, &sum,
+ *                       sizeof(sum), sum_combine);
+ *
+ * @param[in] pool
+ *   The thread pool. A pool may only run one traversal at a time.
+ *
+ * @param[in] p
+ *   The parser context.
+ *
+ * @param[in] idx
+ *   The index of the object or array token.
+ *
+ * @param[in] fn
+ *   Callback for each child. The callback is called concurrently from the
+ *   threads of the pool, in no particular order.
+ *
+ * @param[in] ctx
+ *   Context passed to the callbacks.
+ *
+ * @param[in,out] result
+ *   The initial value of each accumulator, updated with the combined
+ *   result.
+ *
+ * @param[in] acc_size
+ *   The size of the result and of each accumulator.
+ *
+ * @param[in] combine
+ *   Callback to combine an accumulator into the result.
+ */
+static inline void
+mxjson_par_reduce (mxjson_pool_t         *pool,
+                   mxjson_parser_t       *p,
+                   mxjson_idx_t           idx,
+                   mxjson_par_cb          fn,
+                   void                  *ctx,
+                   void                  *result,
+                   size_t                 acc_size,
+                   mxjson_par_combine_cb  combine)
+{
+    mxjson_par_job_t  job;
+    mxjson_idx_t     *children;
+    unsigned int      i;
+
+    children = mxutil_malloc(max(p->tokens[idx].children, 1) *
+                             sizeof(*children));
+
+    memset(&job, 0, sizeof(job));
+    job.p = p;
+    job.children = children;
+    job.count = mxjson_children(p, idx, children);
+    job.fn = fn;
+    job.ctx = ctx;
+
+    if (result != NULL) {
+        /*
+         * Each accumulator is in its own cache lines.
+         */
+        job.stride = (acc_size + MXJSON_PAR_ALIGN - 1) &
+                     ~(size_t)(MXJSON_PAR_ALIGN - 1);
+        job.stride = max(job.stride, MXJSON_PAR_ALIGN);
+        job.accs = aligned_alloc(MXJSON_PAR_ALIGN, job.stride * pool->threads);
+        assert(job.accs != NULL);
+
+        for (i = 0; i < pool->threads; i++) {
+            memcpy(&job.accs[i * job.stride], result, acc_size);
+        }
+    }
+
+    mxjson_par_job(pool, &job);
+
+    if (result != NULL) {
+        for (i = 0; i < pool->threads; i++) {
+            combine(ctx, result, &job.accs[i * job.stride]);
+        }
+    }
+
+    free(job.accs);
+    free(children);
+}
+
+
+/**
+ * Process the children of an object or array in parallel.
+ *
+ * As mxjson_par_reduce(), without accumulators (the callback is passed
+ * NULL for acc).
+ *
+ * @param[in] pool
+ *   The thread pool.
+ *
+ * @param[in] p
+ *   The parser context.
+ *
+ * @param[in] idx
+ *   The index of the object or array token.
+ *
+ * @param[in] fn
+ *   Callback for each child.
+ *
+ * @param[in] ctx
+ *   Context passed to the callbacks.
+ */
+static inline void
+mxjson_par_foreach (mxjson_pool_t   *pool,
+                    mxjson_parser_t *p,
+                    mxjson_idx_t     idx,
+                    mxjson_par_cb    fn,
+                    void            *ctx)
+{
+    mxjson_par_reduce(pool, p, idx, fn, ctx, NULL, 0, NULL);
+}
+
+
+#endif
@@ -0,0 +1,542 @@
+/*
+ * ----------------------------------------------------------------------
+ * |\ /| mxjson-tape.h
+ * | X | Persisted JSON Token Tape
+ * |/ \|
+ * ----------------------------------------------------------------------
+ */
+
+/* ----------------------------------------------------------------------
+ * Note
+ *
+ * A tape file stores the input JSON and the token array produced by
+ * mxjson_parse() in a single file. The file is mapped into memory when it
+ * is opened, and the parser context in the tape references the mapped
+ * memory directly, so a large JSON input is available without parsing or
+ * copying it.
+ *
+ * File layout (native byte order, the tokens are 8-byte aligned):
+ *
+ *   mxjson_tape_header_t
+ *   JSON input (json_len bytes)
+ *   Padding
+ *   Token array, including the sentinel at index 0 (token_count + 1 tokens)
+ *
+ * This API requires POSIX file I/O and mmap().
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef MXJSON_TAPE_H
+#define MXJSON_TAPE_H
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "mxjson.h"
+#include "mxstr.h"
+#include "mxutil.h"
+
+
+/**
+ * Magic value at the start of a tape file.
+ */
+#define MXJSON_TAPE_MAGIC "MXJTAPE"
+
+
+/**
+ * Version of the tape file format.
+ */
+#define MXJSON_TAPE_VERSION 1
+
+
+/**
+ * Bitmask of the compile time options that affect the token layout. A tape
+ * can only be opened by code built with the same options as the code that
+ * saved it.
+ */
+#define MXJSON_TAPE_OPTIONS ((MXJSON_SPAN ? 0x1 : 0) | \
+                             (MXJSON_DEPTH ? 0x2 : 0))
+
+
+/**
+ * Value used to detect a tape written on a host with a different byte
+ * order.
+ */
+#define MXJSON_TAPE_BYTE_ORDER 0x01020304
+
+
+/**
+ * Header at the start of a tape file.
+ */
+typedef struct {
+    char         magic[8];     /**< MXJSON_TAPE_MAGIC */
+    uint32_t     version;      /**< MXJSON_TAPE_VERSION */
+    uint32_t     byte_order;   /**< MXJSON_TAPE_BYTE_ORDER */
+    uint32_t     options;      /**< MXJSON_TAPE_OPTIONS */
+    uint32_t     token_size;   /**< sizeof(mxjson_token_t) */
+    mxjson_idx_t token_count;  /**< Number of tokens (excluding sentinel) */
+    uint32_t     reserved;     /**< Set to 0 */
+    uint64_t     json_len;     /**< Length of the JSON input */
+    uint64_t     tokens_start; /**< File offset for the token array */
+    uint64_t     source_hash;  /**< Hash of the JSON input */
+    uint64_t     checksum;     /**< Hash of the file contents after header */
+} mxjson_tape_header_t;
+
+
+/**
+ * An open tape file.
+ *
+ * Once opened, the parser field is a parser context containing the result
+ * of parsing the JSON input. It may be used with the navigation and
+ * interpretation APIs (mxjson_first(), mxjson_next(), mxjson_token_name()
+ * etc.), but must not be passed to mxjson_parse(). The tokens and JSON input
+ * are read-only, and remain valid until mxjson_tape_close() is called.
+ */
+typedef struct {
+    mxjson_parser_t  parser;      /**< Parse result referencing the tape */
+    uint64_t         source_hash; /**< Hash of the JSON input */
+    void            *map;         /**< Mapped tape file */
+    size_t           map_size;    /**< Size of the mapped tape file */
+} mxjson_tape_t;
+
+
+/*
+ * ----------------------------------------------------------------------
+ * Internal Implementation
+ * ----------------------------------------------------------------------
+ */
+
+/**
+ * \internal
+ * Rotate a 64-bit value left.
+ */
+static inline uint64_t
+mxjson_tape_rotl (uint64_t v, unsigned int n)
+{
+    return (v << n) | (v >> (64 - n));
+}
+
+
+/**
+ * \internal
+ * Offset of the token array in a tape file with a JSON input of the
+ * specified length.
+ */
+static inline uint64_t
+mxjson_tape_tokens_start (uint64_t json_len)
+{
+    return (sizeof(mxjson_tape_header_t) + json_len + 7) & ~(uint64_t)7;
+}
+
+
+/**
+ * \internal
+ * Map a file into memory as read-only, followed by zero filled padding.
+ *
+ * The address space for the file and the padding is reserved with an
+ * anonymous mapping, which the file is then mapped over. The end of the
+ * last page of the file reads as zero, as do the anonymous pages after it,
+ * so the padding is available without copying the file. This provides the
+ * padding required by mxjson_parse_padded() (padding = MXJSON_PADDING).
+ * The mapping (size + padding bytes) is released with munmap().
+ *
+ * @return
+ *   Pointer to the mapped file, or NULL if the file could not be mapped
+ *   (or is empty).
+ */
+static inline void *
+mxjson_tape_map (const char *path, size_t *size, size_t padding)
+{
+    struct stat  sb;
+    void        *map = NULL;
+    void        *reserve;
+    int          fd;
+
+    fd = open(path, O_RDONLY);
+
+    if (fd != -1) {
+        if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_size != 0) {
+            *size = sb.st_size;
+            reserve = mmap(NULL, *size + padding, PROT_READ,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+            if (reserve != MAP_FAILED) {
+                map = mmap(reserve, *size, PROT_READ, MAP_PRIVATE | MAP_FIXED,
+                           fd, 0);
+
+                if (map == MAP_FAILED) {
+                    (void)munmap(reserve, *size + padding);
+                    map = NULL;
+                }
+            }
+        }
+
+        (void)close(fd);
+    }
+
+    return map;
+}
+
+
+/**
+ * \internal
+ * Write a block of data to a file descriptor, handling partial writes.
+ */
+static inline bool
+mxjson_tape_put (int fd, const void *data, size_t len)
+{
+    mxstr_t s = mxstr((char *)data, len);
+    ssize_t size = 0;
+
+    while (size >= 0 && !mxstr_empty(s)) {
+        size = write(fd, s.ptr, s.len);
+
+        if (size > 0) {
+            (void)mxstr_consume(&s, size);
+        }
+    }
+
+    return mxstr_empty(s);
+}
+
+
+/*
+ * ----------------------------------------------------------------------
+ * External API
+ * ----------------------------------------------------------------------
+ */
+
+/**
+ * Compute a 64-bit hash of a block of data.
+ *
+ * The hash is used to detect changes to the JSON source, and corruption of
+ * the tape file. It processes 32 bytes per iteration using four independent
+ * lanes, and is not intended to be cryptographically secure.
+ *
+ * @param[in] data
+ *   The data to hash.
+ *
+ * @param[in] len
+ *   Length of the data.
+ *
+ * @param[in] seed
+ *   Initial hash value, allowing the hash to be continued from the hash of
+ *   a previous block.
+ *
+ * @return
+ *   The hash value.
+ */
+static inline uint64_t
+mxjson_tape_hash (const void *data, size_t len, uint64_t seed)
+{
+    static const uint64_t k1 = 0x9e3779b185ebca87ULL;
+    static const uint64_t k2 = 0xc2b2ae3d27d4eb4fULL;
+    const unsigned char  *ptr = data;
+    uint64_t              h[4];
+    uint64_t              w;
+    uint64_t              hash;
+    size_t                i = 0;
+    int                   j;
+
+    h[0] = seed + k1 + k2;
+    h[1] = seed + k2;
+    h[2] = seed;
+    h[3] = seed - k1;
+
+    for (; i + 32 <= len; i += 32) {
+        for (j = 0; j < 4; j++) {
+            memcpy(&w, &ptr[i + j * 8], sizeof(w));
+            h[j] = mxjson_tape_rotl(h[j] + w * k2, 31) * k1;
+        }
+    }
+
+    hash = (mxjson_tape_rotl(h[0], 1) + mxjson_tape_rotl(h[1], 7) +
+            mxjson_tape_rotl(h[2], 12) + mxjson_tape_rotl(h[3], 18));
+    hash += len;
+
+    for (; i + 8 <= len; i += 8) {
+        memcpy(&w, &ptr[i], sizeof(w));
+        hash ^= mxjson_tape_rotl(w * k2, 31) * k1;
+        hash = mxjson_tape_rotl(hash, 27) * k1 + k2;
+    }
+
+    for (; i < len; i++) {
+        hash ^= ptr[i] * k1;
+        hash = mxjson_tape_rotl(hash, 11) * k2;
+    }
+
+    /*
+     * Final avalanche.
+     */
+    hash ^= hash >> 33;
+    hash *= k2;
+    hash ^= hash >> 29;
+    hash *= k1;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+
+/**
+ * Save the result of a successful parse to a tape file.
+ *
+ * The file is written to a uniquely named temporary file (path followed by
+ * a random suffix) which is renamed once complete, so a partially written
+ * tape is never observed at path.
+ *
+ * @param[in] p
+ *   The parser context, containing the result of a successful call to
+ *   mxjson_parse(), with the tokens in depth-first order.
+ *
+ * @param[in] path
+ *   The name of the tape file to create.
+ *
+ * @return
+ *   Indicates whether the tape file was successfully written. false is
+ *   returned without writing anything if the tokens have been reordered by
+ *   mxjson_breadth_first().
+ */
+static inline bool
+mxjson_tape_save (mxjson_parser_t *p, const char *path)
+{
+    static const char    padding[8] = { 0 };
+    mxjson_tape_header_t hdr;
+    mxbuf_t              tmp_path;
+    size_t               tokens_size;
+    uint64_t             start;
+    int                  fd;
+    bool                 ok;
+
+    tokens_size = ((size_t)p->idx + 1) * sizeof(*p->tokens);
+    start = mxjson_tape_tokens_start(p->json.len);
+    mxbuf_create(&tmp_path, NULL, 0);
+
+    /*
+     * The tape does not record the order of the tokens, and is navigated
+     * in depth-first order once loaded.
+     */
+    ok = !p->breadth;
+
+    if (ok) {
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, MXJSON_TAPE_MAGIC, sizeof(MXJSON_TAPE_MAGIC));
+        hdr.version = MXJSON_TAPE_VERSION;
+        hdr.byte_order = MXJSON_TAPE_BYTE_ORDER;
+        hdr.options = MXJSON_TAPE_OPTIONS;
+        hdr.token_size = sizeof(*p->tokens);
+        hdr.token_count = p->idx;
+        hdr.json_len = p->json.len;
+        hdr.tokens_start = start;
+        hdr.source_hash = mxjson_tape_hash(p->json.ptr, p->json.len, 0);
+        hdr.checksum = mxjson_tape_hash(p->tokens, tokens_size,
+                                        mxjson_tape_hash(p->json.ptr,
+                                                         p->json.len, 0));
+
+        (void)mxbuf_write(&tmp_path, mxstr((char *)path, strlen(path)));
+        (void)mxbuf_write(&tmp_path, mxstr_literal(".XXXXXX\0"));
+
+        /*
+         * The temporary file is unique, so processes saving the same tape
+         * at once don't write into each other's files.
+         */
+        fd = mkstemp((char *)tmp_path.buf.ptr);
+        ok = (fd != -1);
+
+        if (ok) {
+            (void)fchmod(fd, 0644);
+        }
+    }
+
+    if (ok) {
+        ok = (mxjson_tape_put(fd, &hdr, sizeof(hdr)) &&
+              mxjson_tape_put(fd, p->json.ptr, p->json.len) &&
+              mxjson_tape_put(fd, padding,
+                              start - sizeof(hdr) - p->json.len) &&
+              mxjson_tape_put(fd, p->tokens, tokens_size));
+        ok = (close(fd) == 0) && ok;
+        ok = ok && (rename((char *)tmp_path.buf.ptr, path) == 0);
+
+        if (!ok) {
+            (void)unlink((char *)tmp_path.buf.ptr);
+        }
+    }
+
+    mxbuf_free(&tmp_path);
+
+    return ok;
+}
+
+
+/**
+ * Close a tape file opened by mxjson_tape_open() or mxjson_tape_load().
+ *
+ * @param[in] tape
+ *   The tape to close.
+ */
+static inline void
+mxjson_tape_close (mxjson_tape_t *tape)
+{
+    if (tape->map != NULL) {
+        (void)munmap(tape->map, tape->map_size);
+    }
+
+    mxjson_free(&tape->parser);
+    memset(tape, 0, sizeof(*tape));
+}
+
+
+/**
+ * Open a tape file.
+ *
+ * The file is mapped into memory, and the header is validated to check the
+ * file was created by a compatible version of mxjson with the same token
+ * layout. The parser context in the tape is populated to reference the JSON
+ * input and tokens in the mapped file.
+ *
+ * @param[in] tape
+ *   The tape to open. mxjson_tape_close() must be called once the tape is
+ *   no longer required, even if the open fails.
+ *
+ * @param[in] path
+ *   The name of the tape file.
+ *
+ * @param[in] verify
+ *   Whether to verify the checksum of the file contents. This requires
+ *   reading the whole file, but is much cheaper than parsing. The tokens
+ *   are trusted without further validation, so this should be used unless
+ *   the tape file is known to be intact.
+ *
+ * @return
+ *   Indicates whether the tape was successfully opened.
+ */
+static inline bool
+mxjson_tape_open (mxjson_tape_t *tape, const char *path, bool verify)
+{
+    mxjson_tape_header_t *hdr = NULL;
+    unsigned char        *base;
+    size_t                tokens_size = 0;
+    bool                  ok;
+
+    memset(tape, 0, sizeof(*tape));
+    mxjson_init(&tape->parser, 0, NULL, NULL);
+
+    tape->map = mxjson_tape_map(path, &tape->map_size, 0);
+    base = tape->map;
+    ok = (base != NULL && tape->map_size >= sizeof(*hdr));
+
+    /*
+     * The sizes in the header are checked against the size of the file
+     * before they are added to anything, so that a damaged header can't
+     * wrap around to appear consistent.
+     */
+    if (ok) {
+        hdr = tape->map;
+        tokens_size = ((size_t)hdr->token_count + 1) * sizeof(mxjson_token_t);
+        ok = (memcmp(hdr->magic, MXJSON_TAPE_MAGIC,
+                     sizeof(MXJSON_TAPE_MAGIC)) == 0 &&
+              hdr->version == MXJSON_TAPE_VERSION &&
+              hdr->byte_order == MXJSON_TAPE_BYTE_ORDER &&
+              hdr->options == MXJSON_TAPE_OPTIONS &&
+              hdr->token_size == sizeof(mxjson_token_t) &&
+              hdr->token_count != MXJSON_IDX_NONE &&
+              hdr->json_len <= tape->map_size - sizeof(*hdr) &&
+              hdr->tokens_start <= tape->map_size &&
+              hdr->tokens_start == mxjson_tape_tokens_start(hdr->json_len) &&
+              tokens_size == tape->map_size - hdr->tokens_start);
+    }
+
+    if (ok && verify) {
+        ok = (hdr->checksum ==
+              mxjson_tape_hash(&base[hdr->tokens_start], tokens_size,
+                               mxjson_tape_hash(&base[sizeof(*hdr)],
+                                                hdr->json_len, 0)));
+    }
+
+    if (ok) {
+        tape->source_hash = hdr->source_hash;
+        tape->parser.json = mxstr((char *)&base[sizeof(*hdr)], hdr->json_len);
+        mxstr_substr(tape->parser.json, hdr->json_len, hdr->json_len,
+                     &tape->parser.unparsed);
+        tape->parser.tokens = (mxjson_token_t *)&base[hdr->tokens_start];
+        tape->parser.idx = hdr->token_count;
+        tape->parser.count = hdr->token_count + 1;
+    }
+
+    return ok;
+}
+
+
+/**
+ * Load a parsed JSON file, using a tape file as a cache.
+ *
+ * The tape file is used if it was created from JSON identical to the
+ * current contents of the JSON file (determined by comparing hashes). Only
+ * when the JSON has changed (or the tape is missing or invalid) is the JSON
+ * parsed, and a new tape file written.
+ *
+ *     mxjson_tape_t tape;
+ *
+ *     if (mxjson_tape_load(&tape, "reference.json", "reference.tape")) {
+ *         // Process the parsed JSON in tape.parser
+ *     }
+ *     mxjson_tape_close(&tape);
+ *
+ * @param[in] tape
+ *   The tape to open. mxjson_tape_close() must be called once the tape is
+ *   no longer required, even if the load fails.
+ *
+ * @param[in] json_path
+ *   The name of the JSON file.
+ *
+ * @param[in] tape_path
+ *   The name of the tape file to use as a cache.
+ *
+ * @return
+ *   Indicates whether the JSON file has been loaded. false is returned if
+ *   the JSON file can't be read, is not valid JSON, or the tape file
+ *   can't be written.
+ */
+static inline bool
+mxjson_tape_load (mxjson_tape_t *tape,
+                  const char    *json_path,
+                  const char    *tape_path)
+{
+    mxjson_parser_t  p;
+    void            *json;
+    size_t           json_len = 0;
+    bool             ok;
+
+    memset(tape, 0, sizeof(*tape));
+    json = mxjson_tape_map(json_path, &json_len, MXJSON_PADDING);
+    ok = (json != NULL);
+
+    if (ok && (!mxjson_tape_open(tape, tape_path, true) ||
+               tape->source_hash != mxjson_tape_hash(json, json_len, 0))) {
+        /*
+         * The tape does not match the JSON - parse the JSON and save a
+         * new tape.
+         */
+        mxjson_tape_close(tape);
+        mxjson_init(&p, 0, NULL, mxjson_resize);
+        ok = (mxjson_parse_padded(&p, mxstr(json, json_len)) &&
+              mxjson_tape_save(&p, tape_path) &&
+              mxjson_tape_open(tape, tape_path, false));
+        mxjson_free(&p);
+    }
+
+    if (json != NULL) {
+        (void)munmap(json, json_len + MXJSON_PADDING);
+    }
+
+    return ok;
+}
+
+
+#endif
@@ -0,0 +1,863 @@
+/*
+ * ----------------------------------------------------------------------
+ * |\ /| mxjson-write.h
+ * | X | JSON Serialiser
+ * |/ \|
+ * ----------------------------------------------------------------------
+ */
+
+#ifndef MXJSON_WRITE_H
+#define MXJSON_WRITE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mxjson.h"
+#include "mxstr.h"
+#include "mxutil.h"
+
+
+/*
+ * ----------------------------------------------------------------------
+ * Internal Implementation
+ * ----------------------------------------------------------------------
+ */
+
+/**
+ * \internal
+ * Escape sequences for the control characters 0x00..0x1f.
+ *
+ * Characters with a short form escape use it, all others use the \u00xx
+ * form.
+ */
+static const char mxjson_write_ctrl[32][7] = {
+    "\\u0000", "\\u0001", "\\u0002", "\\u0003",
+    "\\u0004", "\\u0005", "\\u0006", "\\u0007",
+    "\\b",     "\\t",     "\\n",     "\\u000b",
+    "\\f",     "\\r",     "\\u000e", "\\u000f",
+    "\\u0010", "\\u0011", "\\u0012", "\\u0013",
+    "\\u0014", "\\u0015", "\\u0016", "\\u0017",
+    "\\u0018", "\\u0019", "\\u001a", "\\u001b",
+    "\\u001c", "\\u001d", "\\u001e", "\\u001f",
+};
+
+
+/**
+ * \internal
+ * Get the escape sequence for a character that is not plain (see
+ * mxjson_string_span()).
+ */
+static inline mxstr_t
+mxjson_write_escape (unsigned char c)
+{
+    mxstr_t str;
+
+    if (c == '\"') {
+        str = mxstr_literal("\\\"");
+    } else if (c == '\\') {
+        str = mxstr_literal("\\\\");
+    } else {
+        assert(c < 0x20);
+        str = mxstr((char *)mxjson_write_ctrl[c],
+                    strlen(mxjson_write_ctrl[c]));
+    }
+
+    return str;
+}
+
+
+/**
+ * \internal
+ * Start a new line and indent it, when writing in indented form.
+ *
+ * @param[in] buffer
+ *   The buffer to write to.
+ *
+ * @param[in] indent
+ *   Number of spaces per level of indentation. Nothing is written when
+ *   this is 0.
+ *
+ * @param[in] depth
+ *   The indentation level.
+ */
+static inline void
+mxjson_write_newline (mxbuf_t *buffer, unsigned int indent, uint32_t depth)
+{
+    if (indent != 0) {
+        (void)mxbuf_putc(buffer, '\n');
+        (void)mxbuf_write_chars(buffer, ' ', (size_t)indent * depth);
+    }
+}
+
+
+/**
+ * \internal
+ * Write a string exactly as it appears in the parsed input, including the
+ * surrounding quotes.
+ *
+ * The string held in a token is still in its escaped form, and the input
+ * has been validated, so it can be copied to the output in one block
+ * without re-escaping.
+ *
+ * @param[in] p
+ *   The parser context.
+ *
+ * @param[in] buffer
+ *   The buffer to write to.
+ *
+ * @param[in] offset
+ *   Offset of the string in the input (the character after the opening
+ *   quote).
+ *
+ * @param[in] len
+ *   Length of the string, excluding the quotes.
+ */
+static inline void
+mxjson_write_quoted (mxjson_parser_t *p,
+                     mxbuf_t         *buffer,
+                     uint32_t         offset,
+                     uint32_t         len)
+{
+    (void)mxbuf_write(buffer, mxstr((char *)&p->json.ptr[offset - 1],
+                                    (size_t)len + 2));
+}
+
+
+/*
+ * ----------------------------------------------------------------------
+ * External API
+ * ----------------------------------------------------------------------
+ */
+
+/**
+ * Write a string as a JSON string value.
+ *
+ * The string is enclosed in quotes, and any characters that may not appear
+ * as-is in a JSON string are escaped. Runs of characters that do not need
+ * to be escaped are located with mxjson_string_span() and copied to the
+ * buffer in one block.
+ *
+ * Note: No UTF-8 validation is performed, characters >= 0x80 are copied
+ * unchanged.
+ *
+ * @param[in] buffer
+ *   The buffer to write to. The buffer is resized if necessary.
+ *
+ * @param[in] str
+ *   The (unescaped) string to write.
+ *
+ * @return
+ *   The number of characters written.
+ */
+static inline size_t
+mxjson_write_string (mxbuf_t *buffer, mxstr_t str)
+{
+    mxstr_t s = str;
+    size_t  start;
+    size_t  n;
+    uint8_t c;
+
+    start = mxstr_substr_offset(buffer->buf, buffer->available);
+    (void)mxbuf_putc(buffer, '\"');
+
+    while (!mxstr_empty(s)) {
+        n = mxjson_string_span(s.ptr, s.len, false);
+        (void)mxbuf_write(buffer, mxstr((char *)s.ptr, n));
+        (void)mxstr_consume(&s, n);
+
+        if (mxstr_consume_char(&s, &c, true)) {
+            (void)mxbuf_write(buffer, mxjson_write_escape(c));
+        }
+    }
+
+    (void)mxbuf_putc(buffer, '\"');
+
+    return mxstr_substr_offset(buffer->buf, buffer->available) - start;
+}
+
+
+/**
+ * Serialise a parsed JSON value.
+ *
+ * The JSON value at the specified token index, along with all of its
+ * descendants, is written to the buffer. Passing index 1 writes the whole
+ * of the parsed JSON. If the token is an object member, only the value is
+ * written (not the member name).
+ *
+ * Strings and numbers are copied directly from the input JSON in their
+ * original (escaped) form, so the output is produced with a small number
+ * of block copies per token.
+ *
+ * For example, to re-serialise a parsed JSON input in indented form:
+ *
+ *     mxbuf_t buffer;
+ *
+ *     mxbuf_create(&buffer, NULL, 0);
+ *     (void)mxjson_write(&p, 1, &buffer, 2);
+ *     // mxbuf_str(&buffer) contains the JSON
+ *     mxbuf_free(&buffer);
+ *
+ * @param[in] p
+ *   The parser context, containing the result of a successful call to
+ *   mxjson_parse().
+ *
+ * @param[in] idx
+ *   The index for the token to write.
+ *
+ * @param[in] buffer
+ *   The buffer to write to. The buffer is resized if necessary.
+ *
+ * @param[in] indent
+ *   0 to write compact JSON with no whitespace. Otherwise the JSON is
+ *   written with one value per line, with the specified number of spaces
+ *   for each level of indentation.
+ *
+ * @return
+ *   The number of characters written. Nothing is written, and 0 is
+ *   returned, if the tokens have been reordered by mxjson_breadth_first().
+ */
+static inline size_t
+mxjson_write (mxjson_parser_t *p,
+              mxjson_idx_t     idx,
+              mxbuf_t         *buffer,
+              unsigned int     indent)
+{
+    mxjson_token_t *token;
+    mxjson_idx_t    end;
+    mxjson_idx_t    parent = MXJSON_IDX_NONE;
+    uint32_t        depth = 0;
+    size_t          start;
+    bool            open;
+
+    start = mxstr_substr_offset(buffer->buf, buffer->available);
+
+    /*
+     * The tokens are written in depth-first order, so nothing is written
+     * once they have been reordered.
+     */
+    end = p->breadth ? idx : mxjson_next(p, idx);
+
+    while (idx != end) {
+        token = &p->tokens[idx];
+        open = false;
+
+        if (depth != 0 && token->name != 0) {
+            mxjson_write_quoted(p, buffer, token->name, token->name_size);
+
+            if (indent != 0) {
+                (void)mxbuf_write(buffer, mxstr_literal(": "));
+            } else {
+                (void)mxbuf_putc(buffer, ':');
+            }
+        }
+
+        switch (token->value_type) {
+        case MXJSON_NULL:
+            (void)mxbuf_write(buffer, mxstr_literal("null"));
+            break;
+
+        case MXJSON_BOOL:
+            if (token->boolean) {
+                (void)mxbuf_write(buffer, mxstr_literal("true"));
+            } else {
+                (void)mxbuf_write(buffer, mxstr_literal("false"));
+            }
+            break;
+
+        case MXJSON_NUMBER:
+        case MXJSON_RAW:
+            (void)mxbuf_write(buffer, mxstr((char *)&p->json.ptr[token->str],
+                                            token->str_size));
+            break;
+
+        case MXJSON_STRING:
+            mxjson_write_quoted(p, buffer, token->str, token->str_size);
+            break;
+
+        case MXJSON_OBJECT:
+        case MXJSON_ARRAY:
+            (void)mxbuf_putc(buffer,
+                             token->value_type == MXJSON_OBJECT ? '{' : '[');
+
+            if (token->children != 0) {
+                open = true;
+                parent = idx;
+                depth++;
+                mxjson_write_newline(buffer, indent, depth);
+            } else {
+                (void)mxbuf_putc(buffer,
+                                 token->value_type == MXJSON_OBJECT ? '}' : ']');
+            }
+            break;
+
+        default:
+            assert(false);
+            break;
+        }
+
+        idx++;
+
+        if (!open && depth != 0) {
+            /*
+             * Close each object/array that ends with this value, then
+             * separate this value from the next one.
+             */
+            token = &p->tokens[parent];
+
+            while (depth != 0 && token->next == idx) {
+                depth--;
+                mxjson_write_newline(buffer, indent, depth);
+                (void)mxbuf_putc(buffer,
+                                 token->value_type == MXJSON_OBJECT ? '}' : ']');
+                parent = token->parent;
+                token = &p->tokens[parent];
+            }
+
+            if (depth != 0) {
+                (void)mxbuf_putc(buffer, ',');
+                mxjson_write_newline(buffer, indent, depth);
+            }
+        }
+    }
+
+    return mxstr_substr_offset(buffer->buf, buffer->available) - start;
+}
+
+
+/*
+ * ----------------------------------------------------------------------
+ * Streaming Writer
+ * ----------------------------------------------------------------------
+ */
+
+/**
+ * Maximum nesting depth of object/array values for a streaming writer.
+ *
+ * May be overridden by defining MXJSON_WRITER_MAX_DEPTH before including
+ * this file.
+ */
+#ifndef MXJSON_WRITER_MAX_DEPTH
+#define MXJSON_WRITER_MAX_DEPTH 1024
+#endif
+
+
+/**
+ * Callback function type to consume output from a streaming writer.
+ *
+ * The callback is called when the writer's buffer is full, and from
+ * mxjson_writer_finish() to output any remaining data. The data is only
+ * valid for the duration of the call.
+ *
+ * @param[in] ctx
+ *   The context pointer passed to mxjson_writer_init() (e.g. a file
+ *   descriptor, socket or compression stream).
+ *
+ * @param[in] data
+ *   The data to output.
+ *
+ * @return
+ *   Indicates whether the data was successfully consumed. If false is
+ *   returned, the writer is put into an error state, and all subsequent
+ *   calls fail.
+ */
+typedef bool (*mxjson_flush_cb)(void *ctx, mxstr_t data);
+
+
+/**
+ * Streaming writer context.
+ *
+ * A streaming writer generates JSON from a sequence of calls (begin/end of
+ * an object or array, object member name, or value). The output is placed
+ * in a fixed size buffer supplied by the caller, which is passed to a flush
+ * callback whenever it fills. The memory used is constant, irrespective of
+ * the size of the JSON generated.
+ *
+ * The nesting of values is validated as the JSON is written. Any misuse
+ * (e.g. a value in an object without a member name, mismatched end calls,
+ * or a second top-level value) puts the writer in an error state. The
+ * error state is sticky: every subsequent call returns false, so it is
+ * sufficient to check the result of mxjson_writer_finish().
+ *
+ *     char            buf[4096];
+ *     mxjson_writer_t w;
+ *
+ *     mxjson_writer_init(&w, buf, sizeof(buf), flush_fn, ctx);
+ *     mxjson_writer_begin_object(&w);
+ *     mxjson_writer_key(&w, mxstr_literal("ids"));
+ *     mxjson_writer_begin_array(&w);
+ *     mxjson_writer_number(&w, mxstr_literal("1"));
+ *     mxjson_writer_number(&w, mxstr_literal("2"));
+ *     mxjson_writer_end_array(&w);
+ *     mxjson_writer_end_object(&w);
+ *     ok = mxjson_writer_finish(&w);
+ *     // flush_fn has been passed {"ids":[1,2]}
+ */
+typedef struct {
+    mxstr_t          buf;        /**< Caller supplied output buffer */
+    mxstr_t          available;  /**< Remaining space in the buffer */
+    mxjson_flush_cb  flush_fn;   /**< Callback to consume the output */
+    void            *flush_ctx;  /**< Context passed to flush_fn */
+    uint32_t         depth;      /**< Current object/array nesting depth */
+    bool             first;      /**< No value written at current depth */
+    bool             key;        /**< Member name written, expecting value */
+    bool             ok;         /**< Whether any error has occurred */
+
+    /**
+     * Stack of bits, one per nesting level, set when the level is an
+     * object and clear when it is an array.
+     */
+    uint64_t         objects[(MXJSON_WRITER_MAX_DEPTH + 63) / 64];
+} mxjson_writer_t;
+
+
+/**
+ * \internal
+ * Pass the contents of the writer's buffer to the flush callback, and
+ * reset the buffer to be empty.
+ */
+static inline bool
+mxjson_writer_flush (mxjson_writer_t *w)
+{
+    mxstr_t data;
+
+    data = mxstr_prefix(w->buf, w->available);
+
+    if (w->ok && !mxstr_empty(data)) {
+        w->ok = w->flush_fn(w->flush_ctx, data);
+    }
+
+    w->available = w->buf;
+
+    return w->ok;
+}
+
+
+/**
+ * \internal
+ * Write a string to the writer's buffer, flushing the buffer each time
+ * it fills.
+ */
+static inline bool
+mxjson_writer_put (mxjson_writer_t *w, mxstr_t str)
+{
+    mxstr_t s = str;
+
+    (void)mxstr_consume(&s, mxstr_write(&w->available, s));
+
+    while (w->ok && !mxstr_empty(s)) {
+        (void)mxjson_writer_flush(w);
+        (void)mxstr_consume(&s, mxstr_write(&w->available, s));
+    }
+
+    return w->ok;
+}
+
+
+/**
+ * \internal
+ * Write a single character to the writer's buffer.
+ */
+static inline bool
+mxjson_writer_putc (mxjson_writer_t *w, unsigned char c)
+{
+    if (!mxstr_putc(&w->available, c) && mxjson_writer_flush(w)) {
+        (void)mxstr_putc(&w->available, c);
+    }
+
+    return w->ok;
+}
+
+
+/**
+ * \internal
+ * Write a string as a JSON string value, escaping characters as needed.
+ */
+static inline bool
+mxjson_writer_put_string (mxjson_writer_t *w, mxstr_t str)
+{
+    mxstr_t s = str;
+    size_t  n;
+    uint8_t c;
+
+    (void)mxjson_writer_putc(w, '\"');
+
+    while (w->ok && !mxstr_empty(s)) {
+        n = mxjson_string_span(s.ptr, s.len, false);
+        (void)mxjson_writer_put(w, mxstr((char *)s.ptr, n));
+        (void)mxstr_consume(&s, n);
+
+        if (mxstr_consume_char(&s, &c, true)) {
+            (void)mxjson_writer_put(w, mxjson_write_escape(c));
+        }
+    }
+
+    return mxjson_writer_putc(w, '\"');
+}
+
+
+/**
+ * \internal
+ * Whether the current nesting level is an object.
+ */
+static inline bool
+mxjson_writer_in_object (mxjson_writer_t *w)
+{
+    uint32_t level = w->depth - 1;
+
+    return (w->depth != 0 &&
+            (w->objects[level / 64] & (1ULL << (level % 64))) != 0);
+}
+
+
+/**
+ * \internal
+ * Validate that a value may be written at the current position, and write
+ * the separator from any preceding value.
+ */
+static inline bool
+mxjson_writer_value (mxjson_writer_t *w)
+{
+    bool ok = w->ok;
+
+    if (ok) {
+        if (w->depth == 0) {
+            ok = w->first;
+        } else if (mxjson_writer_in_object(w)) {
+            ok = w->key;
+        } else if (!w->first) {
+            ok = mxjson_writer_putc(w, ',');
+        }
+    }
+
+    w->first = false;
+    w->key = false;
+    w->ok = ok;
+
+    return ok;
+}
+
+
+/**
+ * \internal
+ * Start an object or array value.
+ */
+static inline bool
+mxjson_writer_begin (mxjson_writer_t *w, bool object)
+{
+    uint32_t level = w->depth;
+    bool     ok;
+
+    ok = (mxjson_writer_value(w) && level < MXJSON_WRITER_MAX_DEPTH);
+
+    if (ok) {
+        if (object) {
+            w->objects[level / 64] |= (1ULL << (level % 64));
+        } else {
+            w->objects[level / 64] &= ~(1ULL << (level % 64));
+        }
+
+        w->depth++;
+        w->first = true;
+        ok = mxjson_writer_putc(w, object ? '{' : '[');
+    }
+
+    w->ok = ok;
+
+    return ok;
+}
+
+
+/**
+ * \internal
+ * End an object or array value.
+ */
+static inline bool
+mxjson_writer_end (mxjson_writer_t *w, bool object)
+{
+    bool ok;
+
+    ok = (w->ok && w->depth != 0 && !w->key &&
+          mxjson_writer_in_object(w) == object);
+
+    if (ok) {
+        w->depth--;
+        w->first = false;
+        ok = mxjson_writer_putc(w, object ? '}' : ']');
+    }
+
+    w->ok = ok;
+
+    return ok;
+}
+
+
+/**
+ * Initialise a streaming writer.
+ *
+ * @param[in] w
+ *   The writer context to initialise.
+ *
+ * @param[in] buf
+ *   The buffer to hold output before it is passed to the flush callback.
+ *   The buffer must remain valid until mxjson_writer_finish() is called.
+ *
+ * @param[in] len
+ *   The size of the buffer, which must be non-zero.
+ *
+ * @param[in] flush_fn
+ *   Callback to consume the output.
+ *
+ * @param[in] flush_ctx
+ *   Context pointer passed to flush_fn.
+ */
+static inline void
+mxjson_writer_init (mxjson_writer_t *w,
+                    void            *buf,
+                    size_t           len,
+                    mxjson_flush_cb  flush_fn,
+                    void            *flush_ctx)
+{
+    assert(len != 0);
+
+    memset(w, 0, sizeof(*w));
+    w->buf = mxstr(buf, len);
+    w->available = w->buf;
+    w->flush_fn = flush_fn;
+    w->flush_ctx = flush_ctx;
+    w->first = true;
+    w->ok = true;
+}
+
+
+/**
+ * Start an object value.
+ *
+ * @return
+ *   false if the writer is in an error state, an object value is not valid
+ *   at this point, or the maximum nesting depth is exceeded.
+ */
+static inline bool
+mxjson_writer_begin_object (mxjson_writer_t *w)
+{
+    return mxjson_writer_begin(w, true);
+}
+
+
+/**
+ * End an object value.
+ *
+ * @return
+ *   false if the writer is in an error state or the innermost open value is
+ *   not an object (or is an object awaiting a member value).
+ */
+static inline bool
+mxjson_writer_end_object (mxjson_writer_t *w)
+{
+    return mxjson_writer_end(w, true);
+}
+
+
+/**
+ * Start an array value.
+ *
+ * @return
+ *   false if the writer is in an error state, an array value is not valid
+ *   at this point, or the maximum nesting depth is exceeded.
+ */
+static inline bool
+mxjson_writer_begin_array (mxjson_writer_t *w)
+{
+    return mxjson_writer_begin(w, false);
+}
+
+
+/**
+ * End an array value.
+ *
+ * @return
+ *   false if the writer is in an error state or the innermost open value is
+ *   not an array.
+ */
+static inline bool
+mxjson_writer_end_array (mxjson_writer_t *w)
+{
+    return mxjson_writer_end(w, false);
+}
+
+
+/**
+ * Write an object member name.
+ *
+ * The member name must be followed by the member value.
+ *
+ * @param[in] w
+ *   The writer context.
+ *
+ * @param[in] name
+ *   The (unescaped) member name.
+ *
+ * @return
+ *   false if the writer is in an error state, or a member name is not valid
+ *   at this point.
+ */
+static inline bool
+mxjson_writer_key (mxjson_writer_t *w, mxstr_t name)
+{
+    bool ok;
+
+    ok = (w->ok && mxjson_writer_in_object(w) && !w->key &&
+          (w->first || mxjson_writer_putc(w, ',')) &&
+          mxjson_writer_put_string(w, name) &&
+          mxjson_writer_putc(w, ':'));
+
+    w->first = false;
+    w->key = true;
+    w->ok = ok;
+
+    return ok;
+}
+
+
+/**
+ * Write a string value.
+ *
+ * @param[in] w
+ *   The writer context.
+ *
+ * @param[in] str
+ *   The (unescaped) string.
+ */
+static inline bool
+mxjson_writer_string (mxjson_writer_t *w, mxstr_t str)
+{
+    return mxjson_writer_value(w) && mxjson_writer_put_string(w, str);
+}
+
+
+/**
+ * Write a number value.
+ *
+ * @param[in] w
+ *   The writer context.
+ *
+ * @param[in] number
+ *   String representation of the number. This must be a valid JSON number,
+ *   otherwise the writer is put in an error state.
+ */
+static inline bool
+mxjson_writer_number (mxjson_writer_t *w, mxstr_t number)
+{
+    mxstr_t s = number;
+    mxstr_t value;
+
+    w->ok = (mxjson_parse_number(&s, &value) && mxstr_empty(s) &&
+             mxjson_writer_value(w) && mxjson_writer_put(w, number));
+
+    return w->ok;
+}
+
+
+/**
+ * Write an integer number value.
+ */
+static inline bool
+mxjson_writer_int (mxjson_writer_t *w, int64_t value)
+{
+    char    buf[MXSTR_INT64_MAX + 1];
+    mxstr_t s = mxstr(buf, sizeof(buf));
+
+    (void)mxstr_put_int64(&s, value);
+
+    return (mxjson_writer_value(w) &&
+            mxjson_writer_put(w, mxstr_prefix(mxstr(buf, sizeof(buf)), s)));
+}
+
+
+/**
+ * Write a floating point number value.
+ *
+ * The shortest representation that converts back to the same value is
+ * written (see mxstr_put_double()).
+ *
+ * @param[in] w
+ *   The writer context.
+ *
+ * @param[in] value
+ *   The value to write. This must be finite (JSON has no representation for
+ *   infinity or NaN), otherwise the writer is put in an error state.
+ */
+static inline bool
+mxjson_writer_double (mxjson_writer_t *w, double value)
+{
+    char    buf[MXSTR_DOUBLE_MAX];
+    mxstr_t s = mxstr(buf, sizeof(buf));
+
+    w->ok = (mxstr_put_double(&s, value) &&
+             mxjson_writer_value(w) &&
+             mxjson_writer_put(w, mxstr_prefix(mxstr(buf, sizeof(buf)), s)));
+
+    return w->ok;
+}
+
+
+/**
+ * Write a boolean value.
+ */
+static inline bool
+mxjson_writer_bool (mxjson_writer_t *w, bool value)
+{
+    return (mxjson_writer_value(w) &&
+            mxjson_writer_put(w, value ? mxstr_literal("true") :
+                                         mxstr_literal("false")));
+}
+
+
+/**
+ * Write a null value.
+ */
+static inline bool
+mxjson_writer_null (mxjson_writer_t *w)
+{
+    return (mxjson_writer_value(w) &&
+            mxjson_writer_put(w, mxstr_literal("null")));
+}
+
+
+/**
+ * Write a value that is already serialised as JSON.
+ *
+ * For example, the output from mxjson_write() may be inserted into the
+ * stream. The JSON is written as-is, without validation.
+ *
+ * @param[in] w
+ *   The writer context.
+ *
+ * @param[in] json
+ *   A single, valid, JSON value.
+ */
+static inline bool
+mxjson_writer_raw (mxjson_writer_t *w, mxstr_t json)
+{
+    return mxjson_writer_value(w) && mxjson_writer_put(w, json);
+}
+
+
+/**
+ * Complete the output from a streaming writer.
+ *
+ * Any output remaining in the buffer is passed to the flush callback.
+ *
+ * @return
+ *   Indicates whether a complete, valid JSON value has been written, and all
+ *   output was successfully consumed by the flush callback.
+ */
+static inline bool
+mxjson_writer_finish (mxjson_writer_t *w)
+{
+    w->ok = (w->ok && w->depth == 0 && !w->first);
+
+    return mxjson_writer_flush(w);
+}
+
+
+#endif
@@ -17,6 +17,145 @@
 #include "mxutil.h"
 
 
+/**
+ * Compile time options
+ *
+ * The following options may be enabled by defining them to 1 before
+ * including mxjson.h (or on the compiler command line). An option changes
+ * the layout of mxjson_token_t, so it must be set consistently for all code
+ * that shares parser contexts or tokens.
+ *
+ * - MXJSON_SPAN: Record the span of the input (start offset and length)
+ *   for every JSON value, including objects and arrays. The span is
+ *   available via mxjson_token_raw().
+ *
+ * - MXJSON_DEPTH: Record the nesting depth of every token during parsing,
+ *   so that mxjson_depth() is O(1). Without this option, mxjson_depth()
+ *   follows the parent links up to the top level value.
+ *
+ * - MXJSON_STATS: Collect statistics about each parse in the parser
+ *   context (see mxjson_stats_t), available via mxjson_stats(). This
+ *   changes the layout of mxjson_parser_t rather than mxjson_token_t. When
+ *   disabled, no statistics code is compiled.
+ */
+#ifndef MXJSON_SPAN
+#define MXJSON_SPAN 0
+#endif
+
+#ifndef MXJSON_DEPTH
+#define MXJSON_DEPTH 0
+#endif
+
+#ifndef MXJSON_STATS
+#define MXJSON_STATS 0
+#endif
+
+
+/**
+ * Clock used to measure the cycles spent in each parse phase when
+ * MXJSON_STATS is enabled.
+ *
+ * The time stamp counter is used on x86-64 with GCC and Clang. Elsewhere
+ * the phases are not timed (the clock is always 0), unless a clock is
+ * provided by defining MXJSON_STATS_CLOCK() before including mxjson.h to
+ * an expression giving a uint64_t count. Defining it to 0 disables the
+ * timing, which avoids the overhead of reading the clock for every string
+ * and number.
+ */
+#if MXJSON_STATS && !defined(MXJSON_STATS_CLOCK)
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <x86intrin.h>
+#define MXJSON_STATS_CLOCK() __rdtsc()
+#else
+#define MXJSON_STATS_CLOCK() 0
+#endif
+#endif
+
+
+/**
+ * Parser implementation options
+ *
+ * These options select between implementations of the parser, and do not
+ * affect the layout of mxjson_token_t or the parse result.
+ *
+ * - MXJSON_PARSE_FSM: Use the state machine parse core (mxjson_parse_fsm())
+ *   in place of the default parse loop (mxjson_parse_json()).
+ *
+ * - MXJSON_COMPUTED_GOTO: Dispatch on the first character of a value in
+ *   the state machine using computed gotos. Enabled by default for GCC and
+ *   Clang, otherwise a switch statement is used.
+ *
+ * - MXJSON_DISPATCH: Compile the SIMD kernels (used to scan strings) for
+ *   SSE2, AVX2 and AVX-512, and select the best supported by the host at
+ *   runtime. Enabled by default for x86-64 with GCC and Clang. When
+ *   disabled, the kernels for the compile time target (e.g. as set by
+ *   -march) are used.
+ */
+#ifndef MXJSON_PARSE_FSM
+#define MXJSON_PARSE_FSM 0
+#endif
+
+#ifndef MXJSON_COMPUTED_GOTO
+#if defined(__GNUC__)
+#define MXJSON_COMPUTED_GOTO 1
+#else
+#define MXJSON_COMPUTED_GOTO 0
+#endif
+#endif
+
+#ifndef MXJSON_DISPATCH
+#if defined(__x86_64__) && defined(__GNUC__)
+#define MXJSON_DISPATCH 1
+#else
+#define MXJSON_DISPATCH 0
+#endif
+#endif
+
+#if defined(__SSE2__) || MXJSON_DISPATCH
+#include <immintrin.h>
+#endif
+
+#if MXJSON_DISPATCH
+#define MXJSON_TARGET(isa_) __attribute__((target(isa_)))
+#else
+#define MXJSON_TARGET(isa_)
+#endif
+
+
+/**
+ * Maximum nesting depth of objects/arrays accepted by the parser.
+ *
+ * The parser tracks the objects/arrays that enclose the current parse
+ * position in a fixed size stack in the parser context. JSON nested more
+ * deeply than this is rejected, which also limits the resources used when
+ * parsing untrusted input. Each level uses 4 bytes in the parser context.
+ * May be overridden by defining it before including mxjson.h.
+ */
+#ifndef MXJSON_MAX_DEPTH
+#define MXJSON_MAX_DEPTH 1024
+#endif
+
+
+/**
+ * Number of bytes of padding required after the JSON input passed to
+ * mxjson_parse_padded().
+ *
+ * The padding must be readable, and the first byte of the padding must be
+ * '\0' (mxbuf_pad() provides zero filled padding). The '\0' terminates
+ * every scan, so the lexer can read ahead without checking the length of
+ * the input, and the SIMD kernels can use full width loads up to the end
+ * of the padding. May be overridden by defining it before including
+ * mxjson.h, but must be at least 4 (the size of the word compared when
+ * matching a literal).
+ */
+#ifndef MXJSON_PADDING
+#define MXJSON_PADDING 64
+#endif
+
+_Static_assert(MXJSON_PADDING >= 4,
+               "MXJSON_PADDING must cover the 4 byte literal compare");
+
+
 /**
  * Types for JSON tokens
  *
@@ -31,6 +170,7 @@ typedef enum {
     MXJSON_STRING,
     MXJSON_OBJECT,
     MXJSON_ARRAY,
+    MXJSON_RAW,
     MXJSON_COUNT
 } mxjson_type;
 
@@ -54,6 +194,15 @@ typedef uint32_t mxjson_idx_t;
 #define MXJSON_IDX_NONE 0
 
 
+/**
+ * \internal
+ * Flag set in a parse stack entry when the entry is for an object. This
+ * limits token indices for objects/arrays to 2^31 - 1, which is not a
+ * practical restriction given the 32-bit input offsets in the tokens.
+ */
+#define MXJSON_STACK_OBJECT 0x80000000
+
+
 /**
  * Information about a parsed JSON value.
  *
@@ -74,9 +223,13 @@ typedef uint32_t mxjson_idx_t;
  *  - MXJSON_STRING: str and str_size represent the string value
  *  - MXJSON_OBJECT: children is the number of members of the object.
  *  - MXJSON_ARRAY: children is the number of members of the array.
+ *  - MXJSON_RAW: str and str_size represent the text of an object or array
+ *    that was validated but not tokenized (see mxjson_lazy_depth()).
  *
  * For MXJSON_OBJECT and MXJSON_ARRAY, the "next" field gives the index of
- * the token immediately following the object/array contents.
+ * the token immediately following the object/array contents. Once the tokens
+ * have been reordered by mxjson_breadth_first(), it instead gives the index
+ * of the first child.
  *
  * The references to other tokens (parent and next) all use array index values
  * rather than pointers to accommodate the case where the token array is
@@ -89,6 +242,13 @@ typedef uint32_t mxjson_idx_t;
  * the non-escaped string can be obtained using mxjson_token_name and/or
  * mxjson_token_string.
  *
+ * When MXJSON_SPAN is enabled, raw/raw_size give the span of the input
+ * containing the complete value (not including the name), e.g. for an
+ * object this covers the text from the opening '{' to the closing '}'.
+ *
+ * When MXJSON_DEPTH is enabled, depth gives the number of objects/arrays
+ * containing the token (0 for the top level value).
+ *
  * Note: The use of a bitfield for name_size/value_type etc. is to optimise the
  * memory usage for a token. The tradeoff is that the maximum length for an
  * object member name is 2^27.
@@ -114,9 +274,95 @@ typedef struct {
             mxjson_idx_t next;     /**< Next token after array/object */
         };
     };
+
+#if MXJSON_SPAN
+    uint32_t     raw;           /**< Offset into parse buffer for value */
+    uint32_t     raw_size;      /**< Length of the value in parse buffer */
+#endif
+
+#if MXJSON_DEPTH
+    uint32_t     depth;         /**< Nesting depth of the token */
+#endif
 } mxjson_token_t;
 
 
+#if MXJSON_STATS
+/**
+ * Phases of parsing that are timed when MXJSON_STATS is enabled.
+ *
+ * The phases other than MXJSON_PHASE_PARSE are parts of the complete
+ * parse. The remainder of the parse time is spent on whitespace, literals
+ * and structure (punctuation and the parse stack).
+ */
+typedef enum {
+    MXJSON_PHASE_PARSE,   /**< Complete parse */
+    MXJSON_PHASE_STRING,  /**< Scanning object member names and strings */
+    MXJSON_PHASE_NUMBER,  /**< Scanning numbers */
+    MXJSON_PHASE_RESIZE,  /**< Resizing the token array */
+    MXJSON_PHASE_COUNT
+} mxjson_phase;
+
+
+/**
+ * Statistics for a parse, collected when MXJSON_STATS is enabled.
+ *
+ * The statistics are reset at the start of each parse, and describe the
+ * input parsed so far if the parse fails.
+ *
+ * The bytes of a string value or object member name include the quotes,
+ * and the bytes of an object/array are its opening and closing braces, so
+ * the difference between bytes and the sum of value_bytes and name_bytes
+ * is whitespace, ',' and ':'.
+ *
+ * resize_bytes is the size of the token array each time it is resized,
+ * which is the amount copied by mxjson_resize(). The cycles are measured
+ * using MXJSON_STATS_CLOCK(), and include the overhead of reading the
+ * clock, which is significant for short strings and numbers.
+ */
+typedef struct {
+    uint64_t bytes;                     /**< Bytes of input consumed */
+    uint64_t values[MXJSON_COUNT];      /**< Values of each type */
+    uint64_t value_bytes[MXJSON_COUNT]; /**< Bytes of values of each type */
+    uint64_t name_bytes;                /**< Bytes of object member names */
+    uint64_t escapes;                   /**< Escape sequences in strings */
+    uint64_t resizes;                   /**< Calls to the resize function */
+    uint64_t resize_bytes;              /**< Bytes of tokens at resizes */
+    uint64_t cycles[MXJSON_PHASE_COUNT]; /**< Cycles spent in each phase */
+    uint32_t max_depth;                 /**< Maximum nesting depth */
+} mxjson_stats_t;
+#endif
+
+
+/**
+ * \internal
+ * Entry in the hash table of array offset tables.
+ */
+typedef struct {
+    mxjson_idx_t array;   /**< Index of the array, or MXJSON_IDX_NONE */
+    uint32_t     offset;  /**< Offset of the table in the arena */
+} mxjson_index_entry_t;
+
+
+/**
+ * Offset tables for random access to the elements of large arrays.
+ *
+ * Enabled with mxjson_array_index(). The table for an array gives the index
+ * of each of its elements, and is built by mxjson_array_at() the first time
+ * an element of the array is requested. The tables are stored in an arena,
+ * located by a hash table keyed by the index of the array, and are
+ * discarded (keeping the memory) when the parser context is reused.
+ */
+typedef struct {
+    mxjson_idx_t          threshold; /**< Minimum elements, or 0 if disabled */
+    uint32_t              slots;     /**< Size of the hash table (power of 2) */
+    uint32_t              used;      /**< Entries in the hash table */
+    mxjson_index_entry_t *entries;   /**< Hash table */
+    mxjson_idx_t         *arena;     /**< Storage for the tables */
+    size_t                len;       /**< Indices used in the arena */
+    size_t                size;      /**< Indices allocated in the arena */
+} mxjson_index_t;
+
+
 /**
  * Parser context.
  *
@@ -290,12 +536,29 @@ struct mxjson_parser_t {
     mxjson_token_t   *token;          /**< Current token */
     mxjson_idx_t      current_parent; /**< Index for current parent token */
 
+    /**
+     * The parse stack holds the indices for the objects/arrays enclosing
+     * the current parse position (with the outermost at stack[0]), so that
+     * closing braces can be matched without reading the tokens array. The
+     * MXJSON_STACK_OBJECT bit is set for objects.
+     */
+    uint32_t          depth;                   /**< Entries in the stack */
+    mxjson_idx_t      stack[MXJSON_MAX_DEPTH]; /**< Parse stack */
+
     /**
      * The following fields store information passed to mxjson_init().
      */
     mxjson_idx_t      init_count;  /**< Initial size for token array */
     mxjson_token_t   *init_tokens; /**< User supplied initial token array */
     mxjson_resize_cb  resize_fn;   /**< Callback for token array management */
+
+    mxjson_index_t    index;       /**< Array offset tables, if enabled */
+    bool              breadth;     /**< Tokens are in breadth-first order */
+    uint32_t          lazy_depth;  /**< Depth of untokenized values, or 0 */
+
+#if MXJSON_STATS
+    mxjson_stats_t    stats;       /**< Statistics for the last parse */
+#endif
 };
 
 
@@ -323,6 +586,10 @@ static inline bool mxjson_resize(mxjson_parser_t *p, mxjson_idx_t size_hint);
  * or the array/object is empty), the next token after the specified idx
  * is returned.
  *
+ * Once the tokens have been reordered by mxjson_breadth_first(), the first
+ * child of an array or object is returned (which is mxjson_end() if it is
+ * empty).
+ *
  * See mxjson_parser_t for example usage.
  *
  * @param[in] p
@@ -348,6 +615,11 @@ static inline mxjson_idx_t mxjson_first(mxjson_parser_t *p, mxjson_idx_t idx);
  * token following the object/array is returned. If the specified token has no
  * children, the token immediately following the specified token is returned.
  *
+ * Once the tokens have been reordered by mxjson_breadth_first(), the next
+ * sibling of the token is returned (which is mxjson_end() of the parent for
+ * the last child), so mxjson_next() may only be used to iterate over the
+ * children of a token.
+ *
  * See mxjson_parser_t for example usage.
  *
  * @param[in] p
@@ -362,6 +634,33 @@ static inline mxjson_idx_t mxjson_first(mxjson_parser_t *p, mxjson_idx_t idx);
 static inline mxjson_idx_t mxjson_next(mxjson_parser_t *p, mxjson_idx_t idx);
 
 
+/**
+ * Get the end of the children of a token.
+ *
+ * Returns the index reached by mxjson_next() after the last child of the
+ * token, so that the children can be processed in either token order:
+ *
+ *     last = mxjson_end(&p, parent_index);
+ *
+ *     for (index = mxjson_first(&p, parent_index); index != last;
+ *          index = mxjson_next(&p, index)) {
+ *         // Process token p.tokens[index]
+ *     }
+ *
+ * In depth-first order this is the same as mxjson_next().
+ *
+ * @param[in] p
+ *   The parser context.
+ *
+ * @param[in] idx
+ *   The index of the current token.
+ *
+ * @return
+ *   The index after the last child.
+ */
+static inline mxjson_idx_t mxjson_end(mxjson_parser_t *p, mxjson_idx_t idx);
+
+
 /**
  * Get the name string for a token.
  *
@@ -400,7 +699,8 @@ static inline mxstr_t mxjson_token_name(mxjson_parser_t *p,
  *
  * Note: this function may be used for any token type. Only MXJSON_STRING
  * tokens may contain escaped characters. MXJSON_OBJECT and MXJSON_ARRAY
- * token types return the strings "object" and "array" respectively.
+ * token types return the strings "object" and "array" respectively, and
+ * MXJSON_RAW tokens return the text of the object or array.
  *
  * @param[in] p
  *   The parser context containing the tokens.
@@ -430,6 +730,276 @@ static inline mxstr_t mxjson_token_string(mxjson_parser_t *p,
                                           bool            *valid);
 
 
+#if MXJSON_SPAN
+/**
+ * Get the input text for a token's value.
+ *
+ * Returns the exact text from the JSON input for the value, including all
+ * of its descendants for an object or array value, so that a value can be
+ * forwarded or sliced without re-serialising it. The name of an object
+ * member is not included. Only available when MXJSON_SPAN is enabled.
+ *
+ * @param[in] p
+ *   The parser context containing the tokens.
+ *
+ * @param[in] idx
+ *   The index for the token whose value is required.
+ *
+ * @return
+ *   A reference to the value in the JSON input.
+ */
+static inline mxstr_t mxjson_token_raw(mxjson_parser_t *p, mxjson_idx_t idx);
+#endif
+
+
+/**
+ * Get the nesting depth of a token.
+ *
+ * The depth is the number of object/array values that contain the token,
+ * so the top level value has a depth of 0. When MXJSON_DEPTH is enabled the
+ * depth is recorded during parsing and this is O(1), otherwise the parent
+ * links are followed up to the top level value.
+ *
+ * @param[in] p
+ *   The parser context containing the tokens.
+ *
+ * @param[in] idx
+ *   The index for the token (must not be MXJSON_IDX_NONE).
+ *
+ * @return
+ *   The depth of the token.
+ */
+static inline uint32_t mxjson_depth(mxjson_parser_t *p, mxjson_idx_t idx);
+
+
+/**
+ * Get the indices of the children of an object or array.
+ *
+ * @param[in] p
+ *   The parser context.
+ *
+ * @param[in] idx
+ *   The index of the object or array token.
+ *
+ * @param[out] children
+ *   Array to populate with the indices of the children, which must have
+ *   space for p->tokens[idx].children entries.
+ *
+ * @return
+ *   The number of children.
+ */
+static inline size_t mxjson_children(mxjson_parser_t *p,
+                                     mxjson_idx_t     idx,
+                                     mxjson_idx_t    *children);
+
+
+/**
+ * Enable offset tables for random access to the elements of large arrays.
+ *
+ * Without offset tables, mxjson_array_at() is O(1) for an array whose
+ * elements are all strings, numbers or literals (as the elements are then
+ * consecutive tokens), and O(n) for an array containing objects or arrays.
+ * With offset tables, the first call to mxjson_array_at() for an array of
+ * at least threshold elements containing objects or arrays builds a table
+ * of the indices of its elements (one pass over the elements), and later
+ * calls are O(1).
+ *
+ * The tables are allocated with malloc(), and are freed by mxjson_free().
+ * As the tables are built on demand, mxjson_array_at() modifies the parser
+ * context when offset tables are enabled, so it must not then be called
+ * concurrently from several threads for the same parser context.
+ *
+ * @param[in] p
+ *   The parser context.
+ *
+ * @param[in] threshold
+ *   The minimum number of elements for an array to have an offset table,
+ *   or 0 to disable the tables.
+ */
+static inline void mxjson_array_index(mxjson_parser_t *p,
+                                      mxjson_idx_t     threshold);
+
+
+/**
+ * Get an element of an array (or a member of an object) by position.
+ *
+ * See mxjson_array_index() for the cost of the lookup.
+ *
+ * @param[in] p
+ *   The parser context.
+ *
+ * @param[in] idx
+ *   The index of the array (or object) token.
+ *
+ * @param[in] n
+ *   The position of the element (0 for the first element).
+ *
+ * @return
+ *   The index of the element, or MXJSON_IDX_NONE if n is not less than the
+ *   number of elements.
+ */
+static inline mxjson_idx_t mxjson_array_at(mxjson_parser_t *p,
+                                           mxjson_idx_t     idx,
+                                           size_t           n);
+
+
+/**
+ * Binary search a sorted array of numbers.
+ *
+ * The elements of the array must all be numbers, in ascending order. The
+ * elements are located using mxjson_array_at(), so the search is
+ * O(log n) for an array of numbers.
+ *
+ * @param[in] p
+ *   The parser context.
+ *
+ * @param[in] idx
+ *   The index of the array token.
+ *
+ * @param[in] value
+ *   The value to search for.
+ *
+ * @param[out] pos
+ *   Set to the position of the first element that is not less than the
+ *   value (the number of elements if there is none), which is where the
+ *   value would be inserted to keep the array sorted.
+ *
+ * @return
+ *   Indicates whether the element at pos is equal to the value.
+ */
+static inline bool mxjson_array_search(mxjson_parser_t *p,
+                                       mxjson_idx_t     idx,
+                                       double           value,
+                                       size_t          *pos);
+
+
+/**
+ * Reorder the parsed tokens so that the children of each object or array
+ * are consecutive.
+ *
+ * mxjson_parse() produces the tokens in depth-first order, so the children
+ * of an object or array are separated by the descendants of the earlier
+ * children, and scanning the members of a large object with nested values
+ * reads most of the token array. In breadth-first order the root is at
+ * index 1, followed by its children, followed by their children (grouped by
+ * parent) and so on, so a scan of the children of any token reads
+ * consecutive tokens, and mxjson_array_at() is O(1) for every array.
+ *
+ * The next field of an object or array then gives the index of its first
+ * child, and mxjson_first(), mxjson_next() and mxjson_end() iterate over
+ * children as described for each of those functions. The parent, depth
+ * and input offsets of the tokens are unchanged. Iteration using
+ * mxjson_end() and the lookup functions work in either order, but
+ * mxjson_write(), mxjson_detach(), mxjson_tape_save() and mxjson_expand()
+ * require tokens in depth-first order, and fail if they are called after
+ * this. The order is reset to depth-first by the next call to
+ * mxjson_parse().
+ *
+ * Temporary memory for a copy of the tokens is allocated with malloc().
+ *
+ * @param[in] p
+ *   The parser context, containing the result of a successful call to
+ *   mxjson_parse().
+ */
+static inline void mxjson_breadth_first(mxjson_parser_t *p);
+
+
+/**
+ * Limit the depth to which the input is tokenized.
+ *
+ * Objects and arrays at the given depth or deeper (where the top level
+ * value is at depth 0) are validated, but not tokenized: each is stored as
+ * a single MXJSON_RAW token, with str and str_size giving its text. This
+ * avoids the cost of tokenizing values that may not be read, e.g. the
+ * payload of an envelope-style message, which is parsed with a depth of 1
+ * to tokenize just the top level object and its members (with the members'
+ * objects and arrays as MXJSON_RAW tokens). An MXJSON_RAW token may be
+ * tokenized later with mxjson_expand() or mxjson_expand_to().
+ *
+ * The input is validated as for mxjson_parse() (including the maximum
+ * nesting depth), so the result of mxjson_parse() is unchanged. The limit
+ * applies to all later calls to mxjson_parse() for the parser context.
+ *
+ * @param[in] p
+ *   The parser context.
+ *
+ * @param[in] depth
+ *   The depth of the objects and arrays that are not tokenized, or 0 for no
+ *   limit.
+ */
+static inline void mxjson_lazy_depth(mxjson_parser_t *p, uint32_t depth);
+
+
+/**
+ * Tokenize an MXJSON_RAW token into a separate parser context.
+ *
+ * The text of the token is parsed by the child parser context (using its
+ * depth limit), so the offsets in its tokens are relative to the text of
+ * the token. The child parser context references the input of the parser
+ * context.
+ *
+ * @param[in] p
+ *   The parser context containing the token.
+ *
+ * @param[in] idx
+ *   The index of the MXJSON_RAW token.
+ *
+ * @param[in] child
+ *   The parser context to parse the token into.
+ *
+ * @return
+ *   Indicates whether the parsing was successful.
+ */
+static inline bool mxjson_expand_to(mxjson_parser_t *p,
+                                    mxjson_idx_t     idx,
+                                    mxjson_parser_t *child);
+
+
+/**
+ * Tokenize an MXJSON_RAW token in place.
+ *
+ * The token is replaced by the tokens for the object or array (using the
+ * depth limit of the parser context, relative to the token), and the tokens
+ * following it are moved up, so the cost is proportional to the number of
+ * tokens in the parser context. Indices of tokens after idx, and the array
+ * offset tables, are invalidated. mxjson_expand_to() avoids the move when
+ * many values are expanded.
+ *
+ * @param[in] p
+ *   The parser context containing the token, in depth-first order.
+ *
+ * @param[in] idx
+ *   The index of the MXJSON_RAW token.
+ *
+ * @return
+ *   Indicates whether the token was expanded. false is returned if the
+ *   token array could not be resized, or the tokens have been reordered by
+ *   mxjson_breadth_first().
+ */
+static inline bool mxjson_expand(mxjson_parser_t *p, mxjson_idx_t idx);
+
+
+#if MXJSON_STATS
+/**
+ * Get the statistics for the last parse.
+ *
+ * Only available when MXJSON_STATS is enabled. The statistics are
+ * returned as a copy, so that they can be kept (e.g. to be added to
+ * totals across parses, or pushed to a metrics system) after the parser
+ * context is reused.
+ *
+ * @param[in] p
+ *   The parser context.
+ *
+ * @return
+ *   The statistics for the last call to mxjson_parse() or
+ *   mxjson_parse_padded(). The statistics do not cover mxjson_validate(),
+ *   which has no parser context.
+ */
+static inline mxjson_stats_t mxjson_stats(mxjson_parser_t *p);
+#endif
+
+
 /*
  * ----------------------------------------------------------------------
  * External API
@@ -464,6 +1034,35 @@ static inline mxstr_t mxjson_token_string(mxjson_parser_t *p,
 static inline bool mxjson_parse(mxjson_parser_t *p, mxstr_t json);
 
 
+/**
+ * Parse a JSON input that is followed by MXJSON_PADDING bytes of padding.
+ *
+ * This is the same as mxjson_parse(), except that the caller guarantees
+ * that the MXJSON_PADDING bytes following the input (from json.ptr[json.len]
+ * onwards) are readable, and that json.ptr[json.len] is '\0'. The lexer
+ * then reads ahead unconditionally rather than checking the remaining
+ * length before each character. The padding is not part of the input, and
+ * json.len must not include it.
+ *
+ * A padded buffer can be produced with mxbuf_pad():
+ *
+ *     mxbuf_write(&buf, json);
+ *     mxbuf_pad(&buf, MXJSON_PADDING);
+ *     valid = mxjson_parse_padded(&p, mxbuf_str(&buf));
+ *
+ * @param[in] p
+ *   The parser context. This must have been previously initialised by a
+ *   call to mxjson_init.
+ *
+ * @param[in] json
+ *   A string containing the JSON to parse, followed by the padding.
+ *
+ * @return
+ *   Indicates whether the parsing was successful (as mxjson_parse()).
+ */
+static inline bool mxjson_parse_padded(mxjson_parser_t *p, mxstr_t json);
+
+
 /**
  * Frees resources in the parser context.
  *
@@ -558,12 +1157,93 @@ static inline void mxjson_init(mxjson_parser_t  *p,
                                mxjson_resize_cb  resize_fn);
 
 
-/*
- * ----------------------------------------------------------------------
- * Internal Implementation
+/**
+ * Validate a JSON input, without producing any tokens.
+ *
+ * The input is checked against the same grammar, and with the same
+ * nesting limit (MXJSON_MAX_DEPTH), as mxjson_parse(), so the result is
+ * identical to the result of a successful mxjson_parse() call. No parser
+ * context or tokens are needed, and the only state kept is a bit per
+ * nesting level (object or array), so the memory used is constant and
+ * small, regardless of the size of the input.
+ *
+ * @param[in] json
+ *   A string containing the JSON to validate.
+ *
+ * @return
+ *   Indicates whether the input is valid JSON.
+ */
+static inline bool mxjson_validate(mxstr_t json);
+
+
+/*
+ * ----------------------------------------------------------------------
+ * Internal Implementation
  * ----------------------------------------------------------------------
  */
 
+/*
+ * Statistics collection
+ *
+ * The parser updates the statistics in the parser context through these
+ * macros, which expand to nothing when MXJSON_STATS is disabled. A phase
+ * is timed by declaring a uint64_t (only when MXJSON_STATS is enabled),
+ * setting it with MXJSON_STATS_START() and then adding the elapsed cycles
+ * with MXJSON_STATS_PHASE().
+ */
+#if MXJSON_STATS
+#define MXJSON_STATS_ADD(p_, field_, n_) ((p_)->stats.field_ += (n_))
+#define MXJSON_STATS_MAX(p_, field_, n_) \
+    ((p_)->stats.field_ = max((p_)->stats.field_, (n_)))
+#define MXJSON_STATS_VALUE(p_, type_, len_) \
+    ((p_)->stats.values[type_]++, (p_)->stats.value_bytes[type_] += (len_))
+#define MXJSON_STATS_ESCAPES(p_, str_, esc_flag_) \
+    ((p_)->stats.escapes += (esc_flag_) ? mxjson_stats_escapes(str_) : 0)
+#define MXJSON_STATS_START(cycles_) ((cycles_) = MXJSON_STATS_CLOCK())
+#define MXJSON_STATS_PHASE(p_, phase_, cycles_) \
+    ((p_)->stats.cycles[phase_] += MXJSON_STATS_CLOCK() - (cycles_))
+#else
+#define MXJSON_STATS_ADD(p_, field_, n_) ((void)0)
+#define MXJSON_STATS_MAX(p_, field_, n_) ((void)0)
+#define MXJSON_STATS_VALUE(p_, type_, len_) ((void)0)
+#define MXJSON_STATS_ESCAPES(p_, str_, esc_flag_) ((void)0)
+#define MXJSON_STATS_START(cycles_) ((void)0)
+#define MXJSON_STATS_PHASE(p_, phase_, cycles_) ((void)0)
+#endif
+
+
+#if MXJSON_STATS
+/**
+ * \internal
+ * Count the escape sequences in a JSON string value.
+ *
+ * Only called for strings that are known to contain escape sequences, so
+ * that strings without escapes are not scanned again.
+ *
+ * @param[in] str
+ *   The string value (without the quotes), which must be valid.
+ *
+ * @return
+ *   The number of escape sequences.
+ */
+static inline uint64_t
+mxjson_stats_escapes (mxstr_t str)
+{
+    uint64_t count = 0;
+    size_t   i;
+
+    for (i = 0; i < str.len; i++) {
+        if (str.ptr[i] == '\\') {
+            count++;
+            i++;
+        }
+    }
+
+    return count;
+}
+#endif
+
+
 /**
  * \internal
  * Consume whitespace characters.
@@ -579,24 +1259,347 @@ static inline void mxjson_init(mxjson_parser_t  *p,
  *   The string to process. The string is updated to consume any JSON
  *   whitespace characters at the start of the string.
  *
+ * @param[in] padded
+ *   Set if the string is followed by padding (see mxjson_parse_padded()),
+ *   in which case the length of the string is not checked.
+ *
  * @return
  *   Always returns true, indicating that zero or more whitespace characters
  *   have been consumed.
  */
 static inline bool
-mxjson_consume_ws (mxstr_t *str)
+mxjson_consume_ws (mxstr_t *str, bool padded)
 {
-    mxstr_t s = *str;
-    uint8_t c;
+    mxstr_t              s = *str;
+    const unsigned char *ptr = s.ptr;
+    uint8_t              c;
 
-    mxstr_consume_chars(&s, &c, (c == ' ') || (c == '\n') ||
-                        (c == '\r') || (c == '\t'));
+    if (padded) {
+        while (*ptr == ' ' || *ptr == '\n' || *ptr == '\r' || *ptr == '\t') {
+            ptr++;
+        }
+        (void)mxstr_consume(&s, ptr - s.ptr);
+    } else {
+        mxstr_consume_chars(&s, &c, (c == ' ') || (c == '\n') ||
+                            (c == '\r') || (c == '\t'));
+    }
     *str = s;
 
     return true;
 }
 
 
+/**
+ * \internal
+ * Check whether a character may appear as-is inside a JSON string value -
+ * i.e. anything other than '"', '\' or a control character (< 0x20).
+ */
+static inline bool
+mxjson_plain_char (unsigned char c)
+{
+    return (c >= ' ' && c != '\"' && c != '\\');
+}
+
+
+/*
+ * SIMD kernels
+ *
+ * Each kernel returns the length of the prefix of a buffer consisting of a
+ * class of characters:
+ *
+ * - string_span: plain string characters (see mxjson_plain_char()).
+ *
+ * The kernels are provided for several instruction set levels. When
+ * MXJSON_DISPATCH is enabled, all of the x86-64 kernels are compiled
+ * (using target attributes, so no -march option is required), and the best
+ * set for the host is selected at runtime. Otherwise, the best kernels for
+ * the compile time target are used directly.
+ *
+ * There are no kernels for whitespace or numbers: whitespace between
+ * tokens is usually a single character and numbers are short, so the
+ * overhead of calling a kernel outweighs any gain. The parser does not
+ * validate UTF-8 (string bytes >= 0x80 are passed through), so there is no
+ * UTF-8 kernel.
+ */
+
+/**
+ * \internal
+ * Scalar string_span kernel.
+ */
+static inline size_t
+mxjson_string_span_scalar (const unsigned char *ptr, size_t len)
+{
+    size_t i = 0;
+
+    while (i < len && mxjson_plain_char(ptr[i])) {
+        i++;
+    }
+
+    return i;
+}
+
+
+#if defined(__SSE2__) || MXJSON_DISPATCH
+/**
+ * \internal
+ * SSE2 string_span kernel, checking 16 characters at a time.
+ */
+MXJSON_TARGET("sse2") static inline size_t
+mxjson_string_span_sse2 (const unsigned char *ptr, size_t len)
+{
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    __m128i       v;
+    __m128i       m;
+    size_t        i = 0;
+    int           mask = 0;
+
+    while (mask == 0 && i + 16 <= len) {
+        v = _mm_loadu_si128((const __m128i *)&ptr[i]);
+
+        /*
+         * An unsigned (v <= 0x1f) comparison is done as min(v, 0x1f) == v.
+         */
+        m = _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                         _mm_cmpeq_epi8(v, backslash));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(v, control), v));
+        mask = _mm_movemask_epi8(m);
+
+        i += (mask == 0) ? 16 : (size_t)__builtin_ctz(mask);
+    }
+
+    /*
+     * Scalar handling for the tail. If the vector loop found a non-plain
+     * character, this returns immediately.
+     */
+    return i + mxjson_string_span_scalar(&ptr[i], len - i);
+}
+
+
+#endif
+
+
+#if defined(__AVX2__) || MXJSON_DISPATCH
+/**
+ * \internal
+ * AVX2 string_span kernel, checking 32 characters at a time.
+ */
+MXJSON_TARGET("avx2") static inline size_t
+mxjson_string_span_avx2 (const unsigned char *ptr, size_t len)
+{
+    const __m256i quote = _mm256_set1_epi8('\"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i control = _mm256_set1_epi8(0x1f);
+    __m256i       v;
+    __m256i       m;
+    size_t        i = 0;
+    uint32_t      mask = 0;
+
+    while (mask == 0 && i + 32 <= len) {
+        v = _mm256_loadu_si256((const __m256i *)&ptr[i]);
+        m = _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                            _mm256_cmpeq_epi8(v, backslash));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(_mm256_min_epu8(v, control),
+                                                 v));
+        mask = (uint32_t)_mm256_movemask_epi8(m);
+
+        i += (mask == 0) ? 32 : (size_t)__builtin_ctz(mask);
+    }
+
+    return (mask != 0) ? i : i + mxjson_string_span_sse2(&ptr[i], len - i);
+}
+
+
+#endif
+
+
+#if defined(__AVX512BW__) || MXJSON_DISPATCH
+/**
+ * \internal
+ * AVX-512 string_span kernel, checking 64 characters at a time. The tail
+ * is handled with a masked load, so no scalar loop is needed.
+ */
+MXJSON_TARGET("avx512bw") static inline size_t
+mxjson_string_span_avx512 (const unsigned char *ptr, size_t len)
+{
+    const __m512i quote = _mm512_set1_epi8('\"');
+    const __m512i backslash = _mm512_set1_epi8('\\');
+    const __m512i control = _mm512_set1_epi8(0x1f);
+    __m512i       v;
+    __mmask64     load;
+    __mmask64     mask = 0;
+    size_t        i = 0;
+
+    while (mask == 0 && i < len) {
+        load = (len - i >= 64) ? ~(__mmask64)0 :
+                                 (((__mmask64)1 << (len - i)) - 1);
+        v = _mm512_maskz_loadu_epi8(load, &ptr[i]);
+        mask = (_mm512_cmpeq_epi8_mask(v, quote) |
+                _mm512_cmpeq_epi8_mask(v, backslash) |
+                _mm512_cmple_epu8_mask(v, control)) & load;
+
+        i += (mask == 0) ? min(len - i, 64) : (size_t)__builtin_ctzll(mask);
+    }
+
+    return i;
+}
+
+
+#endif
+
+
+/**
+ * A set of SIMD kernels for an instruction set level.
+ */
+typedef struct {
+    const char *name;                                       /**< ISA name */
+    size_t    (*string_span)(const unsigned char *, size_t); /**< Strings */
+} mxjson_kernels_t;
+
+
+#if MXJSON_DISPATCH
+/**
+ * \internal
+ * Kernels selected for the host, or NULL if not yet selected.
+ *
+ * Note: As mxjson is header-only, each translation unit has its own copy,
+ * and performs its own selection.
+ */
+static const mxjson_kernels_t *mxjson_kernels_selected = NULL;
+
+
+/**
+ * \internal
+ * Select the best SIMD kernels supported by the host.
+ *
+ * This is kept separate from mxjson_kernels() so that the selection code
+ * is not inlined into the parser.
+ *
+ * @return
+ *   The kernels to use.
+ */
+static const mxjson_kernels_t *
+mxjson_kernels_select (void)
+{
+    static const mxjson_kernels_t  sse2 = {
+        "sse2", mxjson_string_span_sse2
+    };
+    static const mxjson_kernels_t  avx2 = {
+        "avx2", mxjson_string_span_avx2
+    };
+    static const mxjson_kernels_t  avx512 = {
+        "avx512bw", mxjson_string_span_avx512
+    };
+    const mxjson_kernels_t        *kernels;
+
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512bw")) {
+        kernels = &avx512;
+    } else if (__builtin_cpu_supports("avx2")) {
+        kernels = &avx2;
+    } else {
+        kernels = &sse2;
+    }
+
+    /*
+     * Concurrent first calls all select the same kernels, so there is no
+     * need for any stronger synchronisation.
+     */
+    __atomic_store_n(&mxjson_kernels_selected, kernels, __ATOMIC_RELAXED);
+
+    return kernels;
+}
+#endif
+
+
+/**
+ * \internal
+ * Get the SIMD kernels to use.
+ *
+ * With MXJSON_DISPATCH, the CPU features are checked on the first call,
+ * and the best kernels supported by the host are used from then on.
+ * Otherwise, the kernels for the compile time target are used.
+ *
+ * @return
+ *   The kernels to use.
+ */
+static inline const mxjson_kernels_t *
+mxjson_kernels (void)
+{
+#if MXJSON_DISPATCH
+    const mxjson_kernels_t *kernels;
+
+    kernels = __atomic_load_n(&mxjson_kernels_selected, __ATOMIC_RELAXED);
+
+    if (kernels == NULL) {
+        kernels = mxjson_kernels_select();
+    }
+
+    return kernels;
+#else
+    static const mxjson_kernels_t kernels = {
+#if defined(__AVX512BW__)
+        "avx512bw", mxjson_string_span_avx512
+#elif defined(__AVX2__)
+        "avx2", mxjson_string_span_avx2
+#elif defined(__SSE2__)
+        "sse2", mxjson_string_span_sse2
+#else
+        "scalar", mxjson_string_span_scalar
+#endif
+    };
+
+    return &kernels;
+#endif
+}
+
+
+/**
+ * \internal
+ * Find the length of the plain prefix of a JSON string.
+ *
+ * A plain character is one that may appear as-is inside a JSON string
+ * value (see mxjson_plain_char()). Most strings (particularly object
+ * member names) are short, so the first few characters are checked inline,
+ * and the SIMD kernel is only called for longer strings.
+ *
+ * @param[in] ptr
+ *   The characters to check.
+ *
+ * @param[in] len
+ *   The number of characters to check.
+ *
+ * @param[in] padded
+ *   Set if the characters are followed by padding (see
+ *   mxjson_parse_padded()). The '\0' following the characters ends the
+ *   span, so the inline checks don't need to test the length, and the
+ *   kernel is allowed to read into the padding.
+ *
+ * @return
+ *   The number of characters before the first character that is not
+ *   plain, or len if all the characters are plain.
+ */
+static inline size_t
+mxjson_string_span (const unsigned char *ptr, size_t len, bool padded)
+{
+    size_t i = 0;
+    size_t n = padded ? 8 : min(len, 8);
+
+    while (i < n && mxjson_plain_char(ptr[i])) {
+        i++;
+    }
+
+    if (i == 8) {
+        i += mxjson_kernels()->string_span(&ptr[i], len - i +
+                                           (padded ? MXJSON_PADDING : 0));
+    }
+
+    return i;
+}
+
+
 /**
  * \internal
  * Parse a JSON number from the start of a string.
@@ -666,6 +1669,126 @@ mxjson_parse_number (mxstr_t *str, mxstr_t *value)
 }
 
 
+/**
+ * \internal
+ * Parse a JSON number from the start of a padded string.
+ *
+ * See mxjson_parse_number(). The string must be followed by padding (see
+ * mxjson_parse_padded()), so characters are read without checking the
+ * length of the string. The '\0' following the string ends the number.
+ */
+static inline bool
+mxjson_parse_number_padded (mxstr_t *str, mxstr_t *value)
+{
+    mxstr_t              s = *str;
+    const unsigned char *ptr = s.ptr;
+    bool                 ok;
+
+    /*
+     * Optional '-' followed by at least one digit. If the first digit is
+     * not '0', there may be zero or more successive digits.
+     */
+    ptr += (*ptr == '-');
+    ok = isdigit(*ptr);
+
+    if (ok) {
+        if (*ptr++ != '0') {
+            while (isdigit(*ptr)) {
+                ptr++;
+            }
+        }
+
+        /*
+         * Optional '.' followed by one or more digits.
+         */
+        if (*ptr == '.') {
+            ptr++;
+            ok = isdigit(*ptr);
+
+            while (isdigit(*ptr)) {
+                ptr++;
+            }
+        }
+    }
+
+    /*
+     * Optional 'e' or 'E' followed by optional '+' or '-' followed by
+     * one or more digits.
+     */
+    if (ok && (*ptr == 'e' || *ptr == 'E')) {
+        ptr++;
+        ptr += (*ptr == '+' || *ptr == '-');
+        ok = isdigit(*ptr);
+
+        while (isdigit(*ptr)) {
+            ptr++;
+        }
+    }
+
+    (void)mxstr_consume(&s, ptr - s.ptr);
+
+    if (ok) {
+        /*
+         * Store the parsed value.
+         */
+        *value = mxstr_prefix(*str, s);
+    }
+
+    *str = s;
+
+    return ok;
+}
+
+
+/**
+ * \internal
+ * Consume a JSON literal (true, false or null) from the start of a string.
+ *
+ * The first character of the literal must already have been matched (by
+ * the dispatch on the first character of a value), and the remaining
+ * characters are compared as a single unaligned 4-byte word: the whole of
+ * "true" and "null", or "alse" for "false". The literal is a constant, so
+ * the comparison is reduced to a load and a compare against an immediate.
+ *
+ * @param[in,out] str
+ *   The string to parse. The literal is consumed from the start of the
+ *   string if it matches.
+ *
+ * @param[in] literal
+ *   The literal to match (4 or 5 characters).
+ *
+ * @param[in] padded
+ *   Set if the string is followed by padding (see mxjson_parse_padded()),
+ *   in which case the length of the string is not checked before the
+ *   comparison.
+ *
+ * @return
+ *   Indicates whether the literal was matched.
+ */
+static inline bool
+mxjson_consume_literal (mxstr_t *str, mxstr_t literal, bool padded)
+{
+    size_t   offset = literal.len - sizeof(uint32_t);
+    uint32_t expected;
+    uint32_t actual;
+    bool     ok;
+
+    ok = (padded || str->len >= literal.len);
+
+    if (ok) {
+        memcpy(&expected, &literal.ptr[offset], sizeof(expected));
+        memcpy(&actual, &str->ptr[offset], sizeof(actual));
+        ok = (actual == expected);
+    }
+
+    if (ok) {
+        (void)mxstr_consume(str, literal.len);
+    }
+
+    return ok;
+}
+
+
 /**
  * \internal
  * Parse an escaped character
@@ -741,32 +1864,46 @@ mxjson_parse_escaped_char (mxstr_t *str, bool *esc_flag)
  *   Set to indicate whether there are esccape sequences present in the
  *   string value.
  *
+ * @param[in] padded
+ *   Set if the string is followed by padding (see mxjson_parse_padded()).
+ *
  * @return
  *   Indicates whether the string value was successfully parsed.
  */
 static inline bool
-mxjson_parse_string (mxstr_t *str, mxstr_t *value, bool *esc_flag)
+mxjson_parse_string (mxstr_t *str, mxstr_t *value, bool *esc_flag,
+                     bool padded)
 {
     mxstr_t s = *str;
     mxstr_t start;
     bool    ok;
+    bool    more;
     uint8_t c = '\0';
 
     /*
      * Consume the opening quote character.
      */
-    ok = mxstr_consume_char(&s, &c, (c == '\"')) && !mxstr_empty(s);
+    ok = mxstr_consume_char(&s, &c, (c == '\"'));
     start = s;
 
     /*
-     * Continue consuming characters until either an invalid character
-     * is encountered, or the closing quote is reached.
+     * Consume runs of plain characters, and any escape sequences that
+     * follow them, until either an invalid character is encountered, or
+     * the closing quote is reached.
      */
-    while (ok && mxstr_consume_char(&s, &c, (c >= ' ') && (c != '\"'))) {
-        ok = (c != '\\' || mxjson_parse_escaped_char(&s, esc_flag));
+    more = ok;
+
+    while (more) {
+        (void)mxstr_consume(&s, mxjson_string_span(s.ptr, s.len, padded));
+        more = mxstr_consume_char(&s, &c, (c == '\\'));
+
+        if (more) {
+            ok = mxjson_parse_escaped_char(&s, esc_flag);
+            more = ok;
+        }
     }
 
-    if (ok && c == '\"') {
+    if (ok && mxstr_getchar(s, &c) && c == '\"') {
         /*
          * Get the string from the position immediately after the opening
          * quote to the current position (immediately before the closing
@@ -790,12 +1927,48 @@ mxjson_parse_string (mxstr_t *str, mxstr_t *value, bool *esc_flag)
 
 /**
  * \internal
- * Allocate a new token in the parser context.
+ * Call the resize function to allocate a larger tokens array.
  *
- * If no tokens are available, the tokens array is resized, provided a
- * resize callback function was passed to mxjson_init().
+ * @param[in] p
+ *   The parser context.
  *
- * The token is not returned explicitly. Instead, the token pointer in
+ * @param[in] size_hint
+ *   The size of tokens array to request (see mxjson_resize_cb()).
+ *
+ * @return
+ *   Indicates whether the tokens array was resized. false is returned if
+ *   there is no resize function.
+ */
+static inline bool
+mxjson_token_resize (mxjson_parser_t *p, mxjson_idx_t size_hint)
+{
+    bool     ok;
+#if MXJSON_STATS
+    uint64_t cycles;
+#endif
+
+    ok = (p->resize_fn != NULL);
+
+    if (ok) {
+        MXJSON_STATS_ADD(p, resizes, 1);
+        MXJSON_STATS_ADD(p, resize_bytes, p->count * sizeof(*p->tokens));
+        MXJSON_STATS_START(cycles);
+        ok = p->resize_fn(p, size_hint);
+        MXJSON_STATS_PHASE(p, MXJSON_PHASE_RESIZE, cycles);
+    }
+
+    return ok;
+}
+
+
+/**
+ * \internal
+ * Allocate a new token in the parser context.
+ *
+ * If no tokens are available, the tokens array is resized, provided a
+ * resize callback function was passed to mxjson_init().
+ *
+ * The token is not returned explicitly. Instead, the token pointer in
  * the parser context is updated.
  *
  * @param[in] p
@@ -833,8 +2006,7 @@ mxjson_token (mxjson_parser_t *p)
                 /*
                  * Call the resize function to perform an allocation.
                  */
-                ok = (p->resize_fn != NULL &&
-                      p->resize_fn(p, max(p->idx + 1, p->init_count)));
+                ok = mxjson_token_resize(p, max(p->idx + 1, p->init_count));
             }
 
             if (ok) {
@@ -848,8 +2020,7 @@ mxjson_token (mxjson_parser_t *p)
             /*
              * Resize the existing tokens array, if possible.
              */
-            ok = (p->resize_fn != NULL &&
-                  p->resize_fn(p, mxutil_size_p2(p->count)));
+            ok = mxjson_token_resize(p, mxutil_size_p2(p->count));
         }
     }
 
@@ -859,6 +2030,9 @@ mxjson_token (mxjson_parser_t *p)
         token = &p->tokens[idx];
         memset(token, 0, sizeof(*token));
         token->parent = p->current_parent;
+#if MXJSON_DEPTH
+        token->depth = p->depth;
+#endif
         parent = &p->tokens[p->current_parent];
         parent->children++;
 
@@ -891,26 +2065,36 @@ mxjson_token (mxjson_parser_t *p)
  *   the start of the string. On error, characters are consumed up to the
  *   point the error is detected.
  *
+ * @param[in] padded
+ *   Set if the input is followed by padding (see mxjson_parse_padded()).
+ *
  * @return
  *   Indicates whether the object member name was successfully parsed.
  */
 static inline bool
-mxjson_parse_name (mxjson_parser_t *p, mxstr_t *str)
+mxjson_parse_name (mxjson_parser_t *p, mxstr_t *str, bool padded)
 {
     mxstr_t       s = *str;
     mxstr_t       name;
     unsigned char c;
     bool          esc_flag = false;
     bool          ok;
+#if MXJSON_STATS
+    uint64_t      cycles;
+#endif
 
-    ok = (mxjson_parse_string(&s, &name, &esc_flag) &&
-          mxjson_consume_ws(&s) &&
+    MXJSON_STATS_START(cycles);
+    ok = mxjson_parse_string(&s, &name, &esc_flag, padded);
+    MXJSON_STATS_PHASE(p, MXJSON_PHASE_STRING, cycles);
+    ok = (ok && mxjson_consume_ws(&s, padded) &&
           mxstr_consume_char(&s, &c, (c == ':')));
 
     if (ok) {
         p->token->name = mxstr_substr_offset(p->json, name);
         p->token->name_size = name.len;
         p->token->name_esc = esc_flag;
+        MXJSON_STATS_ADD(p, name_bytes, name.len + 2);
+        MXJSON_STATS_ESCAPES(p, name, esc_flag);
     }
 
     *str = s;
@@ -919,6 +2103,209 @@ mxjson_parse_name (mxjson_parser_t *p, mxstr_t *str)
 }
 
 
+/**
+ * \internal
+ * Validate a JSON value at the start of a string, without tokenizing it.
+ *
+ * @param[in,out] str
+ *   The string to parse. The JSON value (and any whitespace before it) is
+ *   consumed from the start of the string. On error, characters are
+ *   consumed up to the point the error is detected.
+ *
+ * @param[in] padded
+ *   Set if the input is followed by padding (see mxjson_parse_padded()).
+ *
+ * @param[in] max_depth
+ *   The maximum nesting depth of objects and arrays.
+ *
+ * @return
+ *   Indicates whether a JSON value was successfully validated.
+ */
+static inline bool
+mxjson_skip (mxstr_t *str, bool padded, uint32_t max_depth)
+{
+    mxstr_t  s = *str;
+    mxstr_t  value;
+    uint64_t objects[(MXJSON_MAX_DEPTH + 63) / 64];
+    uint32_t depth = 0;
+    bool     esc_flag = false;
+    bool     opened;
+    bool     object = false;
+    bool     ascend;
+    bool     ok;
+    uint8_t  c;
+
+    do {
+        /*
+         * Validate a value. For an object/array, just the opening brace
+         * is consumed, and the nesting level is pushed onto the bit stack
+         * of objects.
+         */
+        mxjson_consume_ws(&s, padded);
+        ok = mxstr_getchar(s, &c);
+        opened = false;
+
+        if (ok) {
+            switch (c) {
+            case '\"':
+                ok = mxjson_parse_string(&s, &value, &esc_flag, padded);
+                break;
+
+            case '{':
+            case '[':
+                (void)mxstr_consume(&s, 1);
+                ok = (depth < max_depth);
+
+                if (ok) {
+                    if (c == '{') {
+                        objects[depth / 64] |= (UINT64_C(1) << (depth % 64));
+                    } else {
+                        objects[depth / 64] &= ~(UINT64_C(1) << (depth % 64));
+                    }
+                    depth++;
+                    opened = true;
+                }
+                break;
+
+            case 't':
+                ok = mxjson_consume_literal(&s, mxstr_literal("true"),
+                                            padded);
+                break;
+
+            case 'f':
+                ok = mxjson_consume_literal(&s, mxstr_literal("false"),
+                                            padded);
+                break;
+
+            case 'n':
+                ok = mxjson_consume_literal(&s, mxstr_literal("null"),
+                                            padded);
+                break;
+
+            case '-':
+            case '0': case '1': case '2': case '3': case '4':
+            case '5': case '6': case '7': case '8': case '9':
+                ok = (padded ? mxjson_parse_number_padded(&s, &value) :
+                      mxjson_parse_number(&s, &value));
+                break;
+
+            default:
+                ok = false;
+                break;
+            }
+        }
+
+        /*
+         * Consume any closing braces.
+         */
+        ascend = ok;
+
+        while (ascend && depth != 0) {
+            object = (objects[(depth - 1) / 64] >> ((depth - 1) % 64)) & 1;
+            mxjson_consume_ws(&s, padded);
+            ascend = mxstr_consume_char(&s, &c, c == (object ? '}' : ']'));
+
+            if (ascend) {
+                depth--;
+                opened = false;
+            }
+        }
+
+        /*
+         * Consume the ',' (unless this is the first member of an
+         * object/array) and the name and ':' for an object member.
+         */
+        if (ok && depth != 0) {
+            ok = (opened || mxstr_consume_char(&s, &c, c == ','));
+
+            if (ok && object) {
+                mxjson_consume_ws(&s, padded);
+                ok = (mxjson_parse_string(&s, &value, &esc_flag, padded) &&
+                      mxjson_consume_ws(&s, padded) &&
+                      mxstr_consume_char(&s, &c, (c == ':')));
+            }
+        }
+    } while (ok && depth != 0);
+
+    *str = s;
+
+    return ok;
+}
+
+
+/**
+ * \internal
+ * Parse an object or array at or below the depth limit (see
+ * mxjson_lazy_depth()) as an MXJSON_RAW token.
+ *
+ * @param[in] p
+ *   The parser context.
+ *
+ * @param[in,out] str
+ *   The string to parse, starting with the opening brace of the value.
+ *
+ * @param[in] padded
+ *   Set if the input is followed by padding (see mxjson_parse_padded()).
+ *
+ * @return
+ *   Indicates whether the value was successfully validated.
+ */
+static inline bool
+mxjson_parse_raw (mxjson_parser_t *p, mxstr_t *str, bool padded)
+{
+    mxstr_t start = *str;
+    bool    ok;
+
+    /*
+     * The value is limited to the nesting depth remaining, so that the
+     * input is accepted only if mxjson_parse() would accept it without a
+     * depth limit.
+     */
+    ok = mxjson_skip(str, padded, MXJSON_MAX_DEPTH - p->depth);
+
+    if (ok) {
+        p->token->value_type = MXJSON_RAW;
+        p->token->str = mxstr_substr_offset(p->json, start);
+        p->token->str_size = mxstr_prefix(start, *str).len;
+    }
+
+    return ok;
+}
+
+
+/**
+ * \internal
+ * Push the current token onto the parse stack, making it the parent for
+ * the tokens that follow.
+ *
+ * @param[in] p
+ *   The parser context.
+ *
+ * @param[in] flags
+ *   MXJSON_STACK_OBJECT for an object, or 0 for an array.
+ *
+ * @return
+ *   Indicates whether the token was pushed. false is returned if the
+ *   maximum nesting depth (MXJSON_MAX_DEPTH) has been reached.
+ */
+static inline bool
+mxjson_push (mxjson_parser_t *p, mxjson_idx_t flags)
+{
+    bool ok;
+
+    ok = (p->depth < MXJSON_MAX_DEPTH);
+
+    if (ok) {
+        p->stack[p->depth] = p->idx | flags;
+        p->depth++;
+        p->current_parent = p->idx;
+        MXJSON_STATS_MAX(p, max_depth, p->depth);
+    }
+
+    return ok;
+}
+
+
 /**
  * \internal
  * Parse a JSON value from the start of a string
@@ -933,18 +2320,29 @@ mxjson_parse_name (mxjson_parser_t *p, mxstr_t *str)
  *   string, On error, characters are consumed up to the point the error is
  *   detected.
  *
+ * @param[in] padded
+ *   Set if the input is followed by padding (see mxjson_parse_padded()).
+ *
  * @return
  *   Indicates whether a JSON value was successfully parsed.
  */
 static inline bool
 mxjson_parse_value (mxjson_parser_t *p,
-                    mxstr_t         *str)
+                    mxstr_t         *str,
+                    bool             padded)
 {
-    mxstr_t s = *str;
-    mxstr_t value;
-    bool    ok;
-    bool    esc_flag = false;
-    uint8_t c;
+    mxstr_t  s = *str;
+    mxstr_t  value;
+    bool     ok;
+    bool     esc_flag = false;
+    uint8_t  c;
+#if MXJSON_STATS
+    uint64_t cycles;
+#endif
+
+#if MXJSON_SPAN
+    p->token->raw = mxstr_substr_offset(p->json, s);
+#endif
 
     /*
      * The first character is used to identify the type of JSON value.
@@ -955,49 +2353,58 @@ mxjson_parse_value (mxjson_parser_t *p,
         switch (c) {
         case '\"':
             p->token->value_type = MXJSON_STRING;
-            ok = mxjson_parse_string(&s, &value, &esc_flag);
+            MXJSON_STATS_START(cycles);
+            ok = mxjson_parse_string(&s, &value, &esc_flag, padded);
+            MXJSON_STATS_PHASE(p, MXJSON_PHASE_STRING, cycles);
 
             if (ok) {
                 p->token->str = mxstr_substr_offset(p->json, value);
                 p->token->str_size = value.len;
                 p->token->value_esc = esc_flag;
+                MXJSON_STATS_ESCAPES(p, value, esc_flag);
             }
             break;
 
         case '{':
-            (void)mxstr_consume(&s, 1);
-            p->token->value_type = MXJSON_OBJECT;
-            p->current_parent = p->idx;
-            break;
-
         case '[':
-            (void)mxstr_consume(&s, 1);
-            p->token->value_type = MXJSON_ARRAY;
-            p->current_parent = p->idx;
+            if (p->lazy_depth != 0 && p->depth >= p->lazy_depth) {
+                ok = mxjson_parse_raw(p, &s, padded);
+            } else if (c == '{') {
+                (void)mxstr_consume(&s, 1);
+                p->token->value_type = MXJSON_OBJECT;
+                ok = mxjson_push(p, MXJSON_STACK_OBJECT);
+            } else {
+                (void)mxstr_consume(&s, 1);
+                p->token->value_type = MXJSON_ARRAY;
+                ok = mxjson_push(p, 0);
+            }
             break;
 
         case 't':
             p->token->value_type = MXJSON_BOOL;
             p->token->boolean = true;
-            ok = mxstr_consume_str(&s, mxstr_literal("true"));
+            ok = mxjson_consume_literal(&s, mxstr_literal("true"), padded);
             break;
 
         case 'f':
             p->token->value_type = MXJSON_BOOL;
             p->token->boolean = false;
-            ok = mxstr_consume_str(&s, mxstr_literal("false"));
+            ok = mxjson_consume_literal(&s, mxstr_literal("false"), padded);
             break;
 
         case 'n':
             p->token->value_type = MXJSON_NULL;
-            ok = mxstr_consume_str(&s, mxstr_literal("null"));
+            ok = mxjson_consume_literal(&s, mxstr_literal("null"), padded);
             break;
 
         case '-':
         case '0': case '1': case '2': case '3': case '4':
         case '5': case '6': case '7': case '8': case '9':
             p->token->value_type = MXJSON_NUMBER;
-            ok = mxjson_parse_number(&s, &value);
+            MXJSON_STATS_START(cycles);
+            ok = (padded ? mxjson_parse_number_padded(&s, &value) :
+                  mxjson_parse_number(&s, &value));
+            MXJSON_STATS_PHASE(p, MXJSON_PHASE_NUMBER, cycles);
 
             if (ok) {
                 p->token->str = mxstr_substr_offset(p->json, value);
@@ -1011,6 +2418,18 @@ mxjson_parse_value (mxjson_parser_t *p,
         }
     }
 
+    if (ok) {
+        MXJSON_STATS_VALUE(p, p->token->value_type, mxstr_prefix(*str, s).len);
+    }
+
+#if MXJSON_SPAN
+    /*
+     * The size for object/array values is set once the closing brace is
+     * reached.
+     */
+    p->token->raw_size = mxstr_substr_offset(p->json, s) - p->token->raw;
+#endif
+
     *str = s;
 
     return ok;
@@ -1029,38 +2448,44 @@ mxjson_parse_value (mxjson_parser_t *p,
  *   objects ('}') along with any whitespace are consumed from the start of
  *   the string.
  *
+ * @param[in] padded
+ *   Set if the input is followed by padding (see mxjson_parse_padded()).
+ *
  * @return
  *   The index for the enclosing array or object token for the current parse
  *   location, or MXJSON_IDX_NONE if the top level JSON value has been reached.
  */
 static inline mxjson_idx_t
-mxjson_ascend (mxjson_parser_t *p, mxstr_t *str)
+mxjson_ascend (mxjson_parser_t *p, mxstr_t *str, bool padded)
 {
     mxstr_t         s = *str;
     unsigned char   c;
-    mxjson_idx_t    parent;
-    bool            ascend = true;
-    mxjson_token_t *token = NULL;
-
-    parent = p->current_parent;
-
-    if (parent != MXJSON_IDX_NONE) {
-        do {
-            token = &p->tokens[parent];
-            mxjson_consume_ws(&s);
-
-            if ((token->value_type == MXJSON_ARRAY &&
-                 mxstr_consume_char(&s, &c, c == ']')) ||
-                (token->value_type == MXJSON_OBJECT &&
-                 mxstr_consume_char(&s, &c, c == '}'))) {
-                token->next = p->idx + 1;
-                parent = token->parent;
+    mxjson_idx_t    entry;
+    mxjson_idx_t    parent = MXJSON_IDX_NONE;
+    bool            ascend = (p->depth != 0);
+    mxjson_token_t *token;
 
-            } else {
-                ascend = false;
-            }
+    while (ascend) {
+        entry = p->stack[p->depth - 1];
+        mxjson_consume_ws(&s, padded);
+        ascend = mxstr_consume_char(&s, &c,
+                                    c == ((entry & MXJSON_STACK_OBJECT) ?
+                                          '}' : ']'));
+
+        if (ascend) {
+            token = &p->tokens[entry & ~MXJSON_STACK_OBJECT];
+            token->next = p->idx + 1;
+            MXJSON_STATS_ADD(p, value_bytes[token->value_type], 1);
+#if MXJSON_SPAN
+            token->raw_size = mxstr_substr_offset(p->json, s) - token->raw;
+#endif
+            p->depth--;
+            ascend = (p->depth != 0);
+        }
+    }
 
-        } while (ascend);
+    if (p->depth != 0) {
+        parent = p->stack[p->depth - 1] & ~MXJSON_STACK_OBJECT;
     }
 
     *str = s;
@@ -1076,13 +2501,16 @@ mxjson_ascend (mxjson_parser_t *p, mxstr_t *str)
  * @param[in] p
  *   The parser context containing a reference to the JSON to parse.
  *
+ * @param[in] padded
+ *   Set if the input is followed by padding (see mxjson_parse_padded()).
+ *
  * @return
  *   Indicates whether the parsing was successful. false is returned either
  *   when the JSON is invalid, or there were insufficient tokens in the
  *   parser context to complete the parsing.
  */
 static inline bool
-mxjson_parse_json (mxjson_parser_t *p)
+mxjson_parse_json (mxjson_parser_t *p, bool padded)
 {
     mxstr_t       s = p->unparsed;
     mxjson_idx_t  parent;
@@ -1090,11 +2518,11 @@ mxjson_parse_json (mxjson_parser_t *p)
     bool          ok;
 
     do {
-        mxjson_consume_ws(&s);
-        ok = mxjson_parse_value(p, &s);
+        mxjson_consume_ws(&s, padded);
+        ok = mxjson_parse_value(p, &s, padded);
 
         if (ok) {
-            parent = mxjson_ascend(p, &s);
+            parent = mxjson_ascend(p, &s, padded);
             p->current_parent = parent;
 
             if (parent != MXJSON_IDX_NONE) {
@@ -1102,16 +2530,16 @@ mxjson_parse_json (mxjson_parser_t *p)
                  * Move to the next JSON value in the object/array.
                  * A ',' is expected if this isn't the first entry.
                  */
-                mxjson_consume_ws(&s);
+                mxjson_consume_ws(&s, padded);
                 ok = ((parent == p->idx) ||
                       mxstr_consume_char(&s, &c, c == ',')) && mxjson_token(p);
 
                 /*
                  * Parse the name string and ':' for an object member.
                  */
-                if (ok && p->tokens[parent].value_type == MXJSON_OBJECT) {
-                    mxjson_consume_ws(&s);
-                    ok = mxjson_parse_name(p, &s);
+                if (ok && (p->stack[p->depth - 1] & MXJSON_STACK_OBJECT)) {
+                    mxjson_consume_ws(&s, padded);
+                    ok = mxjson_parse_name(p, &s, padded);
                 }
             }
         }
@@ -1121,7 +2549,7 @@ mxjson_parse_json (mxjson_parser_t *p)
         /*
          * Reject the input if there is anything left to parse.
          */
-        mxjson_consume_ws(&s);
+        mxjson_consume_ws(&s, padded);
         ok = mxstr_empty(s);
     }
 
@@ -1131,90 +2559,412 @@ mxjson_parse_json (mxjson_parser_t *p)
 }
 
 
+#if MXJSON_PARSE_FSM
+#if MXJSON_COMPUTED_GOTO
+/*
+ * Label addresses, computed goto and designated initializer ranges are GCC
+ * extensions (also supported by Clang).
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#pragma GCC diagnostic ignored "-Woverride-init"
+#define MXJSON_FSM_DISPATCH(table_, c_) goto *table_[c_]
+#else
+#define MXJSON_FSM_DISPATCH(table_, c_) goto value_switch
+#endif
+
 /**
  * \internal
- * Parse a 4-digit hex value
+ * Parse and validate a JSON input using a state machine.
+ *
+ * This is an alternative to mxjson_parse_json(), selected by the
+ * MXJSON_PARSE_FSM option, producing identical tokens. Each state is a
+ * label, and the transitions between states are gotos, so the parse
+ * position in the JSON hierarchy is encoded in the program counter rather
+ * than being rediscovered on each iteration. The only data dependent
+ * transitions are the dispatch on the first character of a value (via a
+ * table of label addresses when MXJSON_COMPUTED_GOTO is enabled, or a
+ * switch otherwise), and the choice between the object and array states
+ * after a value, which is made using the parse stack.
  *
- * @param[in] str
- *   The string to read from.
+ * @param[in] p
+ *   The parser context containing a reference to the JSON to parse. The
+ *   root token must already have been allocated.
  *
- * @param[out] value
- *   The value parsed
+ * @param[in] padded
+ *   Set if the input is followed by padding (see mxjson_parse_padded()).
  *
  * @return
- *   Indicates whether the start of the string contained a valid 4-digit
- *   hexadecimal value.
+ *   Indicates whether the parsing was successful. false is returned either
+ *   when the JSON is invalid, or there were insufficient tokens in the
+ *   parser context to complete the parsing.
  */
 static inline bool
-mxjson_hex (mxstr_t *str, uint32_t *value)
+mxjson_parse_fsm (mxjson_parser_t *p, bool padded)
 {
-    uint32_t v = 0;
-    bool     ok = true;
-    int      i;
-    uint8_t  c;
+    mxstr_t         s = p->unparsed;
+    mxstr_t         value;
+    mxjson_idx_t    entry;
+    mxjson_token_t *token;
+    bool            esc_flag;
+    bool            ok = true;
+    uint8_t         c = '\0';
+#if MXJSON_STATS
+    mxstr_t         start;
+    uint64_t        cycles;
+#endif
 
-    for (i = 0; ok && i < 4; i++) {
-        ok = mxstr_consume_char(str, &c, isxdigit(c));
+#if MXJSON_COMPUTED_GOTO
+    static const void *const value_states[256] = {
+        [0 ... 255] = &&value_error,
+        ['\"'] = &&value_string,
+        ['{'] = &&value_object,
+        ['['] = &&value_array,
+        ['t'] = &&value_true,
+        ['f'] = &&value_false,
+        ['n'] = &&value_null,
+        ['-'] = &&value_number,
+        ['0' ... '9'] = &&value_number,
+    };
+#endif
 
-        if (ok) {
-            c = (c > '9') ? (c & ~0x20) - 'A' + 10 : (c - '0');
-            v = (v << 4) + c;
-        }
+    /*
+     * Expecting a value, for the token at p->token.
+     */
+value:
+    mxjson_consume_ws(&s, padded);
+    token = p->token;
+#if MXJSON_SPAN
+    token->raw = mxstr_substr_offset(p->json, s);
+#endif
+#if MXJSON_STATS
+    start = s;
+#endif
+
+    if (!mxstr_getchar(s, &c)) {
+        goto value_error;
+    }
+    MXJSON_FSM_DISPATCH(value_states, c);
+
+#if !MXJSON_COMPUTED_GOTO
+value_switch:
+    switch (c) {
+    case '\"':
+        goto value_string;
+    case '{':
+        goto value_object;
+    case '[':
+        goto value_array;
+    case 't':
+        goto value_true;
+    case 'f':
+        goto value_false;
+    case 'n':
+        goto value_null;
+    case '-':
+    case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+        goto value_number;
+    default:
+        goto value_error;
     }
+#endif
 
-    *value = v;
+value_string:
+    token->value_type = MXJSON_STRING;
+    esc_flag = false;
+    MXJSON_STATS_START(cycles);
+    ok = mxjson_parse_string(&s, &value, &esc_flag, padded);
+    MXJSON_STATS_PHASE(p, MXJSON_PHASE_STRING, cycles);
 
-    return ok;
-}
+    if (!ok) {
+        goto value_error;
+    }
+    token->str = mxstr_substr_offset(p->json, value);
+    token->str_size = value.len;
+    token->value_esc = esc_flag;
+    MXJSON_STATS_ESCAPES(p, value, esc_flag);
+    goto value_end;
+
+value_number:
+    token->value_type = MXJSON_NUMBER;
+    MXJSON_STATS_START(cycles);
+    ok = (padded ? mxjson_parse_number_padded(&s, &value) :
+          mxjson_parse_number(&s, &value));
+    MXJSON_STATS_PHASE(p, MXJSON_PHASE_NUMBER, cycles);
+
+    if (!ok) {
+        goto value_error;
+    }
+    token->str = mxstr_substr_offset(p->json, value);
+    token->str_size = value.len;
+    goto value_end;
 
+value_true:
+    token->value_type = MXJSON_BOOL;
+    token->boolean = true;
 
-/**
- * \internal
- * Translate a JSON string value, processing any escape characters.
- *
- * @param[in] buffer
- *   The buffer to write the translated string to.
- *
- * @param[in] str
- *   The JSON string to translate.
- *
- * @return
- *   Indicates whether the input string was valid and successfully translated.
- */
-static inline bool
-mxjson_unescape (mxbuf_t *buffer, mxstr_t str)
-{
-    mxstr_t  s = str;
-    mxstr_t  start;
-    bool     ok = true;
-    uint8_t  c;
-    uint32_t v1;
-    uint32_t v2;
+    if (!mxjson_consume_literal(&s, mxstr_literal("true"), padded)) {
+        goto value_error;
+    }
+    goto value_end;
 
-    while (ok && !mxstr_empty(s)) {
-        start = s;
-        mxstr_consume_chars(&s, &c, (c != '\\'));
-        mxbuf_write(buffer, mxstr_prefix(start, s));
-        (void)mxstr_consume(&s, 1);
-        ok = mxstr_consume_char(&s, &c, true);
+value_false:
+    token->value_type = MXJSON_BOOL;
+    token->boolean = false;
 
-        if (ok) {
-            switch (c) {
-            case '\"': case '\\': case '/':
-                (void)mxbuf_putc(buffer, c);
-                break;
+    if (!mxjson_consume_literal(&s, mxstr_literal("false"), padded)) {
+        goto value_error;
+    }
+    goto value_end;
 
-            case 'b':
-                (void)mxbuf_putc(buffer, '\b');
-                break;
+value_null:
+    token->value_type = MXJSON_NULL;
 
-            case 'f':
-                (void)mxbuf_putc(buffer, '\f');
-                break;
+    if (!mxjson_consume_literal(&s, mxstr_literal("null"), padded)) {
+        goto value_error;
+    }
+    goto value_end;
 
-            case 'n':
-                (void)mxbuf_putc(buffer, '\n');
-                break;
+value_object:
+    if (p->lazy_depth != 0 && p->depth >= p->lazy_depth) {
+        goto value_raw;
+    }
+    (void)mxstr_consume(&s, 1);
+    token->value_type = MXJSON_OBJECT;
+
+    if (!mxjson_push(p, MXJSON_STACK_OBJECT)) {
+        goto value_error;
+    }
+    MXJSON_STATS_VALUE(p, MXJSON_OBJECT, 1);
+    mxjson_consume_ws(&s, padded);
+
+    if (mxstr_getchar(s, &c) && c == '}') {
+        goto after_value;
+    }
+    goto member;
+
+value_array:
+    if (p->lazy_depth != 0 && p->depth >= p->lazy_depth) {
+        goto value_raw;
+    }
+    (void)mxstr_consume(&s, 1);
+    token->value_type = MXJSON_ARRAY;
+
+    if (!mxjson_push(p, 0)) {
+        goto value_error;
+    }
+    MXJSON_STATS_VALUE(p, MXJSON_ARRAY, 1);
+    mxjson_consume_ws(&s, padded);
+
+    if (mxstr_getchar(s, &c) && c == ']') {
+        goto after_value;
+    }
+    goto element;
+
+value_raw:
+    if (!mxjson_parse_raw(p, &s, padded)) {
+        goto value_error;
+    }
+    goto value_end;
+
+value_end:
+#if MXJSON_SPAN
+    token->raw_size = mxstr_substr_offset(p->json, s) - token->raw;
+#endif
+    MXJSON_STATS_VALUE(p, token->value_type, mxstr_prefix(start, s).len);
+
+    /*
+     * A value has been completed (or an empty object/array has been
+     * opened). Expecting either a ',' and another member/element, or the
+     * end of the enclosing object/array. Empty objects/arrays enter here,
+     * rather than going directly to close, so that the loop between
+     * after_value and close has a single entry point.
+     */
+after_value:
+    if (p->depth == 0) {
+        goto done;
+    }
+    mxjson_consume_ws(&s, padded);
+    entry = p->stack[p->depth - 1];
+
+    if (!mxstr_getchar(s, &c)) {
+        goto value_error;
+    }
+    (void)mxstr_consume(&s, 1);
+
+    if (entry & MXJSON_STACK_OBJECT) {
+        if (c == ',') {
+            goto member;
+        } else if (c == '}') {
+            goto close;
+        }
+    } else {
+        if (c == ',') {
+            goto element;
+        } else if (c == ']') {
+            goto close;
+        }
+    }
+    goto value_error;
+
+    /*
+     * The closing brace for the object/array at the top of the parse
+     * stack has been consumed.
+     */
+close:
+    p->depth--;
+    token = &p->tokens[p->stack[p->depth] & ~MXJSON_STACK_OBJECT];
+    token->next = p->idx + 1;
+    MXJSON_STATS_ADD(p, value_bytes[token->value_type], 1);
+#if MXJSON_SPAN
+    token->raw_size = mxstr_substr_offset(p->json, s) - token->raw;
+#endif
+
+    if (p->depth != 0) {
+        p->current_parent = p->stack[p->depth - 1] & ~MXJSON_STACK_OBJECT;
+    } else {
+        p->current_parent = MXJSON_IDX_NONE;
+    }
+    goto after_value;
+
+    /*
+     * Expecting an object member: the name string, ':' and the value.
+     */
+member:
+    if (!mxjson_token(p)) {
+        goto value_error;
+    }
+    mxjson_consume_ws(&s, padded);
+
+    if (!mxjson_parse_name(p, &s, padded)) {
+        goto value_error;
+    }
+    goto value;
+
+    /*
+     * Expecting an array element.
+     */
+element:
+    if (!mxjson_token(p)) {
+        goto value_error;
+    }
+    goto value;
+
+value_error:
+    ok = false;
+
+done:
+    if (ok) {
+        /*
+         * Reject the input if there is anything left to parse.
+         */
+        mxjson_consume_ws(&s, padded);
+        ok = mxstr_empty(s);
+    }
+
+    p->unparsed = s;
+
+    return ok;
+}
+
+#undef MXJSON_FSM_DISPATCH
+#if MXJSON_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+
+/**
+ * \internal
+ * Parse a 4-digit hex value
+ *
+ * @param[in] str
+ *   The string to read from.
+ *
+ * @param[out] value
+ *   The value parsed
+ *
+ * @return
+ *   Indicates whether the start of the string contained a valid 4-digit
+ *   hexadecimal value.
+ */
+static inline bool
+mxjson_hex (mxstr_t *str, uint32_t *value)
+{
+    uint32_t v = 0;
+    bool     ok = true;
+    int      i;
+    uint8_t  c;
+
+    for (i = 0; ok && i < 4; i++) {
+        ok = mxstr_consume_char(str, &c, isxdigit(c));
+
+        if (ok) {
+            c = (c > '9') ? (c & ~0x20) - 'A' + 10 : (c - '0');
+            v = (v << 4) + c;
+        }
+    }
+
+    *value = v;
+
+    return ok;
+}
+
+
+/**
+ * \internal
+ * Translate a JSON string value, processing any escape characters.
+ *
+ * @param[in] buffer
+ *   The buffer to write the translated string to.
+ *
+ * @param[in] str
+ *   The JSON string to translate.
+ *
+ * @return
+ *   Indicates whether the input string was valid and successfully translated.
+ */
+static inline bool
+mxjson_unescape (mxbuf_t *buffer, mxstr_t str)
+{
+    mxstr_t  s = str;
+    mxstr_t  start;
+    bool     ok = true;
+    bool     escape;
+    uint8_t  c;
+    uint32_t v1;
+    uint32_t v2;
+
+    while (ok && !mxstr_empty(s)) {
+        start = s;
+        mxstr_consume_chars(&s, &c, (c != '\\'));
+        mxbuf_write(buffer, mxstr_prefix(start, s));
+
+        /*
+         * The run of characters ends either at an escape sequence, or at
+         * the end of the string.
+         */
+        escape = mxstr_consume_char(&s, &c, (c == '\\'));
+        ok = (!escape || mxstr_consume_char(&s, &c, true));
+
+        if (ok && escape) {
+            switch (c) {
+            case '\"': case '\\': case '/':
+                (void)mxbuf_putc(buffer, c);
+                break;
+
+            case 'b':
+                (void)mxbuf_putc(buffer, '\b');
+                break;
+
+            case 'f':
+                (void)mxbuf_putc(buffer, '\f');
+                break;
+
+            case 'n':
+                (void)mxbuf_putc(buffer, '\n');
+                break;
 
             case 'r':
                 (void)mxbuf_putc(buffer, '\r');
@@ -1251,56 +3001,79 @@ mxjson_unescape (mxbuf_t *buffer, mxstr_t str)
 }
 
 
-/*
- * ----------------------------------------------------------------------
- * API Implementation
- * ----------------------------------------------------------------------
+/**
+ * \internal
+ * Get a string from a JSON input, unescaping it if necessary.
+ *
+ * @param[in] json
+ *   The JSON input the offset refers to.
+ *
+ * @param[in] offset
+ *   Offset of the string in the JSON input.
+ *
+ * @param[in] len
+ *   Length of the string.
+ *
+ * @param[in] esc
+ *   Whether the string contains escape characters.
+ *
+ * @param[in] buffer
+ *   The buffer to write the unescaped string to, if esc is set.
+ *
+ * @param[out] valid
+ *   Set to whether the string could be unescaped.
+ *
+ * @return
+ *   The string.
  */
-
-static inline bool
-mxjson_resize (mxjson_parser_t *p, mxjson_idx_t size_hint)
+static inline mxstr_t
+mxjson_text (mxstr_t   json,
+             uint32_t  offset,
+             uint32_t  len,
+             bool      esc,
+             mxbuf_t  *buffer,
+             bool     *valid)
 {
-    mxjson_token_t *tokens = NULL;
+    mxstr_t str;
+    size_t  start;
 
-    if (size_hint != 0) {
-        assert(size_hint > p->count);
-        tokens = mxutil_calloc(size_hint * sizeof(*tokens));
-        memcpy(tokens, p->tokens, p->count * sizeof(*tokens));
-    }
+    str = mxstr((char *)&json.ptr[offset], len);
+    *valid = true;
 
-    if (p->tokens != p->init_tokens) {
-        free(p->tokens);
-    }
+    if (esc) {
+        /*
+         * The buffer may be reallocated while unescaping, so the start of
+         * the unescaped string is recorded as an offset.
+         */
+        start = mxstr_substr_offset(buffer->buf, buffer->available);
+        *valid = mxjson_unescape(buffer, str);
 
-    p->tokens = tokens;
-    p->count = size_hint;
+        if (*valid) {
+            str = mxbuf_str(buffer);
+            (void)mxstr_consume(&str, start);
+        }
+    }
 
-    return true;
+    return str;
 }
 
 
+/**
+ * \internal
+ * Get the name of a token, for mxjson_token_name() and for tokens that are
+ * not in a parser context (e.g. in a detached document).
+ */
 static inline mxstr_t
-mxjson_token_name (mxjson_parser_t *p,
-                   mxjson_idx_t     idx,
-                   mxbuf_t         *buffer,
-                   bool            *valid)
+mxjson_name_of (mxstr_t               json,
+                const mxjson_token_t *token,
+                mxbuf_t              *buffer,
+                bool                 *valid)
 {
-    mxstr_t         s;
-    mxjson_token_t *token;
-    mxstr_t         str;
-    bool            ok = true;
-
-    token = &p->tokens[idx];
-    str = mxstr((char *)&p->json.ptr[token->name], token->name_size);
-
-    if (token->name_esc) {
-        s = buffer->available;
-        ok = mxjson_unescape(buffer, str);
+    mxstr_t str;
+    bool    ok;
 
-        if (ok) {
-            str = mxstr_prefix(s, buffer->available);
-        }
-    }
+    str = mxjson_text(json, token->name, token->name_size, token->name_esc,
+                      buffer, &ok);
 
     if (valid != NULL) {
         *valid = ok;
@@ -1310,18 +3083,19 @@ mxjson_token_name (mxjson_parser_t *p,
 }
 
 
+/**
+ * \internal
+ * Get the string representation of the value of a token, for
+ * mxjson_token_string() and for tokens that are not in a parser context.
+ */
 static inline mxstr_t
-mxjson_token_string (mxjson_parser_t *p,
-                     mxjson_idx_t     idx,
-                     mxbuf_t         *buffer,
-                     bool            *valid)
+mxjson_string_of (mxstr_t               json,
+                  const mxjson_token_t *token,
+                  mxbuf_t              *buffer,
+                  bool                 *valid)
 {
-    mxstr_t         s;
-    mxjson_token_t *token;
-    mxstr_t         str;
-    bool            ok = true;
-
-    token = &p->tokens[idx];
+    mxstr_t str;
+    bool    ok = true;
 
     switch (token->value_type) {
     case MXJSON_NULL:
@@ -1338,16 +3112,9 @@ mxjson_token_string (mxjson_parser_t *p,
 
     case MXJSON_NUMBER:
     case MXJSON_STRING:
-        str = mxstr((char *)&p->json.ptr[token->str], token->str_size);
-
-        if (token->value_esc) {
-            s = buffer->available;
-            ok = mxjson_unescape(buffer, str);
-
-            if (ok) {
-                str = mxstr_prefix(s, buffer->available);
-            }
-        }
+    case MXJSON_RAW:
+        str = mxjson_text(json, token->str, token->str_size,
+                          token->value_esc, buffer, &ok);
         break;
 
     case MXJSON_OBJECT:
@@ -1372,22 +3139,18 @@ mxjson_token_string (mxjson_parser_t *p,
 }
 
 
+/**
+ * \internal
+ * Get the index of the next token after a token and its descendants, for
+ * mxjson_next() and for tokens that are not in a parser context.
+ */
 static inline mxjson_idx_t
-mxjson_first (mxjson_parser_t *p, mxjson_idx_t idx)
-{
-    UNUSED(p);
-
-    return idx + 1;
-}
-
-
-static inline mxjson_idx_t
-mxjson_next (mxjson_parser_t *p, mxjson_idx_t idx)
+mxjson_next_of (const mxjson_token_t *tokens, mxjson_idx_t idx)
 {
-    mxjson_token_t *token;
-    mxjson_idx_t    next;
+    const mxjson_token_t *token;
+    mxjson_idx_t          next;
 
-    token = &p->tokens[idx];
+    token = &tokens[idx];
 
     if (token->value_type == MXJSON_OBJECT ||
         token->value_type == MXJSON_ARRAY) {
@@ -1400,44 +3163,678 @@ mxjson_next (mxjson_parser_t *p, mxjson_idx_t idx)
 }
 
 
-static inline bool
-mxjson_parse (mxjson_parser_t *p, mxstr_t json)
+/**
+ * \internal
+ * Get the nesting depth of a token, for mxjson_depth() and for tokens that
+ * are not in a parser context.
+ */
+static inline uint32_t
+mxjson_depth_of (const mxjson_token_t *tokens, mxjson_idx_t idx)
 {
-    bool ok;
+    uint32_t depth;
 
-    p->json = json;
-    p->unparsed = json;
-    p->token = NULL;
-    p->current_parent = MXJSON_IDX_NONE;
-    p->idx = MXJSON_IDX_NONE;
+    assert(idx != MXJSON_IDX_NONE);
 
-    /*
-     * Consume the optional UTF-8 BOM. This is not expected to be present,
-     * but it is valid to accept it.
-     */
-    (void)mxstr_consume_str(&p->unparsed, mxstr_literal("\xEF\xBB\xBF"));
+#if MXJSON_DEPTH
+    depth = tokens[idx].depth;
+#else
+    depth = 0;
+    idx = tokens[idx].parent;
 
-    /*
-     * Get the root token and parse the JSON.
-     */
-    ok = (mxjson_token(p) && mxjson_parse_json(p));
+    while (idx != MXJSON_IDX_NONE) {
+        depth++;
+        idx = tokens[idx].parent;
+    }
+#endif
 
-    return ok;
+    return depth;
 }
 
 
-static inline void
-mxjson_free (mxjson_parser_t *p)
-{
-    bool ok;
-
-    if (p->resize_fn != NULL) {
-        ok = p->resize_fn(p, 0);
+/*
+ * ----------------------------------------------------------------------
+ * API Implementation
+ * ----------------------------------------------------------------------
+ */
+
+static inline bool
+mxjson_resize (mxjson_parser_t *p, mxjson_idx_t size_hint)
+{
+    mxjson_token_t *tokens = NULL;
+
+    if (size_hint != 0) {
+        assert(size_hint > p->count);
+        tokens = mxutil_calloc(size_hint * sizeof(*tokens));
+        memcpy(tokens, p->tokens, p->count * sizeof(*tokens));
+    }
+
+    if (p->tokens != p->init_tokens) {
+        free(p->tokens);
+    }
+
+    p->tokens = tokens;
+    p->count = size_hint;
+
+    return true;
+}
+
+
+static inline mxstr_t
+mxjson_token_name (mxjson_parser_t *p,
+                   mxjson_idx_t     idx,
+                   mxbuf_t         *buffer,
+                   bool            *valid)
+{
+    return mxjson_name_of(p->json, &p->tokens[idx], buffer, valid);
+}
+
+
+static inline mxstr_t
+mxjson_token_string (mxjson_parser_t *p,
+                     mxjson_idx_t     idx,
+                     mxbuf_t         *buffer,
+                     bool            *valid)
+{
+    return mxjson_string_of(p->json, &p->tokens[idx], buffer, valid);
+}
+
+
+#if MXJSON_SPAN
+static inline mxstr_t
+mxjson_token_raw (mxjson_parser_t *p, mxjson_idx_t idx)
+{
+    mxjson_token_t *token;
+
+    token = &p->tokens[idx];
+
+    return mxstr((char *)&p->json.ptr[token->raw], token->raw_size);
+}
+#endif
+
+
+static inline uint32_t
+mxjson_depth (mxjson_parser_t *p, mxjson_idx_t idx)
+{
+    return mxjson_depth_of(p->tokens, idx);
+}
+
+
+#if MXJSON_STATS
+static inline mxjson_stats_t
+mxjson_stats (mxjson_parser_t *p)
+{
+    return p->stats;
+}
+#endif
+
+
+static inline mxjson_idx_t
+mxjson_first (mxjson_parser_t *p, mxjson_idx_t idx)
+{
+    mxjson_idx_t first = idx + 1;
+
+    if (p->breadth && (p->tokens[idx].value_type == MXJSON_OBJECT ||
+                       p->tokens[idx].value_type == MXJSON_ARRAY)) {
+        first = p->tokens[idx].next;
+    }
+
+    return first;
+}
+
+
+static inline mxjson_idx_t
+mxjson_next (mxjson_parser_t *p, mxjson_idx_t idx)
+{
+    return p->breadth ? idx + 1 : mxjson_next_of(p->tokens, idx);
+}
+
+
+static inline mxjson_idx_t
+mxjson_end (mxjson_parser_t *p, mxjson_idx_t idx)
+{
+    mxjson_token_t *token;
+    mxjson_idx_t    end;
+
+    token = &p->tokens[idx];
+
+    if (p->breadth) {
+        end = mxjson_first(p, idx);
+
+        if (token->value_type == MXJSON_OBJECT ||
+            token->value_type == MXJSON_ARRAY) {
+            end += token->children;
+        }
+    } else {
+        end = mxjson_next_of(p->tokens, idx);
+    }
+
+    return end;
+}
+
+
+static inline size_t
+mxjson_children (mxjson_parser_t *p, mxjson_idx_t idx, mxjson_idx_t *children)
+{
+    mxjson_idx_t last;
+    mxjson_idx_t child;
+    size_t       n = 0;
+
+    last = mxjson_end(p, idx);
+    child = mxjson_first(p, idx);
+
+    while (child != last) {
+        children[n++] = child;
+        child = mxjson_next(p, child);
+    }
+
+    return n;
+}
+
+
+static inline void
+mxjson_array_index (mxjson_parser_t *p, mxjson_idx_t threshold)
+{
+    p->index.threshold = threshold;
+}
+
+
+/**
+ * \internal
+ * Find the hash table slot for an array's offset table: the slot holding
+ * the array, or the empty slot where it is to be added.
+ */
+static inline mxjson_index_entry_t *
+mxjson_index_slot (mxjson_index_t *index, mxjson_idx_t idx)
+{
+    uint32_t slot;
+
+    /*
+     * Fibonacci hashing spreads the (often consecutive) array indices, and
+     * the table is at most half full, so the linear probing is short.
+     */
+    slot = (uint32_t)(idx * 2654435761U) & (index->slots - 1);
+
+    while (index->entries[slot].array != MXJSON_IDX_NONE &&
+           index->entries[slot].array != idx) {
+        slot = (slot + 1) & (index->slots - 1);
+    }
+
+    return &index->entries[slot];
+}
+
+
+/**
+ * \internal
+ * Get the offset table for an array, building it if it does not exist.
+ *
+ * @return
+ *   The table of the indices of the elements of the array.
+ */
+static inline mxjson_idx_t *
+mxjson_index_table (mxjson_parser_t *p, mxjson_idx_t idx)
+{
+    mxjson_index_t       *index = &p->index;
+    mxjson_index_entry_t *entries;
+    mxjson_index_entry_t *entry = NULL;
+    mxjson_idx_t         *table;
+    uint32_t              slots;
+    uint32_t              i;
+    size_t                n;
+
+    if (index->slots != 0) {
+        entry = mxjson_index_slot(index, idx);
+    }
+
+    if (entry == NULL || entry->array == MXJSON_IDX_NONE) {
+        /*
+         * Double the size of the hash table if it is half full.
+         */
+        if (index->used >= index->slots / 2) {
+            entries = index->entries;
+            slots = index->slots;
+            index->slots = max(slots * 2, 16);
+            index->entries = mxutil_calloc(index->slots * sizeof(*entries));
+
+            for (i = 0; i < slots; i++) {
+                if (entries[i].array != MXJSON_IDX_NONE) {
+                    *mxjson_index_slot(index, entries[i].array) = entries[i];
+                }
+            }
+
+            free(entries);
+            entry = mxjson_index_slot(index, idx);
+        }
+
+        /*
+         * Add the table to the arena, growing it geometrically.
+         */
+        n = p->tokens[idx].children;
+
+        if (index->len + n > index->size) {
+            index->size = max(index->size * 2, index->len + n);
+            index->arena = mxutil_realloc(index->arena,
+                                          index->size * sizeof(*table));
+        }
+
+        entry->array = idx;
+        entry->offset = (uint32_t)index->len;
+        index->used++;
+        index->len += mxjson_children(p, idx, &index->arena[entry->offset]);
+    }
+
+    return &index->arena[entry->offset];
+}
+
+
+/**
+ * \internal
+ * Discard the offset tables, keeping the memory for reuse.
+ */
+static inline void
+mxjson_index_reset (mxjson_index_t *index)
+{
+    if (index->used != 0) {
+        memset(index->entries, 0, index->slots * sizeof(*index->entries));
+        index->used = 0;
+        index->len = 0;
+    }
+}
+
+
+static inline mxjson_idx_t
+mxjson_array_at (mxjson_parser_t *p, mxjson_idx_t idx, size_t n)
+{
+    mxjson_token_t *token;
+    mxjson_idx_t    child = MXJSON_IDX_NONE;
+
+    token = &p->tokens[idx];
+
+    if (n < token->children) {
+        if (p->breadth) {
+            child = token->next + n;
+        } else if (token->next == idx + 1 + token->children) {
+            /*
+             * No element has descendants, so the elements are consecutive.
+             */
+            child = idx + 1 + n;
+        } else if (p->index.threshold != 0 &&
+                   token->children >= p->index.threshold) {
+            child = mxjson_index_table(p, idx)[n];
+        } else {
+            child = mxjson_first(p, idx);
+
+            while (n-- != 0) {
+                child = mxjson_next(p, child);
+            }
+        }
+    }
+
+    return child;
+}
+
+
+/**
+ * \internal
+ * Get the value of a number token as a double.
+ *
+ * The number is copied to be terminated, as the text of a number in a
+ * detached document is not followed by a delimiter.
+ */
+static inline double
+mxjson_number_of (mxjson_parser_t *p, mxjson_idx_t idx, mxbuf_t *buffer)
+{
+    mxjson_token_t *token;
+
+    token = &p->tokens[idx];
+    mxbuf_reset(buffer);
+    (void)mxbuf_write(buffer, mxstr((char *)&p->json.ptr[token->str],
+                                    token->str_size));
+    (void)mxbuf_putc(buffer, '\0');
+
+    return strtod((char *)buffer->buf.ptr, NULL);
+}
+
+
+static inline bool
+mxjson_array_search (mxjson_parser_t *p,
+                     mxjson_idx_t     idx,
+                     double           value,
+                     size_t          *pos)
+{
+    mxbuf_t buffer;
+    char    number[64];
+    size_t  low = 0;
+    size_t  high;
+    size_t  mid;
+    bool    found;
+
+    high = p->tokens[idx].children;
+    mxbuf_create(&buffer, number, sizeof(number));
+
+    /*
+     * Find the first element that is not less than the value.
+     */
+    while (low < high) {
+        mid = low + (high - low) / 2;
+
+        if (mxjson_number_of(p, mxjson_array_at(p, idx, mid), &buffer) <
+            value) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    *pos = low;
+    found = (low < p->tokens[idx].children &&
+             mxjson_number_of(p, mxjson_array_at(p, idx, low), &buffer) ==
+             value);
+    mxbuf_free(&buffer);
+
+    return found;
+}
+
+
+static inline void
+mxjson_breadth_first (mxjson_parser_t *p)
+{
+    mxjson_token_t *tokens;
+    mxjson_token_t *token;
+    mxjson_idx_t   *order;
+    mxjson_idx_t   *map;
+    mxjson_idx_t    head;
+    mxjson_idx_t    tail = 2;
+    mxjson_idx_t    child;
+    mxjson_idx_t    end;
+    size_t          size;
+
+    if (!p->breadth && p->idx != MXJSON_IDX_NONE) {
+        size = (size_t)p->idx + 1;
+        tokens = mxutil_malloc(size * sizeof(*tokens));
+        order = mxutil_malloc(2 * size * sizeof(*order));
+        map = &order[size];
+        memcpy(tokens, p->tokens, size * sizeof(*tokens));
+
+        /*
+         * order gives the original index of the token at each new index,
+         * and map gives the new index of each original index. The token
+         * array is filled in order, and is also the queue of tokens whose
+         * children are still to be added, so each token's children are
+         * added (in their original order) after the children of the tokens
+         * before it.
+         */
+        order[1] = 1;
+        map[1] = 1;
+        map[MXJSON_IDX_NONE] = MXJSON_IDX_NONE;
+
+        for (head = 1; head < tail; head++) {
+            token = &p->tokens[head];
+            *token = tokens[order[head]];
+            token->parent = map[token->parent];
+
+            if (token->value_type == MXJSON_OBJECT ||
+                token->value_type == MXJSON_ARRAY) {
+                end = mxjson_next_of(tokens, order[head]);
+                token->next = tail;
+
+                for (child = order[head] + 1; child != end;
+                     child = mxjson_next_of(tokens, child)) {
+                    order[tail] = child;
+                    map[child] = tail++;
+                }
+            }
+        }
+
+        p->breadth = true;
+        free(order);
+        free(tokens);
+    }
+}
+
+
+static inline void
+mxjson_lazy_depth (mxjson_parser_t *p, uint32_t depth)
+{
+    p->lazy_depth = depth;
+}
+
+
+static inline bool
+mxjson_expand_to (mxjson_parser_t *p,
+                  mxjson_idx_t     idx,
+                  mxjson_parser_t *child)
+{
+    mxjson_token_t *token;
+
+    token = &p->tokens[idx];
+    assert(token->value_type == MXJSON_RAW);
+
+    return mxjson_parse(child, mxstr((char *)&p->json.ptr[token->str],
+                                     token->str_size));
+}
+
+
+static inline bool
+mxjson_expand (mxjson_parser_t *p, mxjson_idx_t idx)
+{
+    mxjson_parser_t child;
+    mxjson_token_t  raw;
+    mxjson_token_t *token;
+    mxjson_idx_t    count = 0;
+    mxjson_idx_t    i;
+    uint32_t        base;
+    bool            ok;
+
+    raw = p->tokens[idx];
+    base = raw.str;
+    mxjson_init(&child, 0, NULL, mxjson_resize);
+    mxjson_lazy_depth(&child, p->lazy_depth);
+    ok = (!p->breadth && mxjson_expand_to(p, idx, &child));
+
+    if (ok) {
+        /*
+         * The raw token is replaced by the tokens for the value, so count
+         * tokens are inserted after it.
+         */
+        count = child.idx - 1;
+
+        while (ok && p->idx + count >= p->count) {
+            ok = mxjson_token_resize(p, mxutil_size_p2(p->idx + count));
+        }
+    }
+
+    if (ok) {
+        memmove(&p->tokens[idx + 1 + count], &p->tokens[idx + 1],
+                (size_t)(p->idx - idx) * sizeof(*p->tokens));
+        p->idx += count;
+
+        /*
+         * Move the references to the tokens that were moved. The raw token
+         * has no descendants, so these are the tokens after it, and the
+         * end of each of its ancestors.
+         */
+        for (i = 1; i <= p->idx; i++) {
+            token = &p->tokens[i];
+
+            if (i == idx) {
+                i += count;
+            } else {
+                if (token->parent > idx) {
+                    token->parent += count;
+                }
+
+                if ((token->value_type == MXJSON_OBJECT ||
+                     token->value_type == MXJSON_ARRAY) && token->next > idx) {
+                    token->next += count;
+                }
+            }
+        }
+
+        /*
+         * Copy the tokens for the value, rebasing the offsets from the text
+         * of the raw token to the input, and the indices from the child
+         * parser context. The value takes the place of the raw token.
+         */
+        for (i = 1; i <= child.idx; i++) {
+            token = &p->tokens[idx + i - 1];
+            *token = child.tokens[i];
+
+            if (i == 1) {
+                token->name = raw.name;
+                token->name_size = raw.name_size;
+                token->name_esc = raw.name_esc;
+                token->parent = raw.parent;
+            } else {
+                if (token->name != 0) {
+                    token->name += base;
+                }
+                token->parent += idx - 1;
+            }
+
+            switch (token->value_type) {
+            case MXJSON_OBJECT:
+            case MXJSON_ARRAY:
+                token->next += idx - 1;
+                break;
+
+            case MXJSON_NUMBER:
+            case MXJSON_STRING:
+            case MXJSON_RAW:
+                token->str += base;
+                break;
+
+            default:
+                break;
+            }
+#if MXJSON_SPAN
+            token->raw += base;
+#endif
+#if MXJSON_DEPTH
+            token->depth += raw.depth;
+#endif
+        }
+
+        mxjson_index_reset(&p->index);
+    }
+
+    mxjson_free(&child);
+
+    return ok;
+}
+
+
+/**
+ * \internal
+ * Parse a JSON input, for mxjson_parse() and mxjson_parse_padded().
+ *
+ * @param[in] p
+ *   The parser context.
+ *
+ * @param[in] json
+ *   A string containing the JSON to parse.
+ *
+ * @param[in] padded
+ *   Set if the input is followed by padding (see mxjson_parse_padded()).
+ *
+ * @return
+ *   Indicates whether the parsing was successful.
+ */
+static inline bool
+mxjson_parse_input (mxjson_parser_t *p, mxstr_t json, bool padded)
+{
+    bool     ok;
+#if MXJSON_STATS
+    uint64_t cycles;
+
+    memset(&p->stats, 0, sizeof(p->stats));
+#endif
+
+    MXJSON_STATS_START(cycles);
+    p->json = json;
+    p->unparsed = json;
+    p->token = NULL;
+    p->current_parent = MXJSON_IDX_NONE;
+    p->idx = MXJSON_IDX_NONE;
+    p->depth = 0;
+    p->breadth = false;
+    mxjson_index_reset(&p->index);
+
+    /*
+     * Consume the optional UTF-8 BOM. This is not expected to be present,
+     * but it is valid to accept it.
+     */
+    (void)mxstr_consume_str(&p->unparsed, mxstr_literal("\xEF\xBB\xBF"));
+
+    /*
+     * Get the root token and parse the JSON.
+     */
+#if MXJSON_PARSE_FSM
+    ok = (mxjson_token(p) && mxjson_parse_fsm(p, padded));
+#else
+    ok = (mxjson_token(p) && mxjson_parse_json(p, padded));
+#endif
+
+    MXJSON_STATS_ADD(p, bytes, p->json.len - p->unparsed.len);
+    MXJSON_STATS_PHASE(p, MXJSON_PHASE_PARSE, cycles);
+
+    return ok;
+}
+
+
+static inline bool
+mxjson_parse (mxjson_parser_t *p, mxstr_t json)
+{
+    return mxjson_parse_input(p, json, false);
+}
+
+
+static inline bool
+mxjson_parse_padded (mxjson_parser_t *p, mxstr_t json)
+{
+    return mxjson_parse_input(p, json, true);
+}
+
+
+static inline bool
+mxjson_validate (mxstr_t json)
+{
+    mxstr_t s = json;
+    bool    ok;
+
+    (void)mxstr_consume_str(&s, mxstr_literal("\xEF\xBB\xBF"));
+    ok = mxjson_skip(&s, false, MXJSON_MAX_DEPTH);
+
+    if (ok) {
+        /*
+         * Reject the input if there is anything left to parse.
+         */
+        mxjson_consume_ws(&s, false);
+        ok = mxstr_empty(s);
+    }
+
+    return ok;
+}
+
+
+static inline void
+mxjson_free (mxjson_parser_t *p)
+{
+    mxjson_idx_t threshold;
+    bool         ok;
+
+    if (p->resize_fn != NULL) {
+        ok = p->resize_fn(p, 0);
         assert(ok);
     }
 
     p->count = 0;
     p->tokens = NULL;
+
+    free(p->index.entries);
+    free(p->index.arena);
+    threshold = p->index.threshold;
+    memset(&p->index, 0, sizeof(p->index));
+    p->index.threshold = threshold;
 }
 
 
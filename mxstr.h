@@ -18,6 +18,7 @@
 #define MXSTR_H
 
 #include <assert.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
@@ -484,6 +485,603 @@ mxstr_putc(mxstr_t *str, unsigned char c)
 }
 
 
+/*
+ * ----------------------------------------------------------------------
+ * Number Output
+ * ----------------------------------------------------------------------
+ */
+
+/**
+ * Maximum number of characters written by mxstr_put_double().
+ *
+ * The longest outputs are of the form -0.00000ddddddddddddddddd and
+ * -d.ddddddddddddddddde-308.
+ */
+#define MXSTR_DOUBLE_MAX 25
+
+
+/**
+ * Maximum number of characters written by mxstr_put_int64() or
+ * mxstr_put_uint64().
+ */
+#define MXSTR_INT64_MAX 20
+
+
+/**
+ * \internal
+ * Pairs of decimal digits "00" to "99", used to convert integers two digits
+ * at a time.
+ */
+static const char mxstr_digits2[200] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+
+/**
+ * \internal
+ * Powers of 10 that fit in a uint64_t.
+ */
+static const uint64_t mxstr_pow10[20] = {
+    1ULL,
+    10ULL,
+    100ULL,
+    1000ULL,
+    10000ULL,
+    100000ULL,
+    1000000ULL,
+    10000000ULL,
+    100000000ULL,
+    1000000000ULL,
+    10000000000ULL,
+    100000000000ULL,
+    1000000000000ULL,
+    10000000000000ULL,
+    100000000000000ULL,
+    1000000000000000ULL,
+    10000000000000000ULL,
+    100000000000000000ULL,
+    1000000000000000000ULL,
+    10000000000000000000ULL,
+};
+
+
+/**
+ * \internal
+ * Count the number of decimal digits in an integer.
+ *
+ * The count is estimated from the number of significant bits
+ * (log10(2) ~= 1233/4096), and corrected with a single comparison. The
+ * value 0 has 1 digit.
+ */
+static inline unsigned int
+mxstr_digit_count(uint64_t value)
+{
+    unsigned int t;
+
+    t = ((64 - __builtin_clzll(value | 1)) * 1233) >> 12;
+
+    return t + (value >= mxstr_pow10[t]) + (value == 0);
+}
+
+
+/**
+ * \internal
+ * Write the decimal digits of an integer, given the number of digits.
+ *
+ * The digits are written from the least significant end, two at a time.
+ */
+static inline void
+mxstr_put_digits(unsigned char *ptr, uint64_t value, unsigned int count)
+{
+    unsigned char *p = &ptr[count];
+    unsigned int   d;
+
+    while (value >= 100) {
+        d = (value % 100) * 2;
+        value /= 100;
+        p -= 2;
+        memcpy(p, &mxstr_digits2[d], 2);
+    }
+
+    if (value >= 10) {
+        p -= 2;
+        memcpy(p, &mxstr_digits2[value * 2], 2);
+    } else {
+        *--p = '0' + value;
+    }
+}
+
+
+/**
+ * Write an unsigned integer as a decimal string.
+ *
+ * @param[in,out] dest
+ *   The string to write to. This is updated so that it references any
+ *   remaining space not written to.
+ *
+ * @param[in] value
+ *   The value to write.
+ *
+ * @return
+ *   Indicates whether there was space to write the value. Nothing is written
+ *   if there is insufficient space.
+ */
+static inline bool
+mxstr_put_uint64(mxstr_t *dest, uint64_t value)
+{
+    unsigned int count;
+    bool         ok;
+
+    count = mxstr_digit_count(value);
+    ok = (dest->len >= count);
+
+    if (ok) {
+        mxstr_put_digits(dest->ptr, value, count);
+        (void)mxstr_consume(dest, count);
+    }
+
+    return ok;
+}
+
+
+/**
+ * Write a signed integer as a decimal string.
+ *
+ * See mxstr_put_uint64().
+ */
+static inline bool
+mxstr_put_int64(mxstr_t *dest, int64_t value)
+{
+    mxstr_t  s = *dest;
+    uint64_t u = (uint64_t)value;
+    bool     ok = true;
+
+    if (value < 0) {
+        ok = mxstr_putc(&s, '-');
+        u = 0 - u;
+    }
+
+    ok = ok && mxstr_put_uint64(&s, u);
+
+    if (ok) {
+        *dest = s;
+    }
+
+    return ok;
+}
+
+
+/**
+ * \internal
+ * Normalised 64-bit significands for the cached powers of 10 used by the
+ * Grisu algorithm: 10^k for k = -348, -340, ..., 340.
+ */
+static const uint64_t mxstr_cached_pow10_f[87] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL,
+    0x8b16fb203055ac76ULL, 0xcf42894a5dce35eaULL,
+    0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL,
+    0xbe5691ef416bd60cULL, 0x8dd01fad907ffc3cULL,
+    0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL,
+    0x823c12795db6ce57ULL, 0xc21094364dfb5637ULL,
+    0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL,
+    0xb23867fb2a35b28eULL, 0x84c8d4dfd2c63f3bULL,
+    0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL,
+    0xf3e2f893dec3f126ULL, 0xb5b5ada8aaff80b8ULL,
+    0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL,
+    0xa6dfbd9fb8e5b88fULL, 0xf8a95fcf88747d94ULL,
+    0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL,
+    0xe45c10c42a2b3b06ULL, 0xaa242499697392d3ULL,
+    0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL,
+    0x9c40000000000000ULL, 0xe8d4a51000000000ULL,
+    0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL,
+    0xd5d238a4abe98068ULL, 0x9f4f2726179a2245ULL,
+    0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL,
+    0x924d692ca61be758ULL, 0xda01ee641a708deaULL,
+    0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL,
+    0xc83553c5c8965d3dULL, 0x952ab45cfa97a0b3ULL,
+    0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL,
+    0x88fcf317f22241e2ULL, 0xcc20ce9bd35c78a5ULL,
+    0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL,
+    0xbb764c4ca7a44410ULL, 0x8bab8eefb6409c1aULL,
+    0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL,
+    0x80444b5e7aa7cf85ULL, 0xbf21e44003acdd2dULL,
+    0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL,
+    0xaf87023b9bf0ee6bULL
+};
+
+
+/**
+ * \internal
+ * Binary exponents for mxstr_cached_pow10_f[].
+ */
+static const int16_t mxstr_cached_pow10_e[87] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007,  -980,
+     -954,  -927,  -901,  -874,  -847,  -821,  -794,  -768,  -741,  -715,
+     -688,  -661,  -635,  -608,  -582,  -555,  -529,  -502,  -475,  -449,
+     -422,  -396,  -369,  -343,  -316,  -289,  -263,  -236,  -210,  -183,
+     -157,  -130,  -103,   -77,   -50,   -24,     3,    30,    56,    83,
+      109,   136,   162,   189,   216,   242,   269,   295,   322,   348,
+      375,   402,   428,   455,   481,   508,   534,   561,   588,   614,
+      641,   667,   694,   720,   747,   774,   800,   827,   853,   880,
+      907,   933,   960,   986,  1013,  1039,  1066
+};
+
+
+/**
+ * \internal
+ * A floating point value with a 64-bit significand: f * 2^e.
+ */
+typedef struct {
+    uint64_t f;
+    int      e;
+} mxstr_fp_t;
+
+
+/**
+ * \internal
+ * Multiply two floating point values, rounding the 128-bit product of the
+ * significands to 64 bits.
+ */
+static inline mxstr_fp_t
+mxstr_fp_mul(mxstr_fp_t x, mxstr_fp_t y)
+{
+    mxstr_fp_t r;
+
+    uint64_t a = x.f >> 32;
+    uint64_t b = x.f & 0xffffffff;
+    uint64_t c = y.f >> 32;
+    uint64_t d = y.f & 0xffffffff;
+    uint64_t ac = a * c;
+    uint64_t bc = b * c;
+    uint64_t ad = a * d;
+    uint64_t bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & 0xffffffff) + (bc & 0xffffffff);
+
+    tmp += 1U << 31;
+    r.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+    r.e = x.e + y.e + 64;
+
+    return r;
+}
+
+
+/**
+ * \internal
+ * Adjust the last digit of the Grisu output towards the exact value,
+ * while staying within the rounding interval.
+ */
+static inline void
+mxstr_grisu_round(unsigned char *buf,
+                  unsigned int   len,
+                  uint64_t       delta,
+                  uint64_t       rest,
+                  uint64_t       ten_kappa,
+                  uint64_t       wp_w)
+{
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w ||
+            wp_w - rest > rest + ten_kappa - wp_w)) {
+        buf[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+
+/**
+ * \internal
+ * Generate the shortest digits for a positive, finite, non-zero double
+ * using the Grisu2 algorithm (Florian Loitsch, "Printing Floating-Point
+ * Numbers Quickly and Accurately with Integers", PLDI 2010).
+ *
+ * The generated digits always convert back to the same double, but Grisu2
+ * can't always find the shortest such digits, and there is no fallback for
+ * the cases it can't decide. About 0.08% of doubles with uniformly random
+ * bit patterns (0.05% of values uniform in [0, 1000)) get one digit more
+ * than the shortest, and about 1 in 10 of those two digits more.
+ *
+ * @param[in] value
+ *   The value to convert.
+ *
+ * @param[out] buf
+ *   Buffer for the digits, at least 18 characters.
+ *
+ * @param[out] exp10
+ *   Decimal exponent: value ~= digits * 10^exp10
+ *
+ * @return
+ *   The number of digits generated.
+ */
+static inline unsigned int
+mxstr_grisu2(double value, unsigned char *buf, int *exp10)
+{
+    mxstr_fp_t   v;
+    mxstr_fp_t   plus;
+    mxstr_fp_t   minus;
+    mxstr_fp_t   c;
+    mxstr_fp_t   w;
+    mxstr_fp_t   one;
+    uint64_t     bits;
+    uint64_t     delta;
+    uint64_t     wp_w;
+    uint64_t     p2;
+    uint64_t     rest;
+    uint32_t     p1;
+    uint32_t     d;
+    double       dk;
+    unsigned int len = 0;
+    unsigned int index;
+    int          kappa;
+    int          k;
+    bool         done = false;
+
+    /*
+     * Decompose the double into significand and exponent.
+     */
+    memcpy(&bits, &value, sizeof(bits));
+    v.f = bits & ((1ULL << 52) - 1);
+
+    if ((bits >> 52) != 0) {
+        v.f += 1ULL << 52;
+        v.e = (int)(bits >> 52) - 1075;
+    } else {
+        v.e = -1074;
+    }
+
+    /*
+     * Boundaries of the rounding interval, m+ normalised and m- with the
+     * same exponent. The interval is asymmetric when the significand is
+     * a power of 2.
+     */
+    plus.f = (v.f << 1) + 1;
+    plus.e = v.e - 1;
+
+    while ((plus.f & (1ULL << 53)) == 0) {
+        plus.f <<= 1;
+        plus.e--;
+    }
+
+    plus.f <<= 10;
+    plus.e -= 10;
+
+    if (v.f == (1ULL << 52)) {
+        minus.f = (v.f << 2) - 1;
+        minus.e = v.e - 2;
+    } else {
+        minus.f = (v.f << 1) - 1;
+        minus.e = v.e - 1;
+    }
+
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    w.f = v.f << __builtin_clzll(v.f);
+    w.e = v.e - __builtin_clzll(v.f);
+
+    /*
+     * Select a cached power of 10, c = 10^-k, such that the exponent of the
+     * scaled values is in the range [-60, -32].
+     */
+    dk = (-61 - plus.e) * 0.30102999566398114 + 347;
+    k = (int)dk;
+    k += (dk - k > 0.0);
+    index = (unsigned int)((k >> 3) + 1);
+    k = -(-348 + (int)(index << 3));
+    c.f = mxstr_cached_pow10_f[index];
+    c.e = mxstr_cached_pow10_e[index];
+
+    w = mxstr_fp_mul(w, c);
+    plus = mxstr_fp_mul(plus, c);
+    minus = mxstr_fp_mul(minus, c);
+    minus.f++;
+    plus.f--;
+
+    /*
+     * Generate digits from the integral part (p1) and then the fractional
+     * part (p2) of the upper bound, stopping as soon as the digits are
+     * inside the rounding interval.
+     */
+    delta = plus.f - minus.f;
+    wp_w = plus.f - w.f;
+    one.e = plus.e;
+    one.f = 1ULL << -one.e;
+    p1 = (uint32_t)(plus.f >> -one.e);
+    p2 = plus.f & (one.f - 1);
+    kappa = (int)mxstr_digit_count(p1);
+
+    while (!done && kappa > 0) {
+        d = p1 / (uint32_t)mxstr_pow10[kappa - 1];
+        p1 %= (uint32_t)mxstr_pow10[kappa - 1];
+
+        if (d != 0 || len != 0) {
+            buf[len++] = '0' + d;
+        }
+
+        kappa--;
+        rest = ((uint64_t)p1 << -one.e) + p2;
+
+        if (rest <= delta) {
+            k += kappa;
+            mxstr_grisu_round(buf, len, delta, rest,
+                              mxstr_pow10[kappa] << -one.e, wp_w);
+            done = true;
+        }
+    }
+
+    while (!done) {
+        p2 *= 10;
+        delta *= 10;
+        d = (uint32_t)(p2 >> -one.e);
+
+        if (d != 0 || len != 0) {
+            buf[len++] = '0' + d;
+        }
+
+        p2 &= one.f - 1;
+        kappa--;
+
+        if (p2 < delta) {
+            k += kappa;
+            mxstr_grisu_round(buf, len, delta, p2, one.f,
+                              (-kappa < 20) ? wp_w * mxstr_pow10[-kappa] : 0);
+            done = true;
+        }
+    }
+
+    *exp10 = k;
+
+    return len;
+}
+
+
+/**
+ * Write a double as the shortest decimal string that converts back to the
+ * same value.
+ *
+ * The output is valid as a JSON number, and uses the same layout as
+ * JavaScript's Number.prototype.toString():
+ *
+ *  - 0, -0, 123, 1e+21 are written as "0", "-0", "123", "1e21"
+ *  - 0.5, 1234.5678 are written as "0.5", "1234.5678"
+ *  - 0.000001 is written as "0.000001", but 1e-7 is written as "1e-7"
+ *
+ * Non-finite values (infinity and NaN) can't be represented in JSON, and are
+ * not written. The digits are not always the shortest (see mxstr_grisu2()).
+ *
+ * If there are at least MXSTR_DOUBLE_MAX characters available, the value is
+ * formatted directly into the destination, otherwise it is formatted into a
+ * temporary buffer and copied if it fits.
+ *
+ * @param[in,out] dest
+ *   The string to write to. This is updated so that it references any
+ *   remaining space not written to.
+ *
+ * @param[in] value
+ *   The value to write.
+ *
+ * @return
+ *   Indicates whether the value was written. false is returned if the value
+ *   is not finite, or there is not enough space. Nothing is written when
+ *   false is returned. Note: MXSTR_DOUBLE_MAX characters is always
+ *   sufficient.
+ */
+static inline bool
+mxstr_put_double(mxstr_t *dest, double value)
+{
+    unsigned char  buf[MXSTR_DOUBLE_MAX];
+    unsigned char *start;
+    unsigned char *p;
+    unsigned int   len;
+    unsigned int   i;
+    int            exp10;
+    int            n;
+    bool           ok;
+
+    ok = isfinite(value);
+    start = (dest->len >= MXSTR_DOUBLE_MAX) ? dest->ptr : buf;
+    p = start;
+
+    if (ok) {
+        if (signbit(value)) {
+            *p++ = '-';
+            value = -value;
+        }
+
+        if (value == 0) {
+            *p++ = '0';
+        } else {
+            len = mxstr_grisu2(value, p, &exp10);
+
+            /*
+             * The value is d.ddd * 10^(n-1), where n is the position of the
+             * decimal point relative to the first digit.
+             */
+            n = (int)len + exp10;
+
+            if (exp10 >= 0 && n <= 21) {
+                /*
+                 * Integer: digits followed by exp10 zeros.
+                 */
+                memset(&p[len], '0', exp10);
+                p += n;
+
+            } else if (n > 0 && n <= 21) {
+                /*
+                 * Decimal point inside the digits.
+                 */
+                memmove(&p[n + 1], &p[n], len - n);
+                p[n] = '.';
+                p += len + 1;
+
+            } else if (n > -6 && n <= 0) {
+                /*
+                 * Leading "0." followed by -n zeros.
+                 */
+                memmove(&p[2 - n], p, len);
+                p[0] = '0';
+                p[1] = '.';
+
+                for (i = 2; i < (unsigned int)(2 - n); i++) {
+                    p[i] = '0';
+                }
+
+                p += len + 2 - n;
+
+            } else {
+                /*
+                 * Exponent form: d[.ddd]e[-]x
+                 */
+                if (len > 1) {
+                    memmove(&p[2], &p[1], len - 1);
+                    p[1] = '.';
+                    p += len + 1;
+                } else {
+                    p++;
+                }
+
+                *p++ = 'e';
+                n--;
+
+                if (n < 0) {
+                    *p++ = '-';
+                    n = -n;
+                }
+
+                i = mxstr_digit_count(n);
+                mxstr_put_digits(p, n, i);
+                p += i;
+            }
+        }
+
+        ok = (dest->len >= (size_t)(p - start));
+
+        if (ok && start == buf) {
+            (void)mxstr_write(dest, mxstr((char *)buf, p - buf));
+        } else if (ok) {
+            (void)mxstr_consume(dest, p - start);
+        }
+    }
+
+    return ok;
+}
+
+
 /*
  * ----------------------------------------------------------------------
  * Buffer
@@ -613,8 +1211,8 @@ mxbuf_require(mxbuf_t *buffer, size_t size)
     void    *ptr = NULL;
 
     if (buffer->available.len < size) {
-        new_size = max(mxutil_size_p2(buffer->buf.len), mxutil_size_p2(size));
         len = mxstr_substr_offset(buffer->buf, buffer->available);
+        new_size = mxutil_size_p2(len + size);
 
         if (buffer->buf.ptr != buffer->init.ptr) {
             ptr = buffer->buf.ptr;
@@ -627,6 +1225,28 @@ mxbuf_require(mxbuf_t *buffer, size_t size)
 }
 
 
+/**
+ * Add zero filled padding after the contents of a buffer.
+ *
+ * The padding is not part of the buffer contents (it is not included in
+ * mxbuf_str()), and remains in place until the buffer is next written to,
+ * trimmed or freed. For example, this provides the padding required by
+ * mxjson_parse_padded().
+ *
+ * @param[in] buffer
+ *   The buffer.
+ *
+ * @param[in] padding
+ *   The number of bytes of padding required.
+ */
+static inline void
+mxbuf_pad(mxbuf_t *buffer, size_t padding)
+{
+    mxbuf_require(buffer, padding);
+    memset(buffer->available.ptr, 0, padding);
+}
+
+
 /**
  * Write a string to a buffer.
  *
@@ -742,6 +1362,72 @@ mxbuf_write_chars(mxbuf_t *buffer, unsigned char c, size_t n)
 }
 
 
+/**
+ * Write an unsigned integer to a buffer as a decimal string.
+ *
+ * The digits are formatted directly into the available space in the
+ * buffer, which is resized if necessary.
+ *
+ * @param[in] buffer
+ *   The buffer to write to.
+ *
+ * @param[in] value
+ *   The value to write.
+ *
+ * @return
+ *   Indicates whether the value was written successfully (i.e. always
+ *   returns true).
+ */
+static inline bool
+mxbuf_put_uint64(mxbuf_t *buffer, uint64_t value)
+{
+    mxbuf_require(buffer, MXSTR_INT64_MAX);
+
+    return mxstr_put_uint64(&buffer->available, value);
+}
+
+
+/**
+ * Write a signed integer to a buffer as a decimal string.
+ *
+ * See mxbuf_put_uint64().
+ */
+static inline bool
+mxbuf_put_int64(mxbuf_t *buffer, int64_t value)
+{
+    mxbuf_require(buffer, MXSTR_INT64_MAX + 1);
+
+    return mxstr_put_int64(&buffer->available, value);
+}
+
+
+/**
+ * Write a double to a buffer as the shortest decimal string that converts
+ * back to the same value.
+ *
+ * The buffer is resized if necessary so that MXSTR_DOUBLE_MAX characters
+ * are available, and the value is formatted directly into the available
+ * space. See mxstr_put_double() for details of the format.
+ *
+ * @param[in] buffer
+ *   The buffer to write to.
+ *
+ * @param[in] value
+ *   The value to write.
+ *
+ * @return
+ *   Indicates whether the value was written. false is returned if the value
+ *   is not finite.
+ */
+static inline bool
+mxbuf_put_double(mxbuf_t *buffer, double value)
+{
+    mxbuf_require(buffer, MXSTR_DOUBLE_MAX);
+
+    return mxstr_put_double(&buffer->available, value);
+}
+
+
 /**
  * Get a string reference for a buffers contents.
  *
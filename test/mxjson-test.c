@@ -6,9 +6,14 @@
  * ----------------------------------------------------------------------
  */
 
+#include <pthread.h>
 #include <stdio.h>
 
 #include "mxjson.h"
+#include "mxjson-doc.h"
+#include "mxjson-par.h"
+#include "mxjson-tape.h"
+#include "mxjson-write.h"
 #include "mxutil.h"
 
 typedef struct {
@@ -377,6 +382,32 @@ static const testcase_t testcases[] = {
 static int mxjson_test_return_code;
 
 
+/**
+ * Parse a zero padded copy of some JSON with mxjson_parse_padded(), and
+ * check that the result (validity and number of tokens) matches the result
+ * of parsing the JSON with mxjson_parse().
+ */
+static bool
+mxjson_test_padded (mxjson_parser_t *p, mxstr_t json, bool ok)
+{
+    mxjson_parser_t padded;
+    mxbuf_t         buffer;
+    bool            match;
+
+    mxbuf_create(&buffer, NULL, 0);
+    mxbuf_write(&buffer, json);
+    mxbuf_pad(&buffer, MXJSON_PADDING);
+
+    mxjson_init(&padded, 0, NULL, mxjson_resize);
+    match = (mxjson_parse_padded(&padded, mxbuf_str(&buffer)) == ok &&
+             (!ok || padded.idx == p->idx));
+    mxjson_free(&padded);
+    mxbuf_free(&buffer);
+
+    return match;
+}
+
+
 /**
  * Perform a test by parsing some JSON
  *
@@ -410,12 +441,1170 @@ mxjson_test (char *test_name, mxjson_parser_t *p, mxstr_t json)
         break;
     }
 
+    /*
+     * Validation must give the same result as parsing, unless the parse
+     * failed due to insufficient tokens.
+     */
+    if (p->idx < p->count && mxjson_validate(json) != ok) {
+        fail = true;
+    }
+
+    /*
+     * Parsing with padding must give the same result as parsing without.
+     */
+    if (p->idx < p->count && !mxjson_test_padded(p, json, ok)) {
+        fail = true;
+    }
+
     printf("%s: %-60s %s\n", fail ? "FAIL" : "PASS", test_name,
            ok ? "Valid" : (p->idx >= p->count) ? "Errored" : "Rejected");
 
     mxjson_test_return_code |= fail;
 }
 
+/**
+ * Record the result of a test that checks a condition.
+ */
+static void
+mxjson_test_check (char *test_name, bool ok)
+{
+    printf("%s: %-60s\n", ok ? "PASS" : "FAIL", test_name);
+
+    mxjson_test_return_code |= !ok;
+}
+
+
+/**
+ * Test serialisation of parsed JSON.
+ *
+ * Each valid testcase is parsed, written in compact form, and then the
+ * output is parsed and written again - the two outputs must be identical.
+ * Indented output and string escaping are checked against known results.
+ */
+static void
+mxjson_test_write (void)
+{
+    mxjson_parser_t p;
+    mxbuf_t         out1;
+    mxbuf_t         out2;
+    bool            ok = true;
+    unsigned int    i;
+
+    mxjson_init(&p, 0, NULL, mxjson_resize);
+    mxbuf_create(&out1, NULL, 0);
+    mxbuf_create(&out2, NULL, 0);
+
+    for (i = 0; i < mxarray_size(testcases); i++) {
+        if (testcases[i].test_name[0] == 'y' &&
+            mxjson_parse(&p, mxstr(testcases[i].json, testcases[i].len))) {
+            mxbuf_reset(&out1);
+            mxbuf_reset(&out2);
+            (void)mxjson_write(&p, 1, &out1, 0);
+            ok = ok && mxjson_parse(&p, mxbuf_str(&out1));
+            (void)mxjson_write(&p, 1, &out2, 0);
+            ok = ok && mxstr_cmp(mxbuf_str(&out1), mxbuf_str(&out2)) == 0;
+        }
+    }
+    mxjson_test_check("write_compact_roundtrip", ok);
+
+    ok = mxjson_parse(&p, mxstr_literal("{ \"a\" : [1, {\"b\":null}, []],"
+                                        " \"c\":\"x\\\"y\" }"));
+    mxbuf_reset(&out1);
+    (void)mxjson_write(&p, 1, &out1, 2);
+    ok = ok && mxstr_cmp(mxbuf_str(&out1),
+                         mxstr_literal("{\n"
+                                       "  \"a\": [\n"
+                                       "    1,\n"
+                                       "    {\n"
+                                       "      \"b\": null\n"
+                                       "    },\n"
+                                       "    []\n"
+                                       "  ],\n"
+                                       "  \"c\": \"x\\\"y\"\n"
+                                       "}")) == 0;
+    mxjson_test_check("write_indented", ok);
+
+    mxbuf_reset(&out1);
+    (void)mxjson_write(&p, 2, &out1, 0);
+    ok = mxstr_cmp(mxbuf_str(&out1), mxstr_literal("[1,{\"b\":null},[]]")) == 0;
+    mxjson_test_check("write_subtree", ok);
+
+    mxbuf_reset(&out1);
+    (void)mxjson_write_string(&out1, mxstr_literal("0123456789abcdef\"\\/\b\f"
+                                                   "\n\r\t\x01\x1f 0123456789"));
+    ok = mxstr_cmp(mxbuf_str(&out1),
+                   mxstr_literal("\"0123456789abcdef\\\"\\\\/\\b\\f"
+                                 "\\n\\r\\t\\u0001\\u001f 0123456789\"")) == 0;
+    mxjson_test_check("write_string_escape", ok);
+
+    mxbuf_free(&out1);
+    mxbuf_free(&out2);
+    mxjson_free(&p);
+}
+
+
+/**
+ * Flush callback for the streaming writer tests, which appends the
+ * output to a buffer.
+ */
+static bool
+mxjson_test_flush (void *ctx, mxstr_t data)
+{
+    mxbuf_t *out = ctx;
+
+    (void)mxbuf_write(out, data);
+
+    return (data.len <= 8);
+}
+
+
+/**
+ * Test the streaming writer.
+ *
+ * A small buffer is used so that the output is flushed many times.
+ */
+static void
+mxjson_test_writer (void)
+{
+    mxjson_writer_t w;
+    char            buf[8];
+    mxbuf_t         out;
+    bool            ok;
+
+    mxbuf_create(&out, NULL, 0);
+
+    mxjson_writer_init(&w, buf, sizeof(buf), mxjson_test_flush, &out);
+    (void)mxjson_writer_begin_object(&w);
+    (void)mxjson_writer_key(&w, mxstr_literal("name \"quoted\""));
+    (void)mxjson_writer_string(&w, mxstr_literal("line1\nline2"));
+    (void)mxjson_writer_key(&w, mxstr_literal("values"));
+    (void)mxjson_writer_begin_array(&w);
+    (void)mxjson_writer_number(&w, mxstr_literal("-1.5e3"));
+    (void)mxjson_writer_bool(&w, true);
+    (void)mxjson_writer_null(&w);
+    (void)mxjson_writer_begin_object(&w);
+    (void)mxjson_writer_end_object(&w);
+    (void)mxjson_writer_raw(&w, mxstr_literal("[1,2]"));
+    (void)mxjson_writer_int(&w, -42);
+    (void)mxjson_writer_double(&w, 0.25);
+    (void)mxjson_writer_end_array(&w);
+    (void)mxjson_writer_end_object(&w);
+    ok = mxjson_writer_finish(&w);
+    ok = ok && mxstr_cmp(mxbuf_str(&out),
+                         mxstr_literal("{\"name \\\"quoted\\\"\":"
+                                       "\"line1\\nline2\",\"values\":"
+                                       "[-1.5e3,true,null,{},[1,2],-42,0.25]}")) == 0;
+    mxjson_test_check("writer_stream", ok);
+
+    mxjson_writer_init(&w, buf, sizeof(buf), mxjson_test_flush, &out);
+    (void)mxjson_writer_begin_object(&w);
+    ok = !mxjson_writer_null(&w) && !mxjson_writer_finish(&w);
+    mxjson_test_check("writer_value_without_key", ok);
+
+    mxjson_writer_init(&w, buf, sizeof(buf), mxjson_test_flush, &out);
+    (void)mxjson_writer_begin_array(&w);
+    ok = !mxjson_writer_key(&w, mxstr_literal("a"));
+    mxjson_test_check("writer_key_in_array", ok);
+
+    mxjson_writer_init(&w, buf, sizeof(buf), mxjson_test_flush, &out);
+    (void)mxjson_writer_begin_array(&w);
+    ok = !mxjson_writer_end_object(&w);
+    mxjson_test_check("writer_mismatched_end", ok);
+
+    mxjson_writer_init(&w, buf, sizeof(buf), mxjson_test_flush, &out);
+    (void)mxjson_writer_null(&w);
+    ok = !mxjson_writer_null(&w);
+    mxjson_test_check("writer_two_top_level_values", ok);
+
+    mxjson_writer_init(&w, buf, sizeof(buf), mxjson_test_flush, &out);
+    (void)mxjson_writer_begin_array(&w);
+    ok = !mxjson_writer_number(&w, mxstr_literal("01")) &&
+         !mxjson_writer_end_array(&w);
+    mxjson_test_check("writer_invalid_number", ok);
+
+    mxjson_writer_init(&w, buf, sizeof(buf), mxjson_test_flush, &out);
+    (void)mxjson_writer_begin_array(&w);
+    ok = !mxjson_writer_finish(&w);
+    mxjson_test_check("writer_unclosed_array", ok);
+
+    mxbuf_free(&out);
+}
+
+
+/**
+ * Test formatting of numbers.
+ *
+ * Doubles must be written in their shortest form, and a sample of values
+ * spread across the whole range of doubles must convert back exactly.
+ */
+static void
+mxjson_test_numbers (void)
+{
+    static const struct {
+        double  value;
+        char   *str;
+    } doubles[] = {
+        { 0.0, "0" },
+        { -0.0, "-0" },
+        { 1.0, "1" },
+        { -123.0, "-123" },
+        { 0.1, "0.1" },
+        { 0.3, "0.3" },
+        { 1234.5678, "1234.5678" },
+        { 0.000001, "0.000001" },
+        { 1e-7, "1e-7" },
+        { 1e21, "1e21" },
+        { 123456789012345678.0, "123456789012345680" },
+        { 5e-324, "5e-324" },
+        { 1.7976931348623157e308, "1.7976931348623157e308" },
+        { 2.2250738585072014e-308, "2.2250738585072014e-308" },
+    };
+    mxbuf_t      out;
+    mxstr_t      s;
+    char         str[MXSTR_DOUBLE_MAX + 1];
+    uint64_t     bits = 1;
+    double       value;
+    bool         ok = true;
+    unsigned int i;
+
+    mxbuf_create(&out, NULL, 0);
+
+    for (i = 0; i < mxarray_size(doubles); i++) {
+        mxbuf_reset(&out);
+        ok = ok && mxbuf_put_double(&out, doubles[i].value) &&
+             mxstr_cmp(mxbuf_str(&out),
+                       mxstr(doubles[i].str, strlen(doubles[i].str))) == 0;
+    }
+    mxjson_test_check("number_double_format", ok);
+
+    for (i = 0; ok && i < 100000; i++) {
+        bits = bits * 6364136223846793005ULL + 1442695040888963407ULL;
+        memcpy(&value, &bits, sizeof(value));
+        s = mxstr(str, MXSTR_DOUBLE_MAX);
+
+        if (mxstr_put_double(&s, value)) {
+            str[MXSTR_DOUBLE_MAX - s.len] = '\0';
+            ok = (strtod(str, NULL) == value);
+        } else {
+            ok = !isfinite(value);
+        }
+    }
+    mxjson_test_check("number_double_roundtrip", ok);
+
+    /*
+     * With less than MXSTR_DOUBLE_MAX characters available the value is
+     * formatted separately, and only written if it fits.
+     */
+    memset(str, '#', sizeof(str));
+    s = mxstr(str, 6);
+    ok = (!mxstr_put_double(&s, -1.2345) && s.len == 6 && str[0] == '#');
+    s = mxstr(str, 7);
+    ok = ok && mxstr_put_double(&s, -1.2345) && s.len == 0 &&
+         memcmp(str, "-1.2345#", 8) == 0;
+    mxjson_test_check("number_double_space", ok);
+
+    mxbuf_reset(&out);
+    ok = (mxbuf_put_int64(&out, INT64_MIN) && mxbuf_putc(&out, ' ') &&
+          mxbuf_put_int64(&out, 0) && mxbuf_putc(&out, ' ') &&
+          mxbuf_put_uint64(&out, UINT64_MAX) &&
+          mxstr_cmp(mxbuf_str(&out),
+                    mxstr_literal("-9223372036854775808 0 "
+                                  "18446744073709551615")) == 0);
+    mxjson_test_check("number_integer_format", ok);
+
+    ok = !mxbuf_put_double(&out, NAN) && !mxbuf_put_double(&out, INFINITY);
+    mxjson_test_check("number_non_finite", ok);
+
+    mxbuf_free(&out);
+}
+
+
+/**
+ * Test unescaping of names and string values.
+ */
+static void
+mxjson_test_unescape (void)
+{
+    static char     json[] = "{\"a\\tb\": [\"a\\nb\", \"\\u00e9x\", \"\\ud83d\\ude00\"]}";
+    mxjson_parser_t p;
+    mxbuf_t         buffer;
+    mxbuf_t         input;
+    mxstr_t         str;
+    bool            valid = false;
+    bool            ok;
+    int             i;
+
+    mxjson_init(&p, 0, NULL, mxjson_resize);
+    mxbuf_create(&buffer, NULL, 0);
+    ok = (mxjson_parse(&p, mxstr_literal(json)) &&
+          mxstr_cmp(mxjson_token_name(&p, 2, &buffer, &valid),
+                    mxstr_literal("a\tb")) == 0 && valid &&
+          mxstr_cmp(mxjson_token_string(&p, 3, &buffer, &valid),
+                    mxstr_literal("a\nb")) == 0 && valid &&
+          mxstr_cmp(mxjson_token_string(&p, 4, &buffer, &valid),
+                    mxstr_literal("\xc3\xa9x")) == 0 && valid &&
+          mxstr_cmp(mxjson_token_string(&p, 5, &buffer, &valid),
+                    mxstr_literal("\xf0\x9f\x98\x80")) == 0 && valid);
+    mxjson_test_check("unescape", ok);
+
+    /*
+     * The buffer is reallocated while unescaping a long string.
+     */
+    mxbuf_create(&input, NULL, 0);
+    (void)mxbuf_write(&input, mxstr_literal("[\""));
+
+    for (i = 0; i < 1000; i++) {
+        (void)mxbuf_write(&input, mxstr_literal("\\u00e9"));
+    }
+    (void)mxbuf_write(&input, mxstr_literal("\"]"));
+
+    mxbuf_reset(&buffer);
+    (void)mxbuf_putc(&buffer, '-');
+    ok = mxjson_parse(&p, mxbuf_str(&input));
+    str = mxjson_token_string(&p, 2, &buffer, &valid);
+    ok = (ok && valid && str.len == 2000);
+
+    for (i = 0; ok && i < 1000; i++) {
+        ok = (str.ptr[2 * i] == 0xc3 && str.ptr[2 * i + 1] == 0xa9);
+    }
+    mxjson_test_check("unescape_buffer_resize", ok);
+
+    mxbuf_free(&input);
+    mxbuf_free(&buffer);
+    mxjson_free(&p);
+}
+
+
+#if MXJSON_SPAN
+/**
+ * Test the input spans recorded for each value.
+ */
+static void
+mxjson_test_span (void)
+{
+    static char     json[] = " {\"a\" : [1, {\"b\": null}, \"s\\\"\" ] , \"c\":true}  ";
+    mxjson_parser_t p;
+    bool            ok;
+
+    mxjson_init(&p, 0, NULL, mxjson_resize);
+    ok = (mxjson_parse(&p, mxstr_literal(json)) &&
+          mxstr_cmp(mxjson_token_raw(&p, 1),
+                    mxstr_literal("{\"a\" : [1, {\"b\": null}, \"s\\\"\" ] ,"
+                                  " \"c\":true}")) == 0 &&
+          mxstr_cmp(mxjson_token_raw(&p, 2),
+                    mxstr_literal("[1, {\"b\": null}, \"s\\\"\" ]")) == 0 &&
+          mxstr_cmp(mxjson_token_raw(&p, 3), mxstr_literal("1")) == 0 &&
+          mxstr_cmp(mxjson_token_raw(&p, 4),
+                    mxstr_literal("{\"b\": null}")) == 0 &&
+          mxstr_cmp(mxjson_token_raw(&p, 5), mxstr_literal("null")) == 0 &&
+          mxstr_cmp(mxjson_token_raw(&p, 6), mxstr_literal("\"s\\\"\"")) == 0 &&
+          mxstr_cmp(mxjson_token_raw(&p, 7), mxstr_literal("true")) == 0);
+    mxjson_test_check("span_raw_values", ok);
+    mxjson_free(&p);
+}
+#endif
+
+
+#if MXJSON_STATS
+/**
+ * Test the statistics collected during parsing.
+ */
+static void
+mxjson_test_stats (void)
+{
+    static char     json[] = " {\"a\": [1, \"x\\n\\t\"], \"b\\\"\": true} ";
+    mxjson_parser_t p;
+    mxjson_stats_t  stats;
+    mxjson_phase    phase;
+    bool            ok;
+
+    mxjson_init(&p, 0, NULL, mxjson_resize);
+    ok = mxjson_parse(&p, mxstr_literal(json));
+    stats = mxjson_stats(&p);
+    ok = (ok && stats.bytes == sizeof(json) - 1 &&
+          stats.values[MXJSON_OBJECT] == 1 &&
+          stats.values[MXJSON_ARRAY] == 1 &&
+          stats.values[MXJSON_NUMBER] == 1 &&
+          stats.values[MXJSON_STRING] == 1 &&
+          stats.values[MXJSON_BOOL] == 1 &&
+          stats.values[MXJSON_NULL] == 0 &&
+          stats.value_bytes[MXJSON_OBJECT] == 2 &&
+          stats.value_bytes[MXJSON_ARRAY] == 2 &&
+          stats.value_bytes[MXJSON_NUMBER] == 1 &&
+          stats.value_bytes[MXJSON_STRING] == 7 &&
+          stats.value_bytes[MXJSON_BOOL] == 4 &&
+          stats.name_bytes == 8 &&
+          stats.escapes == 3 &&
+          stats.resizes == 3 &&
+          stats.resize_bytes == 6 * sizeof(mxjson_token_t) &&
+          stats.max_depth == 2);
+
+    for (phase = MXJSON_PHASE_STRING; ok && phase < MXJSON_PHASE_COUNT;
+         phase++) {
+        ok = (stats.cycles[phase] <= stats.cycles[MXJSON_PHASE_PARSE]);
+    }
+    mxjson_test_check("stats", ok);
+
+    /*
+     * The statistics are reset for each parse.
+     */
+    ok = (mxjson_parse(&p, mxstr_literal("[]")) &&
+          mxjson_stats(&p).bytes == 2 &&
+          mxjson_stats(&p).values[MXJSON_ARRAY] == 1 &&
+          mxjson_stats(&p).escapes == 0 &&
+          mxjson_stats(&p).resizes == 0 &&
+          mxjson_stats(&p).max_depth == 1);
+    mxjson_test_check("stats_reset", ok);
+    mxjson_free(&p);
+}
+#endif
+
+
+/**
+ * Check a set of SIMD kernels against the scalar kernels, for all lengths
+ * up to 200 characters, with a special character at each position.
+ */
+static bool
+mxjson_test_kernel_set (const mxjson_kernels_t *k)
+{
+    static const unsigned char special[] = { '\"', '\\', 0x00, 0x1f, ' ',
+                                             0x7f, 0x80, 0xff };
+    unsigned char buf[256];
+    size_t        len;
+    size_t        pos;
+    size_t        i;
+    bool          ok = true;
+
+    for (i = 0; ok && i < sizeof(special); i++) {
+        for (len = 0; ok && len <= 200; len++) {
+            for (pos = 0; ok && pos <= len; pos++) {
+                /*
+                 * The special character at buf[len] is outside the checked
+                 * length, so must not affect the result.
+                 */
+                memset(buf, 'a', sizeof(buf));
+                buf[pos] = special[i];
+                ok = (k->string_span(buf, len) ==
+                      mxjson_string_span_scalar(buf, len) &&
+                      k->string_span(&buf[1], len / 2) ==
+                      mxjson_string_span_scalar(&buf[1], len / 2));
+            }
+        }
+    }
+
+    return ok;
+}
+
+
+/**
+ * Test the SIMD kernels supported by the host.
+ */
+static void
+mxjson_test_kernels (void)
+{
+#if MXJSON_DISPATCH
+    static const mxjson_kernels_t sse2 = {
+        "sse2", mxjson_string_span_sse2
+    };
+    static const mxjson_kernels_t avx2 = {
+        "avx2", mxjson_string_span_avx2
+    };
+    static const mxjson_kernels_t avx512 = {
+        "avx512bw", mxjson_string_span_avx512
+    };
+    const mxjson_kernels_t       *best = &sse2;
+
+    mxjson_test_check("kernels_sse2", mxjson_test_kernel_set(&sse2));
+
+    if (__builtin_cpu_supports("avx2")) {
+        mxjson_test_check("kernels_avx2", mxjson_test_kernel_set(&avx2));
+        best = &avx2;
+    }
+
+    if (__builtin_cpu_supports("avx512bw")) {
+        mxjson_test_check("kernels_avx512bw", mxjson_test_kernel_set(&avx512));
+        best = &avx512;
+    }
+
+    /*
+     * The best kernels supported by the host are selected.
+     */
+    mxjson_test_check("kernels_best",
+                      strcmp(mxjson_kernels()->name, best->name) == 0);
+#endif
+
+    mxjson_test_check("kernels_selected",
+                      mxjson_test_kernel_set(mxjson_kernels()));
+}
+
+
+/**
+ * Test the token depths.
+ */
+static void
+mxjson_test_depth (void)
+{
+    static char          json[] = "{\"a\": [1, {\"b\": [[]]}], \"c\": 2}";
+    static const uint8_t depths[] = { 0, 0, 1, 2, 2, 3, 4, 1 };
+    mxjson_parser_t      p;
+    mxjson_idx_t         idx;
+    bool                 ok;
+
+    mxjson_init(&p, 0, NULL, mxjson_resize);
+    ok = (mxjson_parse(&p, mxstr_literal(json)) &&
+          p.idx + 1 == sizeof(depths));
+
+    for (idx = 1; ok && idx <= p.idx; idx++) {
+        ok = (mxjson_depth(&p, idx) == depths[idx]);
+    }
+
+    mxjson_test_check("depth", ok);
+    mxjson_free(&p);
+}
+
+
+/**
+ * Test random access to array elements, with and without offset tables.
+ */
+static void
+mxjson_test_array_at (void)
+{
+    static char      dense[] = "[-2.5, 0, 1, 1e1, 12, 40]";
+    static char      mixed[] = "[1, [2, 3], {\"a\": [4]}, 5, [], 6]";
+    static const mxjson_idx_t elements[] = { 2, 3, 6, 9, 10, 11 };
+    mxjson_parser_t  p;
+    mxjson_idx_t     threshold;
+    size_t           pos;
+    size_t           i;
+    bool             ok;
+
+    mxjson_init(&p, 0, NULL, mxjson_resize);
+    ok = mxjson_parse(&p, mxstr_literal(dense));
+
+    for (i = 0; ok && i < 6; i++) {
+        ok = (mxjson_array_at(&p, 1, i) == i + 2);
+    }
+
+    ok = (ok && mxjson_array_at(&p, 1, 6) == MXJSON_IDX_NONE &&
+          mxjson_array_search(&p, 1, 10, &pos) && pos == 3 &&
+          !mxjson_array_search(&p, 1, 11, &pos) && pos == 4 &&
+          !mxjson_array_search(&p, 1, -3, &pos) && pos == 0 &&
+          !mxjson_array_search(&p, 1, 41, &pos) && pos == 6 &&
+          mxjson_array_search(&p, 1, 40, &pos) && pos == 5);
+
+    /*
+     * The offset table is built on the first access, and discarded by the
+     * next parse.
+     */
+    for (threshold = 0; threshold < 3; threshold++) {
+        mxjson_array_index(&p, threshold * 6);
+        ok = ok && mxjson_parse(&p, mxstr_literal(mixed));
+
+        for (i = 0; ok && i < mxarray_size(elements); i++) {
+            ok = (mxjson_array_at(&p, 1, i) == elements[i] &&
+                  mxjson_array_at(&p, 1, 5 - i) == elements[5 - i]);
+        }
+
+        ok = (ok && mxjson_array_at(&p, 1, 6) == MXJSON_IDX_NONE &&
+              p.index.used == (threshold == 1));
+    }
+
+    mxjson_test_check("array_at", ok);
+    mxjson_free(&p);
+}
+
+
+/**
+ * Test reordering the tokens so that the children of each token are
+ * consecutive.
+ */
+static void
+mxjson_test_breadth (void)
+{
+    static char               json[] = "{\"a\": [1, {\"b\": [[]]}], "
+                                       "\"c\": 2, \"d\": {\"e\": 3}}";
+    static const mxjson_idx_t parents[] = { 0, 0, 1, 1, 1, 2, 2, 4, 6, 8 };
+    static const uint8_t      depths[] = { 0, 0, 1, 1, 1, 2, 2, 2, 3, 4 };
+    mxjson_parser_t           p;
+    mxjson_token_t            doc[64];
+    mxbuf_t                   buffer;
+    mxjson_idx_t              children[3];
+    mxjson_idx_t              idx;
+    char                      path[] = "/tmp/mxjson-test-XXXXXX";
+    char                      tape_path[sizeof(path) + 5];
+    int                       fd;
+    bool                      ok;
+
+    mxbuf_create(&buffer, NULL, 0);
+    mxjson_init(&p, 0, NULL, mxjson_resize);
+    ok = (mxjson_parse(&p, mxstr_literal(json)) &&
+          p.idx + 1 == sizeof(depths));
+    mxjson_breadth_first(&p);
+
+    for (idx = 1; ok && idx <= p.idx; idx++) {
+        ok = (p.tokens[idx].parent == parents[idx] &&
+              mxjson_depth(&p, idx) == depths[idx]);
+    }
+
+    ok = (ok && mxjson_children(&p, 1, children) == 3 &&
+          children[0] == 2 && children[1] == 3 && children[2] == 4 &&
+          mxjson_children(&p, 4, children) == 1 && children[0] == 7 &&
+          mxjson_first(&p, 9) == mxjson_end(&p, 9) &&
+          mxjson_end(&p, 3) == 4 && mxjson_array_at(&p, 2, 1) == 6 &&
+          mxstr_cmp(mxjson_token_name(&p, 3, &buffer, NULL),
+                    mxstr_literal("c")) == 0 &&
+          mxstr_cmp(mxjson_token_string(&p, 7, &buffer, NULL),
+                    mxstr_literal("3")) == 0);
+
+    /*
+     * The next parse restores the depth-first order.
+     */
+    ok = ok && mxjson_parse(&p, mxstr_literal(json));
+
+    for (idx = 1; ok && idx <= p.idx; idx++) {
+        ok = (mxjson_next(&p, idx) == mxjson_end(&p, idx));
+    }
+
+    mxjson_test_check("breadth", ok && mxjson_next(&p, 1) == p.idx + 1);
+
+    /*
+     * Functions that require depth-first order fail, without any output,
+     * once the tokens are reordered.
+     */
+    fd = mkstemp(path);
+    ok = (fd != -1);
+    (void)close(fd);
+    snprintf(tape_path, sizeof(tape_path), "%s.tape", path);
+    mxjson_lazy_depth(&p, 2);
+    ok = ok && mxjson_parse(&p, mxstr_literal(json));
+    mxjson_breadth_first(&p);
+
+    for (idx = 1; ok && p.tokens[idx].value_type != MXJSON_RAW; idx++) {
+        ok = (idx < p.idx);
+    }
+
+    mxbuf_reset(&buffer);
+    ok = (ok && mxjson_write(&p, 1, &buffer, 0) == 0 &&
+          mxbuf_str(&buffer).len == 0 &&
+          mxjson_detach(&p, 1) == NULL &&
+          !mxjson_detach_to(&p, 1, (mxjson_doc_t *)doc, sizeof(doc)) &&
+          !mxjson_expand(&p, idx) &&
+          p.tokens[idx].value_type == MXJSON_RAW &&
+          !mxjson_tape_save(&p, tape_path) &&
+          access(tape_path, F_OK) != 0);
+    mxjson_test_check("breadth_refused", ok);
+    (void)unlink(path);
+
+    mxjson_free(&p);
+    mxbuf_free(&buffer);
+}
+
+
+/**
+ * Test parsing with a depth limit, and expanding the untokenized values.
+ */
+static void
+mxjson_test_lazy (void)
+{
+    static char     json[] = "{\"id\": 7, \"meta\": {\"a\": [1, 2]}, "
+                             "\"payload\": [{\"x\": \"y\\n\"}, [[]], 3]}";
+    mxjson_parser_t p;
+    mxjson_parser_t full;
+    mxjson_parser_t child;
+    mxbuf_t         buffer;
+    mxjson_idx_t    idx;
+    unsigned int    i;
+    bool            ok;
+
+    mxbuf_create(&buffer, NULL, 0);
+    mxjson_init(&p, 0, NULL, mxjson_resize);
+    mxjson_init(&full, 0, NULL, mxjson_resize);
+    mxjson_init(&child, 0, NULL, mxjson_resize);
+    mxjson_lazy_depth(&p, 1);
+    ok = (mxjson_parse(&full, mxstr_literal(json)) &&
+          mxjson_parse(&p, mxstr_literal(json)) && p.idx == 4 &&
+          p.tokens[3].value_type == MXJSON_RAW &&
+          p.tokens[4].value_type == MXJSON_RAW &&
+          mxjson_next(&p, 1) == 5 &&
+          mxstr_cmp(mxjson_token_string(&p, 3, &buffer, NULL),
+                    mxstr_literal("{\"a\": [1, 2]}")) == 0);
+
+    /*
+     * A value expanded to a separate parser context has offsets relative to
+     * the raw token.
+     */
+    ok = (ok && mxjson_expand_to(&p, 4, &child) && child.idx == 6 &&
+          child.tokens[1].value_type == MXJSON_ARRAY &&
+          child.tokens[1].children == 3);
+
+    /*
+     * Expanding each raw token in place, one level at a time, gives the
+     * tokens of a full parse.
+     */
+    for (idx = 1; ok && idx <= p.idx; idx++) {
+        if (p.tokens[idx].value_type == MXJSON_RAW) {
+            ok = mxjson_expand(&p, idx);
+        }
+    }
+
+    ok = (ok && p.idx == full.idx &&
+          memcmp(&p.tokens[1], &full.tokens[1],
+                 p.idx * sizeof(*p.tokens)) == 0);
+
+    /*
+     * The input is validated as for a full parse, including the depth of
+     * the untokenized values.
+     */
+    for (i = 0; ok && i < 2; i++) {
+        mxbuf_reset(&buffer);
+        mxbuf_write_chars(&buffer, '[', MXJSON_MAX_DEPTH + i);
+        mxbuf_write_chars(&buffer, ']', MXJSON_MAX_DEPTH + i);
+        ok = (mxjson_parse(&p, mxbuf_str(&buffer)) == (i == 0) &&
+              mxjson_parse(&full, mxbuf_str(&buffer)) == (i == 0));
+    }
+
+    ok = (ok && !mxjson_parse(&p, mxstr_literal("{\"a\": {\"b\": [1,]}}")) &&
+          !mxjson_parse(&p, mxstr_literal("[[1] ]]")) &&
+          mxjson_parse(&p, mxstr_literal(" [[1] ] ")) && p.idx == 2);
+
+    mxjson_test_check("lazy", ok);
+    mxbuf_free(&buffer);
+    mxjson_free(&child);
+    mxjson_free(&full);
+    mxjson_free(&p);
+}
+
+
+/**
+ * Write a string to a file, replacing any existing contents.
+ */
+static bool
+mxjson_test_write_file (const char *path, mxstr_t data)
+{
+    FILE *fp = fopen(path, "wb");
+    bool  ok = (fp != NULL);
+
+    if (ok) {
+        ok = (fwrite(data.ptr, 1, data.len, fp) == data.len);
+        ok = (fclose(fp) == 0) && ok;
+    }
+
+    return ok;
+}
+
+
+/**
+ * Test saving and reloading parsed JSON using a tape file.
+ */
+static void
+mxjson_test_tape (void)
+{
+    static char          json[] = "{\"a\": [1, 2.5, \"x\\n\"], "
+                                  "\"b\": {\"c\": null}}";
+    static char          json2[] = "[true, false]";
+    char                 json_path[] = "/tmp/mxjson-test-XXXXXX";
+    char                 tape_path[sizeof(json_path) + 5];
+    mxjson_parser_t      p;
+    mxjson_tape_t        tape;
+    mxjson_tape_header_t hdr;
+    unsigned char        c;
+    FILE                *fp;
+    int                  fd;
+    bool                 ok;
+
+    fd = mkstemp(json_path);
+    ok = (fd != -1);
+    if (ok) {
+        (void)close(fd);
+    }
+    snprintf(tape_path, sizeof(tape_path), "%s.tape", json_path);
+
+    mxjson_init(&p, 0, NULL, mxjson_resize);
+    ok = ok && (mxjson_parse(&p, mxstr_literal(json)) &&
+                mxjson_test_write_file(json_path, mxstr_literal(json)));
+
+    /*
+     * The first load parses the JSON and saves the tape, the second load
+     * uses the tape. Both must match the result of parsing the JSON.
+     */
+    ok = ok && mxjson_tape_load(&tape, json_path, tape_path);
+    mxjson_tape_close(&tape);
+    ok = ok && (mxjson_tape_load(&tape, json_path, tape_path) &&
+                tape.parser.idx == p.idx &&
+                mxstr_cmp(tape.parser.json, p.json) == 0 &&
+                memcmp(tape.parser.tokens, p.tokens,
+                       (p.idx + 1) * sizeof(*p.tokens)) == 0 &&
+                tape.parser.tokens[2].value_type == MXJSON_ARRAY &&
+                tape.parser.json.ptr[tape.parser.tokens[2].name] == 'a');
+    mxjson_tape_close(&tape);
+    mxjson_test_check("tape_reload", ok);
+
+    /*
+     * Changing the JSON causes it to be parsed again.
+     */
+    ok = (mxjson_test_write_file(json_path, mxstr_literal(json2)) &&
+          mxjson_tape_load(&tape, json_path, tape_path) &&
+          tape.parser.idx == 3 &&
+          tape.parser.tokens[3].value_type == MXJSON_BOOL);
+    mxjson_tape_close(&tape);
+    mxjson_test_check("tape_source_changed", ok);
+
+    /*
+     * Corrupting the tape is detected by the checksum.
+     */
+    fp = fopen(tape_path, "r+b");
+    ok = (fp != NULL &&
+          fseek(fp, sizeof(mxjson_tape_header_t) + 1, SEEK_SET) == 0 &&
+          fread(&c, 1, 1, fp) == 1 &&
+          fseek(fp, sizeof(mxjson_tape_header_t) + 1, SEEK_SET) == 0);
+    c ^= 0x20;
+    ok = ok && fwrite(&c, 1, 1, fp) == 1;
+    if (fp != NULL) {
+        ok = (fclose(fp) == 0) && ok;
+    }
+    ok = ok && (mxjson_tape_open(&tape, tape_path, false) &&
+                !mxjson_tape_open(&tape, tape_path, true));
+    mxjson_tape_close(&tape);
+    mxjson_test_check("tape_checksum", ok);
+
+    /*
+     * A header with a JSON length that wraps the token array offset around
+     * to 0 is rejected, even if the token array then fills the file.
+     */
+    fd = open(tape_path, O_RDWR);
+    ok = (fd != -1 && pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr));
+    hdr.json_len = UINT64_MAX - sizeof(hdr) - 6;
+    hdr.tokens_start = 0;
+    hdr.token_count = 16;
+    ok = ok && (pwrite(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+                ftruncate(fd, 17 * sizeof(mxjson_token_t)) == 0);
+    if (fd != -1) {
+        ok = (close(fd) == 0) && ok;
+    }
+    ok = ok && !mxjson_tape_open(&tape, tape_path, false);
+    mxjson_tape_close(&tape);
+    mxjson_test_check("tape_header_wrap", ok);
+
+    (void)unlink(json_path);
+    (void)unlink(tape_path);
+    mxjson_free(&p);
+}
+
+
+/**
+ * Check the contents of the document detached by mxjson_test_doc() from
+ * {"a": [1, "x\ty"], "b\u0041": true}, through the document API.
+ */
+static bool
+mxjson_test_doc_read (const mxjson_doc_t *doc, mxbuf_t *buffer)
+{
+    bool ok;
+
+    mxbuf_reset(buffer);
+    ok = (doc->token_count == 5 &&
+          mxjson_doc_token(doc, 1)->value_type == MXJSON_OBJECT &&
+          mxjson_doc_first(doc, 1) == 2 &&
+          mxjson_doc_next(doc, 2) == 5 &&
+          mxjson_doc_next(doc, 5) == 6 &&
+          mxjson_doc_depth(doc, 4) == 2 &&
+          mxstr_cmp(mxjson_doc_string(doc, 4, buffer, NULL),
+                    mxstr_literal("x\ty")) == 0 &&
+          mxstr_cmp(mxjson_doc_name(doc, 5, buffer, NULL),
+                    mxstr_literal("bA")) == 0 &&
+          mxstr_cmp(mxjson_doc_string(doc, 3, buffer, NULL),
+                    mxstr_literal("1")) == 0);
+#if MXJSON_SPAN
+    ok = ok && mxstr_cmp(mxjson_doc_raw(doc, 5), mxstr_literal("true")) == 0;
+#endif
+
+    return ok;
+}
+
+
+/**
+ * A thread reading a shared document in mxjson_test_doc().
+ */
+typedef struct {
+    pthread_t           thread; /**< The thread */
+    const mxjson_doc_t *doc;    /**< The thread's reference to the document */
+    bool                ok;     /**< Result of the reads */
+} mxjson_test_reader_t;
+
+
+/**
+ * Thread reading a shared document repeatedly, then releasing its
+ * reference.
+ */
+static void *
+mxjson_test_doc_reader (void *arg)
+{
+    mxjson_test_reader_t *reader = arg;
+    mxbuf_t               buffer;
+    unsigned int          i;
+
+    mxbuf_create(&buffer, NULL, 0);
+    reader->ok = true;
+
+    for (i = 0; reader->ok && i < 1000; i++) {
+        reader->ok = mxjson_test_doc_read(reader->doc, &buffer);
+    }
+
+    mxjson_doc_unref(reader->doc);
+    mxbuf_free(&buffer);
+
+    return NULL;
+}
+
+
+/**
+ * Test detaching part of a parse result from the input JSON.
+ */
+static void
+mxjson_test_doc (void)
+{
+    static const char json[] = "{\"skip\": [1, 2, 3], \"msg\": {\"id\": 42, "
+                               "\"s\": \"a\\nb\", \"e\": {}, \"l\": [true, "
+                               "null], \"\": \"x\"}, \"after\": 1}";
+    mxjson_parser_t      p;
+    mxjson_parser_t      view;
+    mxjson_doc_t        *doc;
+    mxjson_doc_t        *copy;
+    mxjson_test_reader_t readers[8];
+    mxbuf_t              expected;
+    mxbuf_t              buffer;
+    char                *input;
+    size_t               i;
+    bool                 ok;
+
+    mxbuf_create(&expected, NULL, 0);
+    mxbuf_create(&buffer, NULL, 0);
+    input = mxutil_malloc(sizeof(json));
+    memcpy(input, json, sizeof(json));
+
+    /*
+     * Detach the "msg" object (token 6), then overwrite the input and move
+     * the document, which must not affect the result.
+     */
+    mxjson_init(&p, 0, NULL, mxjson_resize);
+    ok = (mxjson_parse(&p, mxstr(input, sizeof(json) - 1)) &&
+          p.tokens[6].value_type == MXJSON_OBJECT);
+    (void)mxjson_write(&p, 6, &expected, 0);
+    doc = mxjson_detach(&p, 6);
+    ok = ok && (doc->size == mxjson_doc_size(&p, 6) &&
+                !mxjson_detach_to(&p, 6, doc, doc->size - 1));
+    mxjson_free(&p);
+    memset(input, ' ', sizeof(json));
+    free(input);
+
+    copy = mxutil_malloc(doc->size);
+    memcpy(copy, doc, doc->size);
+    mxjson_doc_unref(doc);
+
+    mxjson_attach(&view, copy);
+    (void)mxjson_write(&view, 1, &buffer, 0);
+    ok = ok && (view.idx == 8 && copy->text_len < sizeof(json) / 2 &&
+                mxstr_cmp(mxbuf_str(&buffer), mxbuf_str(&expected)) == 0 &&
+                view.tokens[1].parent == MXJSON_IDX_NONE &&
+                mxjson_next(&view, 1) == view.idx + 1 &&
+                mxjson_next(&view, 4) == 5 && mxjson_next(&view, 5) == 8 &&
+                mxjson_depth(&view, 7) == 2 &&
+                view.tokens[8].name != 0 && view.tokens[8].name_size == 0);
+    mxbuf_reset(&buffer);
+    ok = ok && mxstr_cmp(mxjson_token_name(&view, 1, &buffer, NULL),
+                         mxstr_literal("msg")) == 0;
+    ok = ok && mxstr_cmp(mxjson_token_string(&view, 3, &buffer, NULL),
+                         mxstr_literal("a\nb")) == 0;
+#if MXJSON_SPAN
+    ok = ok && (mxstr_cmp(mxjson_token_raw(&view, 2),
+                          mxstr_literal("42")) == 0 &&
+                mxstr_cmp(mxjson_token_raw(&view, 3),
+                          mxstr_literal("\"a\\nb\"")) == 0 &&
+                mxstr_cmp(mxjson_token_raw(&view, 7),
+                          mxstr_literal("null")) == 0);
+#endif
+    mxjson_test_check("doc_detach", ok);
+    free(copy);
+
+    /*
+     * A document of the whole parse result is read through the document
+     * API, and stays valid until the last reference is released, after the
+     * parser context has been reused.
+     */
+    ok = mxjson_parse(&p, mxstr_literal("{\"a\": [1, \"x\\ty\"], "
+                                        "\"b\\u0041\": true}"));
+    doc = mxjson_detach(&p, 1);
+    ok = ok && mxjson_parse(&p, mxstr_literal("[]"));
+    (void)mxjson_doc_ref(doc);
+    mxjson_doc_unref(doc);
+    ok = ok && mxjson_test_doc_read(doc, &buffer);
+    mxjson_doc_unref(doc);
+    mxjson_test_check("doc_shared", ok);
+
+    /*
+     * Several threads read the same document at once, each through its own
+     * reference, and the last to release its reference frees it.
+     */
+    ok = mxjson_parse(&p, mxstr_literal("{\"a\": [1, \"x\\ty\"], "
+                                        "\"b\\u0041\": true}"));
+    doc = mxjson_detach(&p, 1);
+    mxjson_free(&p);
+
+    for (i = 0; i < mxarray_size(readers); i++) {
+        readers[i].doc = mxjson_doc_ref(doc);
+
+        if (pthread_create(&readers[i].thread, NULL, mxjson_test_doc_reader,
+                           &readers[i]) != 0) {
+            mxjson_doc_unref(readers[i].doc);
+            readers[i].doc = NULL;
+            ok = false;
+        }
+    }
+
+    mxjson_doc_unref(doc);
+
+    for (i = 0; i < mxarray_size(readers); i++) {
+        if (readers[i].doc != NULL) {
+            (void)pthread_join(readers[i].thread, NULL);
+            ok = ok && readers[i].ok;
+        }
+    }
+    mxjson_test_check("doc_shared_threads", ok);
+
+    mxbuf_free(&buffer);
+    mxbuf_free(&expected);
+}
+
+
+/**
+ * Callback for mxjson_test_par() to sum the numbers in an array.
+ */
+static void
+mxjson_test_par_sum (void            *ctx,
+                     void            *acc,
+                     mxjson_parser_t *p,
+                     mxjson_idx_t     idx,
+                     size_t           n)
+{
+    UNUSED(ctx);
+    UNUSED(n);
+
+    if (p->tokens[idx].value_type == MXJSON_NUMBER) {
+        *(uint64_t *)acc += strtoull((char *)&p->json.ptr[p->tokens[idx].str],
+                                     NULL, 10);
+    }
+}
+
+
+/**
+ * Callback for mxjson_test_par() to combine the sums from each thread.
+ */
+static void
+mxjson_test_par_combine (void *ctx, void *result, const void *acc)
+{
+    UNUSED(ctx);
+    *(uint64_t *)result += *(const uint64_t *)acc;
+}
+
+
+/**
+ * Callback for mxjson_test_par() to record the position of each child.
+ */
+static void
+mxjson_test_par_mark (void            *ctx,
+                      void            *acc,
+                      mxjson_parser_t *p,
+                      mxjson_idx_t     idx,
+                      size_t           n)
+{
+    UNUSED(acc);
+    UNUSED(p);
+    ((mxjson_idx_t *)ctx)[n] = idx;
+}
+
+
+/**
+ * Test processing the children of an array on a thread pool.
+ */
+static void
+mxjson_test_par (void)
+{
+    static const unsigned int threads[] = { 1, 4 };
+    mxjson_parser_t  p;
+    mxjson_pool_t    pool;
+    mxjson_idx_t    *marks;
+    mxjson_idx_t    *children;
+    mxbuf_t          buffer;
+    char             value[32];
+    uint64_t         sum;
+    size_t           count = 10000;
+    size_t           i;
+    size_t           t;
+    int              len;
+    bool             ok;
+
+    /*
+     * An array of numbers, with nested arrays of different sizes so that
+     * the children are not evenly spaced in the token array.
+     */
+    mxbuf_create(&buffer, NULL, 0);
+    (void)mxbuf_putc(&buffer, '[');
+
+    for (i = 0; i < count; i++) {
+        if (i != 0) {
+            (void)mxbuf_putc(&buffer, ',');
+        }
+
+        if (i % 100 == 0) {
+            len = snprintf(value, sizeof(value), "[%zu, [], 1]", i);
+        } else {
+            len = snprintf(value, sizeof(value), "%zu", i);
+        }
+
+        (void)mxbuf_write(&buffer, mxstr(value, len));
+    }
+
+    (void)mxbuf_putc(&buffer, ']');
+
+    marks = mxutil_calloc(count * sizeof(*marks));
+    children = mxutil_calloc(count * sizeof(*children));
+    mxjson_init(&p, 0, NULL, mxjson_resize);
+    ok = (mxjson_parse(&p, mxbuf_str(&buffer)) &&
+          mxjson_children(&p, 1, children) == count);
+
+    for (t = 0; t < mxarray_size(threads); t++) {
+        ok = ok && mxjson_pool_init(&pool, threads[t]);
+
+        /*
+         * The nested arrays don't contribute to the sum.
+         */
+        sum = 0;
+        mxjson_par_reduce(&pool, &p, 1, mxjson_test_par_sum, NULL, &sum,
+                          sizeof(sum), mxjson_test_par_combine);
+        ok = ok && sum == (uint64_t)count * (count - 1) / 2 - (count / 100) *
+                          (count - 100) / 2;
+
+        memset(marks, 0, count * sizeof(*marks));
+        mxjson_par_foreach(&pool, &p, 1, mxjson_test_par_mark, marks);
+        ok = ok && memcmp(marks, children, count * sizeof(*marks)) == 0;
+
+        /*
+         * The pool is reused for an array with no children.
+         */
+        ok = ok && mxjson_parse(&p, mxstr_literal("[]"));
+        mxjson_par_foreach(&pool, &p, 1, mxjson_test_par_mark, marks);
+        ok = ok && mxjson_parse(&p, mxbuf_str(&buffer));
+        mxjson_pool_free(&pool);
+    }
+
+    mxjson_test_check("par_reduce", ok);
+
+    mxjson_free(&p);
+    free(children);
+    free(marks);
+    mxbuf_free(&buffer);
+}
+
+
 /**
  * Number of tokens to initially allocate, sufficient for any of the
  * testcases in testcases[].
@@ -484,9 +1673,42 @@ int main (void)
     }
     mxbuf_putc(&buffer, '\n');
     mxjson_test("n_structure_open_array_object", &p, mxbuf_str(&buffer));
+
+    /*
+     * Nesting up to MXJSON_MAX_DEPTH is accepted, deeper nesting is
+     * rejected.
+     */
+    mxbuf_reset(&buffer);
+    mxbuf_write_chars(&buffer, '[', MXJSON_MAX_DEPTH);
+    mxbuf_write_chars(&buffer, ']', MXJSON_MAX_DEPTH);
+    mxjson_test("y_structure_max_depth", &p, mxbuf_str(&buffer));
+
+    mxbuf_reset(&buffer);
+    mxbuf_write_chars(&buffer, '[', MXJSON_MAX_DEPTH + 1);
+    mxbuf_write_chars(&buffer, ']', MXJSON_MAX_DEPTH + 1);
+    mxjson_test("n_structure_max_depth_exceeded", &p, mxbuf_str(&buffer));
     mxbuf_free(&buffer);
 
     mxjson_free(&p);
 
+    mxjson_test_write();
+    mxjson_test_writer();
+    mxjson_test_numbers();
+    mxjson_test_unescape();
+    mxjson_test_kernels();
+    mxjson_test_depth();
+    mxjson_test_array_at();
+    mxjson_test_breadth();
+    mxjson_test_lazy();
+    mxjson_test_tape();
+    mxjson_test_doc();
+    mxjson_test_par();
+#if MXJSON_SPAN
+    mxjson_test_span();
+#endif
+#if MXJSON_STATS
+    mxjson_test_stats();
+#endif
+
     return mxjson_test_return_code;
 }